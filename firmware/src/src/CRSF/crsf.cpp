@@ -0,0 +1,109 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <zephyr.h>
+#include "crsf.h"
+#include "auxserial.h"
+#include "log.h"
+#include "trackersettings.h"
+
+/* CRSF output on the auxiliary serial port
+ *
+ *  The calc thread sends a channel frame every cycle, 26 bytes at 420k baud
+ *  take about 0.6ms. This thread owns opening and closing the port and reads
+ *  the link statistics an ELRS or Crossfire module sends back.
+ */
+
+volatile bool crsfopen=false; // AuxSerial is open for CRSF
+
+static CrsfDecoder crsfdecoder;
+static CrsfLinkStats crsflinkstats;
+static volatile uint32_t crsflinktime=0; // (ms) When the last link statistics arrived
+static volatile bool crsflinkvalid=false;
+K_MUTEX_DEFINE(crsf_mutex); // The port being open or closed and the link stats
+
+void CRSF_TX_Send(const uint16_t ch_[16])
+{
+    if(!crsfopen)
+        return;
+
+    uint8_t frame[CRSF_RC_FRAME];
+    int len = crsfEncodeChannels(frame, ch_);
+
+    // The thread can't close the port in between the check and the write
+    k_mutex_lock(&crsf_mutex, K_FOREVER);
+    if(crsfopen)
+        AuxSerial_Write(frame, len);
+    k_mutex_unlock(&crsf_mutex);
+}
+
+bool CRSF_LinkStats(CrsfLinkStats &ls)
+{
+    if(!crsflinkvalid || millis() - crsflinktime > CRSF_LINK_TIMEOUT)
+        return false;
+
+    k_mutex_lock(&crsf_mutex, K_FOREVER);
+    ls = crsflinkstats;
+    k_mutex_unlock(&crsf_mutex);
+    return true;
+}
+
+void crsf_Thread()
+{
+    uint8_t rxbuf[CRSF_MAX_FRAME];
+
+    while(1) {
+        rt_sleep_ms(CRSF_PERIOD);
+
+        if(trkset.serialMode() != TrackerSettings::SERMODE_CRSF) {
+            if(crsfopen) {
+                k_mutex_lock(&crsf_mutex, K_FOREVER);
+                crsfopen = false;
+                crsflinkvalid = false;
+                AuxSerial_Close();
+                k_mutex_unlock(&crsf_mutex);
+            }
+            continue;
+        }
+
+        if(!crsfopen) {
+            // Fails until the last mode has closed the port
+            if(AuxSerial_Open(BAUD420000, CONF8N1) != SERIAL_OK)
+                continue;
+            crsfdecoder.reset();
+            crsfopen = true;
+            LOGI("CRSF output started");
+        }
+
+        uint32_t len;
+        while((len = AuxSerial_Read(rxbuf, sizeof(rxbuf))) > 0) {
+            for(uint32_t i=0; i < len; i++) {
+                if(crsfdecoder.feed(rxbuf[i]) != CRSF_FRAMETYPE_LINK_STATISTICS)
+                    continue;
+
+                CrsfLinkStats ls;
+                if(!crsfParseLinkStats(crsfdecoder.payload(), crsfdecoder.payloadLength(), ls))
+                    continue;
+                k_mutex_lock(&crsf_mutex, K_FOREVER);
+                crsflinkstats = ls;
+                k_mutex_unlock(&crsf_mutex);
+                crsflinktime = millis();
+                crsflinkvalid = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,243 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ESKF.h"
+
+ESKF::ESKF()
+{
+    q[0] = 1; q[1] = 0; q[2] = 0; q[3] = 0;
+    b[0] = 0; b[1] = 0; b[2] = 0;
+    error = 0;
+    boostleft = 0;
+    resetCovariance(0.1f);
+}
+
+void ESKF::resetCovariance(float attvar)
+{
+    for(int i=0; i < ESKF_STATES; i++) {
+        dx[i] = 0;
+        for(int j=0; j < ESKF_STATES; j++)
+            P[i][j] = 0;
+    }
+    for(int i=0; i < 3; i++) {
+        P[i][i] = attvar;
+        P[i+3][i+3] = ESKF_BIAS_START * ESKF_BIAS_START;
+    }
+}
+
+void ESKF::begin(float ax, float ay, float az, float mx, float my, float mz)
+{
+    initialQuat(ax, ay, az, mx, my, mz, q);
+    b[0] = 0; b[1] = 0; b[2] = 0;
+    resetCovariance(0.1f);
+}
+
+// Opens up the attitude uncertainty (startgain, rad) so the first
+// measurements are trusted almost completely
+void ESKF::startConvergence(float startgain, float time)
+{
+    for(int i=0; i < 3; i++) {
+        for(int j=0; j < ESKF_STATES; j++) {
+            P[i][j] = 0;
+            P[j][i] = 0;
+        }
+        P[i][i] = startgain * startgain;
+    }
+    boostleft = time;
+}
+
+void ESKF::update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat)
+{
+    predict(gx, gy, gz, deltat);
+    if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+        correctGravity(ax, ay, az);
+    if(!((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)))
+        correctHeading(mx, my, mz);
+    inject();
+}
+
+void ESKF::updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat)
+{
+    predict(gx, gy, gz, deltat);
+    if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+        correctGravity(ax, ay, az);
+    inject();
+}
+
+// Rotates the orientation by the bias corrected gyro and grows the covariance
+//   P = F P F' + Q,  F = | I-[w]dt  -I dt |
+//                        |    0       I   |
+
+void ESKF::predict(float gx, float gy, float gz, float deltat)
+{
+    if(boostleft > 0)
+        boostleft -= deltat;
+
+    float wx = (gx - b[0]) * deltat;
+    float wy = (gy - b[1]) * deltat;
+    float wz = (gz - b[2]) * deltat;
+
+    // q = q * exp(w dt / 2)
+    float angle = sqrtf(wx*wx + wy*wy + wz*wz);
+    float dq0 = 1.0f, dqs = 0.5f;
+    if(angle > 1e-6f) {
+        dq0 = cosf(angle * 0.5f);
+        dqs = sinf(angle * 0.5f) / angle;
+    }
+    float dq1 = wx * dqs, dq2 = wy * dqs, dq3 = wz * dqs;
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    q[0] = q0*dq0 - q1*dq1 - q2*dq2 - q3*dq3;
+    q[1] = q0*dq1 + q1*dq0 + q2*dq3 - q3*dq2;
+    q[2] = q0*dq2 - q1*dq3 + q2*dq0 + q3*dq1;
+    q[3] = q0*dq3 + q1*dq2 - q2*dq1 + q3*dq0;
+    float n = 1.0f / sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    q[0] *= n; q[1] *= n; q[2] *= n; q[3] *= n;
+
+    float F[ESKF_STATES][ESKF_STATES] = {
+        {    1,  wz, -wy, -deltat, 0, 0},
+        {  -wz,   1,  wx, 0, -deltat, 0},
+        {   wy, -wx,   1, 0, 0, -deltat},
+        {    0,   0,   0, 1, 0, 0},
+        {    0,   0,   0, 0, 1, 0},
+        {    0,   0,   0, 0, 0, 1}};
+
+    // Lower half of F is identity so only the top three rows need multiplying
+    float FP[ESKF_STATES][ESKF_STATES];
+    for(int i=0; i < 3; i++)
+        for(int j=0; j < ESKF_STATES; j++) {
+            float s = 0;
+            for(int k=0; k < ESKF_STATES; k++)
+                s += F[i][k] * P[k][j];
+            FP[i][j] = s;
+        }
+    for(int i=3; i < ESKF_STATES; i++)
+        for(int j=0; j < ESKF_STATES; j++)
+            FP[i][j] = P[i][j];
+
+    for(int i=0; i < ESKF_STATES; i++)
+        for(int j=i; j < ESKF_STATES; j++) {
+            float s;
+            if(j < 3) {
+                s = 0;
+                for(int k=0; k < ESKF_STATES; k++)
+                    s += FP[i][k] * F[j][k];
+            } else {
+                s = FP[i][j];
+            }
+            P[i][j] = s;
+            P[j][i] = s;
+        }
+
+    float qa = ESKF_GYRO_NOISE * ESKF_GYRO_NOISE * deltat;
+    float qb = ESKF_BIAS_NOISE * ESKF_BIAS_NOISE * deltat;
+    for(int i=0; i < 3; i++) {
+        P[i][i] += qa;
+        P[i+3][i+3] += qb;
+    }
+}
+
+// Measured vs predicted gravity direction, H = [ [h]x  0 ]
+
+void ESKF::correctGravity(float ax, float ay, float az)
+{
+    float an = sqrtf(ax*ax + ay*ay + az*az);
+    ax /= an; ay /= an; az /= an;
+
+    // Less trust when accelerating, magnitude away from 1g
+    float sd = ESKF_ACCEL_NOISE + ESKF_ACCEL_DYN * fabsf(an - 1.0f);
+    float var = sd * sd;
+
+    float hx = 2.0f * (q[1]*q[3] - q[0]*q[2]);
+    float hy = 2.0f * (q[0]*q[1] + q[2]*q[3]);
+    float hz = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+
+    float rx = ax - hx, ry = ay - hy, rz = az - hz;
+    error = sqrtf(rx*rx + ry*ry + rz*rz);
+
+    float H0[ESKF_STATES] = {  0, -hz,  hy, 0, 0, 0};
+    float H1[ESKF_STATES] = { hz,   0, -hx, 0, 0, 0};
+    float H2[ESKF_STATES] = {-hy,  hx,   0, 0, 0, 0};
+    scalarUpdate(H0, rx, var);
+    scalarUpdate(H1, ry, var);
+    scalarUpdate(H2, rz, var);
+}
+
+// Heading of the field in the earth frame should be north (0). Only a
+// rotation about earth Z is corrected, H = third row of the rotation matrix
+
+void ESKF::correctHeading(float mx, float my, float mz)
+{
+    float ex = (1.0f - 2.0f*(q[2]*q[2] + q[3]*q[3])) * mx +
+               2.0f*(q[1]*q[2] - q[0]*q[3]) * my +
+               2.0f*(q[1]*q[3] + q[0]*q[2]) * mz;
+    float ey = 2.0f*(q[1]*q[2] + q[0]*q[3]) * mx +
+               (1.0f - 2.0f*(q[1]*q[1] + q[3]*q[3])) * my +
+               2.0f*(q[2]*q[3] - q[0]*q[1]) * mz;
+    if(ex*ex + ey*ey < 1e-12f)
+        return;
+
+    float H[ESKF_STATES] = {
+        2.0f*(q[1]*q[3] - q[0]*q[2]),
+        2.0f*(q[2]*q[3] + q[0]*q[1]),
+        1.0f - 2.0f*(q[1]*q[1] + q[2]*q[2]),
+        0, 0, 0};
+    scalarUpdate(H, -atan2f(ey, ex), ESKF_HEADING_NOISE * ESKF_HEADING_NOISE);
+}
+
+// One row of a measurement, sequential updates avoid any matrix inverse
+
+void ESKF::scalarUpdate(const float H[ESKF_STATES], float residual, float variance)
+{
+    float PH[ESKF_STATES];
+    float S = variance;
+    float innov = residual;
+    for(int i=0; i < ESKF_STATES; i++) {
+        float s = 0;
+        for(int j=0; j < ESKF_STATES; j++)
+            s += P[i][j] * H[j];
+        PH[i] = s;
+        S += H[i] * s;
+        innov -= H[i] * dx[i];
+    }
+
+    float invS = 1.0f / S;
+    for(int i=0; i < ESKF_STATES; i++) {
+        dx[i] += PH[i] * invS * innov;
+        for(int j=i; j < ESKF_STATES; j++) {
+            P[i][j] -= PH[i] * PH[j] * invS;
+            P[j][i] = P[i][j];
+        }
+    }
+}
+
+// Folds the error state into the orientation and bias, then clears it
+
+void ESKF::inject()
+{
+    float d1 = dx[0] * 0.5f, d2 = dx[1] * 0.5f, d3 = dx[2] * 0.5f;
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    q[0] = q0 - q1*d1 - q2*d2 - q3*d3;
+    q[1] = q1 + q0*d1 + q2*d3 - q3*d2;
+    q[2] = q2 - q1*d3 + q0*d2 + q3*d1;
+    q[3] = q3 + q1*d2 - q2*d1 + q0*d3;
+    float n = 1.0f / sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    q[0] *= n; q[1] *= n; q[2] *= n; q[3] *= n;
+
+    b[0] += dx[3]; b[1] += dx[4]; b[2] += dx[5];
+    for(int i=0; i < ESKF_STATES; i++)
+        dx[i] = 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <zephyr.h>
+#include <math.h>
+#include "defines.h"
+#include "fusionengine.h"
+
+/* Error state (indirect) Kalman filter
+ *
+ *  Nominal state is the orientation quaternion and the gyro bias. The filter
+ *  runs on the 6 element error state, a small body frame rotation and a bias
+ *  error, which is folded back into the nominal state after every update.
+ *
+ *  Gravity corrects tilt/roll, the accel noise grows as the magnitude moves
+ *  away from 1g so linear acceleration is trusted less. The magnetometer only
+ *  corrects heading, it can't pull tilt or roll.
+ *
+ *  Unlike Madgwick/Mahony the gyro bias is estimated so slow drift left after
+ *  the gyro calibration is removed too.
+ */
+
+#define ESKF_STATES 6
+
+class ESKF : public FusionEngine {
+public:
+    ESKF();
+    const char *name() override {return "ESKF";}
+    void begin(float ax, float ay, float az, float mx, float my, float mz) override;
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat) override;
+    void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat) override;
+    void startConvergence(float startgain, float time) override;
+    bool converging() override {return boostleft > 0;}
+    float getError() override {return error;} // Last accel innovation (rad), 0 = sensors agree
+    float *getQuat() override {return q;}
+    const float *getBias() {return b;} // Estimated gyro bias (rad/s)
+
+private:
+    void predict(float gx, float gy, float gz, float deltat);
+    void correctGravity(float ax, float ay, float az);
+    void correctHeading(float mx, float my, float mz);
+    void scalarUpdate(const float h[ESKF_STATES], float residual, float variance);
+    void inject();
+    void resetCovariance(float attvar);
+
+    float q[4];               // Orientation, sensor to earth
+    float b[3];               // Gyro bias (rad/s)
+    float dx[ESKF_STATES];    // Error state, attitude (rad) then bias
+    float P[ESKF_STATES][ESKF_STATES];
+    float error;
+    float boostleft;
+};
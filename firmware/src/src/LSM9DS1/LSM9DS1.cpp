@@ -250,7 +250,7 @@ int LSM9DS1Class::setAccelFS(uint8_t range) // 0: ±2g ; 1: ±16g ; 2: ±4g ; 3:
 }
 
 float LSM9DS1Class::getAccelFS() // Full scale dimensionless, but its value corresponds to g
-{ float ranges[] ={2.0, 24.0, 4.0, 8.0}; //g
+{ float ranges[] ={2.0, 16.0, 4.0, 8.0}; //g
   if(!storedAccelFS) {
     lastAccelFS = (readRegister(LSM9DS1_ADDRESS, LSM9DS1_CTRL_REG6_XL) & 0x18) >> 3;
     storedAccelFS = true;
@@ -372,7 +372,7 @@ float LSM9DS1Class::getGyroBW()
    return BWtable[ODR][BW];
 }
 
-int LSM9DS1Class::setGyroFS(uint8_t range) // (0: 245 dps; 1: 500 dps; 2: 1000  dps; 3: 2000 dps)
+int LSM9DS1Class::setGyroFS(uint8_t range) // (0: 245 dps; 1: 500 dps; 2: not available; 3: 2000 dps)
 {  if (range >=4) return 0;
    lastGyroFS = range;
    storedGyroFS = true;
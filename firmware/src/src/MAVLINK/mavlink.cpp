@@ -0,0 +1,126 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <zephyr.h>
+#include <math.h>
+#include "mavlink.h"
+#include "auxserial.h"
+#include "log.h"
+#include "trackersettings.h"
+
+/* MAVLink gimbal control on the auxiliary serial port
+ *
+ *  The calc thread sends the head's attitude every cycle, to the flight
+ *  controller's gimbal manager or straight to a MAVLink gimbal, along with a
+ *  heartbeat once a second so the tracker shows up as a ground station. This
+ *  thread only opens and closes the port.
+ *
+ *  Roll and pitch are sent locked to the horizon and yaw follows the vehicle,
+ *  the same way the tracker's outputs act on a servo gimbal.
+ */
+
+volatile bool mavopen=false; // AuxSerial is open for MAVLink
+K_MUTEX_DEFINE(mav_mutex); // The port being open or closed
+
+static uint8_t mavseq=0;
+static uint32_t mavhbtime=0; // (ms) Last heartbeat
+
+static constexpr int MAV_FRAME_MAX = mavlinkFrameLen(MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE.length);
+static_assert(mavlinkFrameLen(MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE.length) <= MAV_FRAME_MAX &&
+              mavlinkFrameLen(MAVLINK_MSG_HEARTBEAT.length) <= MAV_FRAME_MAX, "MAVLink frame buffer too small");
+
+static void mavWrite(uint8_t *frame, int len)
+{
+    if(AuxSerial_Write(frame, len) == 0)
+        mavseq++;
+}
+
+// Heartbeat if one is due then the attitude, port must be open
+static void sendAttitude(const float q[4])
+{
+    uint8_t frame[MAV_FRAME_MAX];
+    MavlinkHeader hdr = {mavseq, MAVLINK_SYSID, MAVLINK_COMPID};
+
+    if(millis() - mavhbtime >= MAVLINK_HEARTBEAT_PERIOD) {
+        mavhbtime = millis();
+        mavWrite(frame, mavlinkEncodeHeartbeat(frame, hdr, MAV_TYPE_GCS,
+                                               MAV_AUTOPILOT_INVALID, MAV_STATE_ACTIVE));
+        hdr.seq = mavseq;
+    }
+
+    // Cycles faster than the baud rate can carry are dropped here rather than
+    // queued, a late attitude is worse than a skipped one
+    if(AuxSerial_TXPending() > 0)
+        return;
+
+    static const float angvel[3] = {NAN, NAN, NAN}; // Gimbal works out its own rates
+    int len;
+    if(trkset.MAVGimbalDevice())
+        len = mavlinkEncodeGimbalDeviceSetAttitude(frame, hdr, MAVLINK_TARGET_SYSID, MAV_COMP_ID_GIMBAL,
+                                                   GIMBAL_FLAGS_ROLL_LOCK | GIMBAL_FLAGS_PITCH_LOCK,
+                                                   q, angvel);
+    else
+        len = mavlinkEncodeGimbalManagerSetAttitude(frame, hdr, MAVLINK_TARGET_SYSID, MAV_COMP_ID_AUTOPILOT1,
+                                                    0, // All of the manager's gimbals
+                                                    GIMBAL_FLAGS_ROLL_LOCK | GIMBAL_FLAGS_PITCH_LOCK,
+                                                    q, angvel);
+    mavWrite(frame, len);
+}
+
+void MAV_TX_SendAttitude(const float q[4])
+{
+    if(!mavopen)
+        return;
+
+    // The thread can't close the port in between the check and the writes
+    k_mutex_lock(&mav_mutex, K_FOREVER);
+    if(mavopen)
+        sendAttitude(q);
+    k_mutex_unlock(&mav_mutex);
+}
+
+void mavlink_Thread()
+{
+    uint8_t rxbuf[64];
+
+    while(1) {
+        rt_sleep_ms(MAVLINK_PERIOD);
+
+        if(trkset.serialMode() != TrackerSettings::SERMODE_MAVLINK) {
+            if(mavopen) {
+                k_mutex_lock(&mav_mutex, K_FOREVER);
+                mavopen = false;
+                AuxSerial_Close();
+                k_mutex_unlock(&mav_mutex);
+            }
+            continue;
+        }
+
+        if(!mavopen) {
+            // Fails until the last mode has closed the port
+            if(AuxSerial_Open(MAVLINK_BAUD, CONF8N1) != SERIAL_OK)
+                continue;
+            mavhbtime = millis() - MAVLINK_HEARTBEAT_PERIOD; // Heartbeat goes first
+            mavopen = true;
+            LOGI("MAVLink output started");
+        }
+
+        // Nothing is read back yet, just keep the flight controller's stream
+        // from filling the receive buffer
+        while(AuxSerial_Read(rxbuf, sizeof(rxbuf)) > 0);
+    }
+}
@@ -38,11 +38,31 @@
 //============================================================================================
 // Functions
 
+//-------------------------------------------------------------------------------------------
+// Inverse square-root
+// The M4F FPU does a single precision square root (14 cycles) and divide (14 cycles)
+// in hardware, faster and exact compared to the bit hack with two Newton steps.
+// sqrtf() can't be used directly as it's kept as a libm call to set errno.
+
+inline float Madgwick::invSqrt(float x) {
+#if defined(__ARM_FP) && (__ARM_FP & 0x4)
+	float r;
+	__asm__ ("vsqrt.f32 %0, %1" : "=t"(r) : "t"(x));
+	return 1.0f / r;
+#else
+	return 1.0f / sqrtf(x);
+#endif
+}
+
 //-------------------------------------------------------------------------------------------
 // AHRS algorithm update
 
 Madgwick::Madgwick() {
 	beta = betaDef;
+	boostbeta = betaDef;
+	boosttime = 0;
+	boostleft = 0;
+	gradsq = 0;
 	q0 = 1.0f;
 	q1 = 0.0f;
 	q2 = 0.0f;
@@ -94,12 +114,31 @@ void Madgwick::begin(float ax, float ay, float az, float mx, float my, float mz)
 	anglesComputed = 0;
 }
 
+// Starts the gain at startbeta, falling linearly to the normal beta over time
+// seconds. A large gain pulls a poor initial orientation in quickly, the
+// normal one keeps it smooth after
+void Madgwick::startConvergence(float startbeta, float time) {
+	boostbeta = startbeta;
+	boosttime = time;
+	boostleft = time;
+}
+
+float Madgwick::scheduledBeta(float deltat) {
+	if(boostleft <= 0)
+		return beta;
+	float b = beta + (boostbeta - beta) * (boostleft / boosttime);
+	boostleft -= deltat;
+	return b;
+}
+
 void Madgwick::update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat) {
 	float recipNorm;
 	float s0, s1, s2, s3;
 	float qDot1, qDot2, qDot3, qDot4;
 	float hx, hy;
-	float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	float _2bxq0, _2bxq1, _2bxq2, _2bxq3, _2bzq0, _2bzq1, _2bzq2, _2bzq3;
+	float f1, f2, f3, f4, f5, f6;
 
 	// Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
 	if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
@@ -155,25 +194,34 @@ void Madgwick::update(float gx, float gy, float gz, float ax, float ay, float az
 		hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
 		_2bx = sqrtf(hx * hx + hy * hy);
 		_2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
-		_4bx = 2.0f * _2bx;
-		_4bz = 2.0f * _2bz;
+
+		// Objective function, estimated minus measured field directions.
+		// Each term is shared by several gradient components
+		f1 = 2.0f * q1q3 - _2q0q2 - ax;
+		f2 = 2.0f * q0q1 + _2q2q3 - ay;
+		f3 = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+		f4 = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+		f5 = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+		f6 = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+		_2bxq0 = _2bx * q0; _2bxq1 = _2bx * q1; _2bxq2 = _2bx * q2; _2bxq3 = _2bx * q3;
+		_2bzq0 = _2bz * q0; _2bzq1 = _2bz * q1; _2bzq2 = _2bz * q2; _2bzq3 = _2bz * q3;
 
 		// Gradient decent algorithm corrective step
-		s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-		s0 *= recipNorm;
-		s1 *= recipNorm;
-		s2 *= recipNorm;
-		s3 *= recipNorm;
-
-		// Apply feedback step
-		qDot1 -= beta * s0;
-		qDot2 -= beta * s1;
-		qDot3 -= beta * s2;
-		qDot4 -= beta * s3;
+		s0 = -_2q2 * f1 + _2q1 * f2 - _2bzq2 * f4 + (_2bzq1 - _2bxq3) * f5 + _2bxq2 * f6;
+		s1 = _2q3 * f1 + _2q0 * f2 - 2.0f * _2q1 * f3 + _2bzq3 * f4 + (_2bxq2 + _2bzq0) * f5 + (_2bxq3 - 2.0f * _2bzq1) * f6;
+		s2 = -_2q0 * f1 + _2q3 * f2 - 2.0f * _2q2 * f3 - (2.0f * _2bxq2 + _2bzq0) * f4 + (_2bxq1 + _2bzq3) * f5 + (_2bxq0 - 2.0f * _2bzq2) * f6;
+		s3 = _2q1 * f1 + _2q2 * f2 + (_2bzq1 - 2.0f * _2bxq3) * f4 + (_2bzq2 - _2bxq0) * f5 + _2bxq1 * f6;
+		gradsq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+
+		// Apply feedback step, normalised. Skipped if already at the minimum
+		float b = scheduledBeta(deltat);
+		if(gradsq > 0.0f) {
+			recipNorm = b * invSqrt(gradsq);
+			qDot1 -= recipNorm * s0;
+			qDot2 -= recipNorm * s1;
+			qDot3 -= recipNorm * s2;
+			qDot4 -= recipNorm * s3;
+		}
 	}
 
 	// Integrate rate of change of quaternion to yield quaternion
@@ -235,17 +283,17 @@ void Madgwick::updateIMU(float gx, float gy, float gz, float ax, float ay, float
 		s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
 		s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
 		s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
-		recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-		s0 *= recipNorm;
-		s1 *= recipNorm;
-		s2 *= recipNorm;
-		s3 *= recipNorm;
-
-		// Apply feedback step
-		qDot1 -= beta * s0;
-		qDot2 -= beta * s1;
-		qDot3 -= beta * s2;
-		qDot4 -= beta * s3;
+		gradsq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+
+		// Apply feedback step, normalised. Skipped if already at the minimum
+		float b = scheduledBeta(deltat);
+		if(gradsq > 0.0f) {
+			recipNorm = b * invSqrt(gradsq);
+			qDot1 -= recipNorm * s0;
+			qDot2 -= recipNorm * s1;
+			qDot3 -= recipNorm * s2;
+			qDot4 -= recipNorm * s3;
+		}
 	}
 
 	// Integrate rate of change of quaternion to yield quaternion
@@ -263,31 +311,26 @@ void Madgwick::updateIMU(float gx, float gy, float gz, float ax, float ay, float
 	anglesComputed = 0;
 }
 
-//-------------------------------------------------------------------------------------------
-// Fast inverse square-root
-// See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
-
-float Madgwick::invSqrt(float x) {
-	float halfx = 0.5f * x;
-	float y = x;
-	uint32_t i;
-    static_assert(sizeof(x) == sizeof(i));
-    memcpy(&i, &x, sizeof(i));
-	i = 0x5f3759df - (i>>1);
-    memcpy(&y,&i,sizeof(y));
-	y = y * (1.5f - (halfx * y * y));
-	y = y * (1.5f - (halfx * y * y));
-	return y;
-}
-
 // Aligns two vectors (changes quaternion!)
 void Madgwick::align(float ax, float ay, float az, float bx, float by, float bz) {
 	float va, vx, vy, vz; // rotation angle and vector
 	cross(ax, ay, az, bx, by, bz, vx, vy, vz);
 	norm(ax, ay, az);
 	norm(bx, by, bz);
+	float d = dot(ax, ay, az, bx, by, bz);
+
+	// Parallel vectors have no cross product to normalize, the exact root
+	// in invSqrt makes that inf * 0. Nothing to do if already aligned, any
+	// axis at right angles works when opposite
+	if(dot(vx, vy, vz, vx, vy, vz) == 0) {
+		if(d > 0)
+			return;
+		cross(ax, ay, az, 1, 0, 0, vx, vy, vz);
+		if(dot(vx, vy, vz, vx, vy, vz) == 0)
+			cross(ax, ay, az, 0, 1, 0, vx, vy, vz);
+	}
 	norm(vx, vy, vz);
-	va = acos(dot(ax, ay, az, bx, by, bz));
+	va = acos(d > 1 ? 1 : (d < -1 ? -1 : d));
 	float a2 = cos(va/2);
 	float b2 = vx*sin(va/2);
 	float c2 = vy*sin(va/2);
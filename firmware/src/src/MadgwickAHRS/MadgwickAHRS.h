@@ -20,16 +20,22 @@
 #include <math.h>
 #include <string.h>
 #include "defines.h"
+#include "fusionengine.h"
 
 //--------------------------------------------------------------------------------------------
 // Variable declaration
-class Madgwick{
+class Madgwick : public FusionEngine {
 private:
     static float invSqrt(float x);
     static float dot(float ax, float ay, float az, float bx, float by, float bz);
     static void cross(float ax, float ay, float az, float bx, float by, float bz, float &cx, float &cy, float &cz);
     static void norm(float &ax, float &ay, float &az);
     float beta;				// algorithm gain
+    float boostbeta;		// gain at the start of convergence
+    float boosttime;		// (s) time to fall from boostbeta to beta
+    float boostleft;
+    float gradsq;			// squared magnitude of the last error gradient
+    float scheduledBeta(float deltat);
     float q0;
     float q1;
     float q2;
@@ -37,11 +43,8 @@ private:
     float roll;
     float pitch;
     float yaw;
-    float deltat;
-    float lastUpdate;
     char anglesComputed;
     float _copyQuat[4];	// copy buffer to protect the quaternion values since getters!=setters
-    float Now;
     void computeAngles();
     void align(float ax, float ay, float az, float bx, float by, float bz);
     void combine(float p0, float p1, float p2, float p3);
@@ -52,21 +55,25 @@ private:
 // Function declarations
 public:
     Madgwick(void);
+    const char *name() override {return "Madgwick";}
     void begin(float pitch, float roll, float yaw);
-    void begin(float ax, float ay, float az, float mx, float my, float mz);
+    void begin(float ax, float ay, float az, float mx, float my, float mz) override;
     void setGain(float gain) {beta = gain;}
-    void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat);
-    void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat);
+    void startConvergence(float startbeta, float time) override;
+    bool converging() override {return boostleft > 0;}
+    float getError() override {return sqrtf(gradsq);} // Gradient of the orientation error, 0 = sensors agree
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat) override;
+    void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat) override;
 
-    float getRoll() {
+    float getRoll() override {
         if (!anglesComputed) computeAngles();
         return roll * 57.29578f;
     }
-    float getPitch() {
+    float getPitch() override {
         if (!anglesComputed) computeAngles();
         return pitch * 57.29578f;
     }
-    float getYaw() {
+    float getYaw() override {
         if (!anglesComputed) computeAngles();
         return yaw * 57.29578f;
     }
@@ -83,15 +90,8 @@ public:
         return yaw;
     }
 
-    float* getQuat() {
+    float* getQuat() override {
 		memcpy(_copyQuat, &q0, sizeof(float)*4);
 		return _copyQuat;
 	}
-
-    float deltatUpdate (){
-		Now = micros64();
-		deltat = ((Now - lastUpdate) / 1000000.0f); // set integration time by time elapsed since last filter update
-		lastUpdate = Now;
-		return deltat;
-	}
 };
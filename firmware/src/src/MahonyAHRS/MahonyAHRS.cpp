@@ -0,0 +1,250 @@
+//=============================================================================================
+// MahonyAHRS.c
+//=============================================================================================
+//
+// Madgwick's implementation of Mahony's AHRS algorithm.
+// See: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+//
+// From the x-io website "Open-source resources available on this website are
+// provided under the GNU General Public Licence unless an alternative licence
+// is provided in source."
+//
+// Date			Author			Notes
+// 29/09/2011	SOH Madgwick    Initial release
+// 02/10/2011	SOH Madgwick	Optimised for reduced CPU load
+//
+//=============================================================================================
+
+/* Modified to use a measured period every update and to share the feedback
+ * and integration steps between the 9 and 6 axis updates.
+ */
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "MahonyAHRS.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+#define twoKpDef	(2.0f * 2.0f)	// 2 * proportional gain
+#define twoKiDef	(2.0f * 0.1f)	// 2 * integral gain
+
+//============================================================================================
+// Functions
+
+Mahony::Mahony()
+{
+	twoKp = twoKpDef;
+	twoKi = twoKiDef;
+	boostkp = twoKpDef;
+	boosttime = 0;
+	boostleft = 0;
+	errsq = 0;
+	q0 = 1.0f;
+	q1 = 0.0f;
+	q2 = 0.0f;
+	q3 = 0.0f;
+	integralFBx = 0.0f;
+	integralFBy = 0.0f;
+	integralFBz = 0.0f;
+}
+
+void Mahony::begin(float ax, float ay, float az, float mx, float my, float mz)
+{
+	float q[4];
+	initialQuat(ax, ay, az, mx, my, mz, q);
+	q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3];
+	integralFBx = 0.0f;
+	integralFBy = 0.0f;
+	integralFBz = 0.0f;
+}
+
+// Starts Kp at startkp, falling linearly to the normal Kp over time seconds
+void Mahony::startConvergence(float startkp, float time)
+{
+	boostkp = 2.0f * startkp;
+	boosttime = time;
+	boostleft = time;
+}
+
+float Mahony::scheduledKp(float deltat)
+{
+	if(boostleft <= 0)
+		return twoKp;
+	float k = twoKp + (boostkp - twoKp) * (boostleft / boosttime);
+	boostleft -= deltat;
+	return k;
+}
+
+//-------------------------------------------------------------------------------------------
+// AHRS algorithm update
+
+void Mahony::update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat)
+{
+	float recipNorm;
+	float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	float hx, hy, bx, bz;
+	float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+	float halfex, halfey, halfez;
+
+	// Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
+	if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+		updateIMU(gx, gy, gz, ax, ay, az, deltat);
+		return;
+	}
+
+	// Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+	if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+		// Normalise accelerometer measurement
+		recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+		ax *= recipNorm;
+		ay *= recipNorm;
+		az *= recipNorm;
+
+		// Normalise magnetometer measurement
+		recipNorm = invSqrt(mx * mx + my * my + mz * mz);
+		mx *= recipNorm;
+		my *= recipNorm;
+		mz *= recipNorm;
+
+		// Auxiliary variables to avoid repeated arithmetic
+		q0q0 = q0 * q0;
+		q0q1 = q0 * q1;
+		q0q2 = q0 * q2;
+		q0q3 = q0 * q3;
+		q1q1 = q1 * q1;
+		q1q2 = q1 * q2;
+		q1q3 = q1 * q3;
+		q2q2 = q2 * q2;
+		q2q3 = q2 * q3;
+		q3q3 = q3 * q3;
+
+		// Reference direction of Earth's magnetic field
+		hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+		hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+		bx = sqrtf(hx * hx + hy * hy);
+		bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+		// Estimated direction of gravity and magnetic field
+		halfvx = q1q3 - q0q2;
+		halfvy = q0q1 + q2q3;
+		halfvz = q0q0 - 0.5f + q3q3;
+		halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+		halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+		halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+		// Error is sum of cross product between estimated direction and measured direction of field vectors
+		halfex = (ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy);
+		halfey = (az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz);
+		halfez = (ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx);
+
+		feedback(gx, gy, gz, halfex, halfey, halfez, deltat);
+	}
+
+	integrate(gx, gy, gz, deltat);
+}
+
+//-------------------------------------------------------------------------------------------
+// IMU algorithm update
+
+void Mahony::updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat)
+{
+	float recipNorm;
+	float halfvx, halfvy, halfvz;
+	float halfex, halfey, halfez;
+
+	// Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+	if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+		// Normalise accelerometer measurement
+		recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+		ax *= recipNorm;
+		ay *= recipNorm;
+		az *= recipNorm;
+
+		// Estimated direction of gravity
+		halfvx = q1 * q3 - q0 * q2;
+		halfvy = q0 * q1 + q2 * q3;
+		halfvz = q0 * q0 - 0.5f + q3 * q3;
+
+		// Error is sum of cross product between estimated and measured direction of gravity
+		halfex = (ay * halfvz - az * halfvy);
+		halfey = (az * halfvx - ax * halfvz);
+		halfez = (ax * halfvy - ay * halfvx);
+
+		feedback(gx, gy, gz, halfex, halfey, halfez, deltat);
+	}
+
+	integrate(gx, gy, gz, deltat);
+}
+
+// Applies the PI correction to the gyro rates
+void Mahony::feedback(float &gx, float &gy, float &gz, float halfex, float halfey, float halfez, float deltat)
+{
+	errsq = 4.0f * (halfex * halfex + halfey * halfey + halfez * halfez);
+
+	// Compute and apply integral feedback if enabled
+	if(twoKi > 0.0f) {
+		integralFBx += twoKi * halfex * deltat;	// integral error scaled by Ki
+		integralFBy += twoKi * halfey * deltat;
+		integralFBz += twoKi * halfez * deltat;
+		gx += integralFBx;	// apply integral feedback
+		gy += integralFBy;
+		gz += integralFBz;
+	} else {
+		integralFBx = 0.0f;	// prevent integral windup
+		integralFBy = 0.0f;
+		integralFBz = 0.0f;
+	}
+
+	// Apply proportional feedback
+	float kp = scheduledKp(deltat);
+	gx += kp * halfex;
+	gy += kp * halfey;
+	gz += kp * halfez;
+}
+
+// Integrate rate of change of quaternion
+void Mahony::integrate(float gx, float gy, float gz, float deltat)
+{
+	float recipNorm;
+	float qa, qb, qc;
+
+	gx *= (0.5f * deltat);		// pre-multiply common factors
+	gy *= (0.5f * deltat);
+	gz *= (0.5f * deltat);
+	qa = q0;
+	qb = q1;
+	qc = q2;
+	q0 += (-qb * gx - qc * gy - q3 * gz);
+	q1 += (qa * gx + qc * gz - q3 * gy);
+	q2 += (qa * gy - qb * gz + q3 * gx);
+	q3 += (qa * gz + qb * gy - qc * gx);
+
+	// Normalise quaternion
+	recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	q0 *= recipNorm;
+	q1 *= recipNorm;
+	q2 *= recipNorm;
+	q3 *= recipNorm;
+}
+
+//-------------------------------------------------------------------------------------------
+// Fast inverse square-root
+// See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
+
+float Mahony::invSqrt(float x)
+{
+	float halfx = 0.5f * x;
+	float y = x;
+	uint32_t i;
+	static_assert(sizeof(x) == sizeof(i));
+	memcpy(&i, &x, sizeof(i));
+	i = 0x5f3759df - (i>>1);
+	memcpy(&y, &i, sizeof(y));
+	y = y * (1.5f - (halfx * y * y));
+	y = y * (1.5f - (halfx * y * y));
+	return y;
+}
@@ -0,0 +1,55 @@
+//=============================================================================================
+// MahonyAHRS.h
+//=============================================================================================
+//
+// Madgwick's implementation of Mahony's AHRS algorithm.
+// See: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+//
+// From the x-io website "Open-source resources available on this website are
+// provided under the GNU General Public Licence unless an alternative licence
+// is provided in source."
+//
+// Date			Author			Notes
+// 29/09/2011	SOH Madgwick    Initial release
+// 02/10/2011	SOH Madgwick	Optimised for reduced CPU load
+//
+//=============================================================================================
+#pragma once
+
+#include <zephyr.h>
+#include <math.h>
+#include <string.h>
+#include "defines.h"
+#include "fusionengine.h"
+
+class Mahony : public FusionEngine {
+private:
+    static float invSqrt(float x);
+    float twoKp;		// 2 * proportional gain (Kp)
+    float twoKi;		// 2 * integral gain (Ki)
+    float boostkp;		// twoKp at the start of convergence
+    float boosttime;	// (s) time to fall from boostkp to twoKp
+    float boostleft;
+    float errsq;		// squared magnitude of the last error vector
+    float q0, q1, q2, q3;	// quaternion of sensor frame relative to auxiliary frame
+    float _copyQuat[4];
+    float integralFBx, integralFBy, integralFBz;  // integral error terms scaled by Ki
+    float scheduledKp(float deltat);
+    void feedback(float &gx, float &gy, float &gz, float halfex, float halfey, float halfez, float deltat);
+    void integrate(float gx, float gy, float gz, float deltat);
+
+public:
+    Mahony(void);
+    const char *name() override {return "Mahony";}
+    void begin(float ax, float ay, float az, float mx, float my, float mz) override;
+    void setGains(float kp, float ki) {twoKp = 2.0f * kp; twoKi = 2.0f * ki;}
+    void startConvergence(float startkp, float time) override;
+    bool converging() override {return boostleft > 0;}
+    float getError() override {return sqrtf(errsq);} // Angle between measured and estimated directions
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat) override;
+    void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat) override;
+    float *getQuat() override {
+        _copyQuat[0] = q0; _copyQuat[1] = q1; _copyQuat[2] = q2; _copyQuat[3] = q3;
+        return _copyQuat;
+    }
+};
@@ -24,11 +24,15 @@
 #include "io.h"
 #include "log.h"
 #include "trackersettings.h"
+#include "chanpack.h"
 #include <nrfx.h>
 #include <nrfx_uarte.h>
 
 #define SBUS_FRAME_LEN   25
 
+static_assert(TrackerSettings::SBUS_CENTER == chanpack::CH_CENTER &&
+              TrackerSettings::PPM_CENTER == chanpack::PPM_CENTER, "SBUS scaling differs from chanpack");
+
 static constexpr uint8_t HEADER_ = 0x0F;
 static constexpr uint8_t FOOTER_ = 0x00;
 static constexpr uint8_t FOOTER2_ = 0x04;
@@ -44,12 +48,21 @@ static constexpr uint8_t FAILSAFE_MASK_ = 0x08;
 static bool failsafe_ = false, lost_frame_ = false, ch17_ = false, ch18_ = false;
 
 volatile bool sbusTreadRun=false;
-volatile bool sbusBuildingData=false;
 volatile bool sbusoutinv=false;
 volatile bool sbusininv=false;
 volatile bool sbusinsof=false; // Start of Frame
+volatile bool sbustimed=false; // Hardware timer is sending the frames
+volatile bool sbusopen=false; // AuxSerial is open for SBUS
+
+// Output frames. The calc thread fills one that is neither waiting to be sent
+// nor possibly still going out, then makes it the ready one. Two aren't
+// enough when the calc thread runs faster than the SBUS rate, it would have
+// to wait for the next frame to start before it could write again.
+static uint8_t sbusframes[3][SBUS_FRAME_LEN];
+static atomic_t sbusready = ATOMIC_INIT(0); // Newest complete frame
+static int sbussending = 0; // Frame that may still be going out, calc thread only
 
-uint8_t localTXBuffer[SBUS_FRAME_LEN]; // Local Buffer
+static int SbusRx_Sync(const uint8_t *frame, uint32_t len);
 
 void sbus_Thread()
 {
@@ -58,69 +71,90 @@ void sbus_Thread()
             rt_sleep_ms(50);
             continue;
         }
-        rt_sleep_us((1.0/(float)trkset.SBUSRate()) * 1.0e6);
+
+        // Another serial mode has the port
+        if(trkset.serialMode() != TrackerSettings::SERMODE_SBUS) {
+            if(sbusopen) {
+                sbustimed = false;
+                sbusopen = false;
+                AuxSerial_Close();
+            }
+            rt_sleep_ms(50);
+            continue;
+        }
+
+        uint32_t period = 1000000 / trkset.SBUSRate();
 
         // Has the SBUS inverted status changed
-        if(sbusoutinv != !trkset.invertedSBUSOut() ||
-           sbusininv != !trkset.invertedSBUSIn()) {
+        if(sbusopen && (sbusoutinv != !trkset.invertedSBUSOut() ||
+                        sbusininv != !trkset.invertedSBUSIn())) {
+            // Close and re-open port with new settings, also stops timed output
+            sbustimed = false;
+            sbusopen = false;
+            AuxSerial_Close();
+        }
+
+        if(!sbusopen) {
             sbusininv = !trkset.invertedSBUSIn();
             sbusoutinv = !trkset.invertedSBUSOut();
-
-            // Close and re-open port with new settings
-            AuxSerial_Close();
             uint8_t inversion =0;
             if(sbusininv) inversion |= CONFINV_RX;
             if(sbusoutinv) inversion |= CONFINV_TX;
-            AuxSerial_Open(BAUD100000, CONF8E2, inversion);
+            // Fails until the last mode has closed the port
+            if(AuxSerial_Open(BAUD100000, CONF8E2, inversion, SBUS_FRAME_LEN, SbusRx_Sync) != SERIAL_OK) {
+                rt_sleep_ms(50);
+                continue;
+            }
+            sbusopen = true;
+        }
+
+        // Hardware timed, the thread only has to follow setting changes.
+        // Sent from here instead if there was no PPI channel for it
+        if(trkset.SBUSHWTimed()) {
+            if(!AuxSerial_TimedTXActive() &&
+               AuxSerial_TimedTXStart(sbusframes[atomic_get(&sbusready)], SBUS_FRAME_LEN, period) == SERIAL_OK)
+                sbustimed = true;
+            if(sbustimed) {
+                AuxSerial_TimedTXPeriod(period);
+                rt_sleep_ms(SBUS_TIMED_CHECK_PERIOD);
+                continue;
+            }
         }
+
+        if(AuxSerial_TimedTXActive()) {
+            sbustimed = false;
+            AuxSerial_TimedTXStop();
+        }
+
+        rt_sleep_us(period);
+
         // Send SBUS Data
         SBUS_TX_Start();
     }
 }
 
 uint8_t buf_[SBUS_FRAME_LEN];
-int bytesfilled=0;
-int8_t state_ = 0;
-uint8_t prev_byte_ = FOOTER_;
-uint8_t cur_byte_;
 
 #ifdef DEBUG
 uint64_t bytecount=0;
 #endif
-bool SbusRx_Parse() {
-  /* Parse messages */
-  while (AuxSerial_Read(&cur_byte_, 1)) {
-      /*TODO fixme serialWriteHex(&cur_byte_,1);
-      if ((cur_byte_ == HEADER_) && ((prev_byte_ == FOOTER_) ||
-         ((prev_byte_ & 0x0F) == FOOTER2_))) {
-        serialWriteln();
-         }*/
-#ifdef DEBUG
-      bytecount++;
-#endif
-     if (state_ == 0) {
-      if ((cur_byte_ == HEADER_) && ((prev_byte_ == FOOTER_) ||
-         ((prev_byte_ & 0x0F) == FOOTER2_))) {
-        buf_[state_++] = cur_byte_;
-      } else {
-        state_ = 0;
-      }
-    } else {
-      if (state_ < SBUS_FRAME_LEN) {
-        buf_[state_++] = cur_byte_;
-      } else {
-        state_ = 0;
-        if ((buf_[SBUS_FRAME_LEN - 1] == FOOTER_) ||
-           ((buf_[SBUS_FRAME_LEN - 1] & 0x0F) == FOOTER2_)) {
-          return true;
-        } else {
-          return false;
-        }
-      }
+
+static inline bool sbusFooter(uint8_t byte)
+{
+    return byte == FOOTER_ || (byte & 0x0F) == FOOTER2_;
+}
+
+// Runs in the receive ISR for every 25 bytes, finds where the frame starts
+// if the DMA buffers aren't lined up with the frames
+static int SbusRx_Sync(const uint8_t *frame, uint32_t len)
+{
+    if(frame[0] == HEADER_ && sbusFooter(frame[len - 1]))
+        return 0;
+    for(uint32_t i=1; i < len; i++) {
+        if(frame[i] == HEADER_ && sbusFooter(frame[i - 1]))
+            return i;
     }
-    prev_byte_ = cur_byte_;
-  }
-  return false;
+    return -1;
 }
 
 #ifdef DEBUG
@@ -145,28 +179,16 @@ bool SBUS_Read_Data(uint16_t ch_[16])
         toggle = !toggle;
 #endif
     bool newdata = false;
-    while(SbusRx_Parse()) { // Get most recent data if more than 1 packet came in
+    while(AuxSerial_ReadFrame(buf_)) { // Get most recent data if more than 1 packet came in
+#ifdef DEBUG
+        bytecount += SBUS_FRAME_LEN;
+#endif
         newdata = true;
     }
     if (newdata) {
-        ch_[0]  = static_cast<int16_t>(buf_[1]       | ((buf_[2]  << 8) & 0x07FF));
-        ch_[1]  = static_cast<int16_t>(buf_[2]  >> 3 | ((buf_[3]  << 5) & 0x07FF));
-        ch_[2]  = static_cast<int16_t>(buf_[3]  >> 6 | ((buf_[4]  << 2)  | ((buf_[5] << 10) & 0x07FF)));
-        ch_[3]  = static_cast<int16_t>(buf_[5]  >> 1 | ((buf_[6]  << 7) & 0x07FF));
-        ch_[4]  = static_cast<int16_t>(buf_[6]  >> 4 | ((buf_[7]  << 4) & 0x07FF));
-        ch_[5]  = static_cast<int16_t>(buf_[7]  >> 7 | ((buf_[8]  << 1)  | ((buf_[9] << 9) & 0x07FF)));
-        ch_[6]  = static_cast<int16_t>(buf_[9]  >> 2 | ((buf_[10] << 6) & 0x07FF));
-        ch_[7]  = static_cast<int16_t>(buf_[10] >> 5 | ((buf_[11] << 3) & 0x07FF));
-        ch_[8]  = static_cast<int16_t>(buf_[12]      | ((buf_[13] << 8) & 0x07FF));
-        ch_[9]  = static_cast<int16_t>(buf_[13] >> 3 | ((buf_[14] << 5) & 0x07FF));
-        ch_[10] = static_cast<int16_t>(buf_[14] >> 6 | ((buf_[15] << 2)  | ((buf_[16] << 10) & 0x07FF)));
-        ch_[11] = static_cast<int16_t>(buf_[16] >> 1 | ((buf_[17] << 7) & 0x07FF));
-        ch_[12] = static_cast<int16_t>(buf_[17] >> 4 | ((buf_[18] << 4) & 0x07FF));
-        ch_[13] = static_cast<int16_t>(buf_[18] >> 7 | ((buf_[19] << 1)  | ((buf_[20] << 9) & 0x07FF)));
-        ch_[14] = static_cast<int16_t>(buf_[20] >> 2 | ((buf_[21] << 6) & 0x07FF));
-        ch_[15] = static_cast<int16_t>(buf_[21] >> 5 | ((buf_[22] << 3) & 0x07FF));
+        chanpack::unpack<16, 11>(buf_ + 1, ch_);
         for(int i=0; i < 16; i++) { // Shift + Scale SBUS to PPM Range
-            ch_[i] = (((float)ch_[i] - TrackerSettings::SBUS_CENTER) / TrackerSettings::SBUS_SCALE) + TrackerSettings::PPM_CENTER;
+            ch_[i] = chanpack::toPPM(ch_[i]);
             if(ch_[i] > TrackerSettings::MAX_PWM) ch_[i] = TrackerSettings::MAX_PWM;
             if(ch_[i] < TrackerSettings::MIN_PWM) ch_[i] = TrackerSettings::MIN_PWM;
         }
@@ -197,9 +219,7 @@ bool SBUS_Read_Data(uint16_t ch_[16])
 
 void SBUS_TX_Start()
 {
-    if(sbusBuildingData)
-        return;
-    AuxSerial_Write(localTXBuffer,SBUS_FRAME_LEN);
+    AuxSerial_Write(sbusframes[atomic_get(&sbusready)],SBUS_FRAME_LEN);
 }
 
 void sbus_init()
@@ -209,7 +229,14 @@ void sbus_init()
     uint8_t inversion =0;
     if(sbusininv) inversion |= CONFINV_RX;
     if(sbusoutinv) inversion |= CONFINV_TX;
-    AuxSerial_Open(BAUD100000, CONF8E2, inversion);
+    sbusopen = AuxSerial_Open(BAUD100000, CONF8E2, inversion, SBUS_FRAME_LEN, SbusRx_Sync) == SERIAL_OK;
+
+    // Centered channels until the first real frame is built
+    uint16_t center[16];
+    for(int i=0; i < 16; i++)
+        center[i] = TrackerSettings::SBUS_CENTER;
+    SBUS_TX_BuildData(center);
+
     sbusTreadRun = true;
 }
 
@@ -225,48 +252,31 @@ void sbus_init()
 
 void SBUS_TX_BuildData(uint16_t ch_[16])
 {
-    sbusBuildingData = true;
-    uint8_t *buf_ = localTXBuffer;
+    bool timed = sbustimed;
+    int ready = atomic_get(&sbusready);
+
+    // In timed mode a frame started since the last build means the ready one
+    // went out. Otherwise SBUS_TX_Start may still be copying the ready one.
+    if(!timed || AuxSerial_TimedTXStarted())
+        sbussending = ready;
+
+    int fill = (ready + 1) % 3;
+    if(fill == sbussending)
+        fill = (fill + 1) % 3;
+
+    uint8_t *buf_ = sbusframes[fill];
     buf_[0] = HEADER_;
-    buf_[1] =  static_cast<uint8_t>((ch_[0]  & 0x07FF));
-    buf_[2] =  static_cast<uint8_t>((ch_[0]  & 0x07FF) >> 8  |
-                (ch_[1]  & 0x07FF) << 3);
-    buf_[3] =  static_cast<uint8_t>((ch_[1]  & 0x07FF) >> 5  |
-                (ch_[2]  & 0x07FF) << 6);
-    buf_[4] =  static_cast<uint8_t>((ch_[2]  & 0x07FF) >> 2);
-    buf_[5] =  static_cast<uint8_t>((ch_[2]  & 0x07FF) >> 10 |
-                (ch_[3]  & 0x07FF) << 1);
-    buf_[6] =  static_cast<uint8_t>((ch_[3]  & 0x07FF) >> 7  |
-                (ch_[4]  & 0x07FF) << 4);
-    buf_[7] =  static_cast<uint8_t>((ch_[4]  & 0x07FF) >> 4  |
-                (ch_[5]  & 0x07FF) << 7);
-    buf_[8] =  static_cast<uint8_t>((ch_[5]  & 0x07FF) >> 1);
-    buf_[9] =  static_cast<uint8_t>((ch_[5]  & 0x07FF) >> 9  |
-                (ch_[6]  & 0x07FF) << 2);
-    buf_[10] = static_cast<uint8_t>((ch_[6]  & 0x07FF) >> 6  |
-                (ch_[7]  & 0x07FF) << 5);
-    buf_[11] = static_cast<uint8_t>((ch_[7]  & 0x07FF) >> 3);
-    buf_[12] = static_cast<uint8_t>((ch_[8]  & 0x07FF));
-    buf_[13] = static_cast<uint8_t>((ch_[8]  & 0x07FF) >> 8  |
-                (ch_[9]  & 0x07FF) << 3);
-    buf_[14] = static_cast<uint8_t>((ch_[9]  & 0x07FF) >> 5  |
-                (ch_[10] & 0x07FF) << 6);
-    buf_[15] = static_cast<uint8_t>((ch_[10] & 0x07FF) >> 2);
-    buf_[16] = static_cast<uint8_t>((ch_[10] & 0x07FF) >> 10 |
-                (ch_[11] & 0x07FF) << 1);
-    buf_[17] = static_cast<uint8_t>((ch_[11] & 0x07FF) >> 7  |
-                (ch_[12] & 0x07FF) << 4);
-    buf_[18] = static_cast<uint8_t>((ch_[12] & 0x07FF) >> 4  |
-                (ch_[13] & 0x07FF) << 7);
-    buf_[19] = static_cast<uint8_t>((ch_[13] & 0x07FF) >> 1);
-    buf_[20] = static_cast<uint8_t>((ch_[13] & 0x07FF) >> 9  |
-                (ch_[14] & 0x07FF) << 2);
-    buf_[21] = static_cast<uint8_t>((ch_[14] & 0x07FF) >> 6  |
-                (ch_[15] & 0x07FF) << 5);
-    buf_[22] = static_cast<uint8_t>((ch_[15] & 0x07FF) >> 3);
+    chanpack::pack<16, 11>(buf_ + 1, ch_);
     buf_[23] = 0x00 | (ch17_ * CH17_) | (ch18_ * CH18_) |
                 (failsafe_ * FAILSAFE_) | (lost_frame_ * LOST_FRAME_);
     buf_[24] = FOOTER_;
-    sbusBuildingData = false;
+
+    if(timed) {
+        AuxSerial_TimedTXFrame(buf_);
+        // A frame started while switching over, it could have been either
+        if(AuxSerial_TimedTXStarted())
+            sbussending = ready;
+    }
+    atomic_set(&sbusready, fill);
 }
 
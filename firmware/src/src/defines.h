@@ -24,13 +24,41 @@
 // Thread Periods
 #define IO_PERIOD 25            // (ms) IO Period (button reading)
 #define BT_PERIOD 12500         // (us) Bluetooth update rate
-#define SERIAL_PERIOD 30        // (ms) Serial processing
-#define DATA_PERIOD 2           // Multiplier of Serial Period (Live Data Transmission Speed)
-#define SENSOR_PERIOD 16666     // (us) 60hz Read Sensors
-#define CALCULATE_PERIOD 6000   // (us) 166hz IMU calculations
+#define SERIAL_PERIOD 10        // (ms) Serial processing
+#define APDS_PERIOD 180         // (ms) Proximity sensor reads
+#define SBUS_TIMED_CHECK_PERIOD 50 // (ms) Settings check when SBUS out is hardware timed
+#define CRSF_PERIOD 10          // (ms) CRSF telemetry parsing
+#define CRSF_LINK_TIMEOUT 1000  // (ms) Link statistics older than this are dropped
+#define CRSF_RSSI_MIN 120.0f    // (-dBm) Aux function minimum
+#define CRSF_RSSI_MAX 50.0f     // (-dBm) Aux function maximum
+#define MAVLINK_PERIOD 50       // (ms) MAVLink port ownership and receive draining
+#define MAVLINK_HEARTBEAT_PERIOD 1000 // (ms)
+#define MAVLINK_BAUD BAUD115200
+#define MAVLINK_SYSID 255       // Ground station id, accepted by ArduPilot and PX4
+#define MAVLINK_COMPID 25       // MAV_COMP_ID_USER1
+#define MAVLINK_TARGET_SYSID 1  // Vehicle the gimbal is on
 #define PWM_FREQUENCY 50        // (ms) PWM Period
+#define JOYSTICK_DEADBAND 1     // Axis change before a new HID report is sent, 0 = any change
+#define JOYSTICK_BUSY_TIMEOUT 100 // (ms) Give up on a report the host never took
 #define UIRESPONSIVE_TIME 10000 // (ms) 10Seconds without an ack data will stop;
 
+// Live Data to the GUI
+#define DATA_BASE_PERIOD 90     // (ms) Period of a data item with an update divisor of 1
+#define DATA_MAX_RATE 100       // (hz) Fastest a data item can be requested, limited by SERIAL_PERIOD
+#define DATA_KEYFRAME_PERIOD 500 // (ms) Unchanged items are still resent in full this often
+#define DATA_FRAME_OVERHEAD 24  // (bytes) Command, CRC and framing added to each data frame
+#define DATA_LINK_RATE_DEF 6000 // (bytes/s) Starting guess of the USB throughput
+#define DATA_LINK_RATE_MIN 1000
+#define DATA_LINK_RATE_MAX 60000
+#define DATA_LINK_BUDGET 0.8    // Fraction of the measured throughput live data may use
+#define DATA_LINK_BURST 0.25    // (s) Most unused budget that can be saved up
+#define DATA_TX_RESERVE 200     // (bytes) TX space always left for responses + logging
+#define DATA_BLE_RATE 8000      // (bytes/s) Throughput used for live data when the GUI is on BLE
+
+// Analog Scan
+#define ANALOG_SAMPLE_RATE 256 // (hz) Scans per second, 32768 must divide by it evenly
+#define ANALOG_OVERSAMPLE 3    // 2^n samples averaged per channel in each scan
+
 // Analog Filters 1 Euro Filter
 #define AN_CH_CNT 4
 #define AN_FILT_FREQ 150
@@ -52,6 +80,23 @@
 #define BT_MAX_CONN_INTER_PERIF 10
 
 #define BT_CONN_LOST_TIME 100 // 100 * 10ms = 1seconds
+#define BT_MAX_PEERS 3 // Centrals the head sends channels to at once
+#define BT_PEER_INTERVAL_STEP 1 // (1.25ms) Each peer's interval is this much longer than the last
+#define BT_JSON_NOTIFY_MAX 2 // Config notifies given to the stack at once, leaves room for trainer data
+#define BT_JSON_CHUNK 244 // (bytes) Largest config notify, MTU 247 less the ATT header
+#define BT_NOTIFY_KEEPALIVE 200 // (ms) Unchanged trainer data is still sent this often
+#define BT_RECONNECT_TIMEOUT 3000 // (ms) Trying the cached head before scanning
+#define BT_CACHE_DATA_TIMEOUT 1000 // (ms) No channel data with the cached handles, rediscover
+
+// Bluetooth PHY policy, 2M unless the link is poor then Coded S8
+#define BT_PHY_PERIOD 500       // (ms) RSSI read and PHY decision period
+#define BT_PHY_RSSI_LP 0.3      // Low pass on the RSSI each period
+#define BT_PHY_RSSI_CODED -82   // (dBm) Below this go to coded
+#define BT_PHY_RSSI_2M -70      // (dBm) Above this can go back to 2M
+#define BT_PHY_LATE_CODED 0.2   // Fraction of late packets to go to coded
+#define BT_PHY_LATE_2M 0.05     // Fraction of late packets to go back to 2M
+#define BT_PHY_BAD_PERIODS 2    // Bad periods in a row before going to coded
+#define BT_PHY_GOOD_PERIODS 10  // Good periods in a row before going back to 2M
 
 // Thread Priority Definitions
 #define PRIORITY_LOW 12
@@ -67,6 +112,8 @@
 #define SENSOR_THREAD_PRIO PRIORITY_MED
 #define CALCULATE_THREAD_PRIO PRIORITY_HIGH
 #define SBUS_THREAD_PRIO PRIORITY_MED + 1
+#define CRSF_THREAD_PRIO PRIORITY_MED + 1
+#define MAVLINK_THREAD_PRIO PRIORITY_MED + 1
 
 // Threads initialized flags
 extern volatile bool ioThreadRun;
@@ -82,12 +129,17 @@ extern volatile bool gyro_calibrated;
 
 // Known good 16,17,18,19
 // 14/15 used for BT LNA
+// Anything else takes a channel from nrfx_ppi_channel_alloc() instead, it
+// knows which ones the BT controller has reserved. The fixed ones are taken
+// out of the allocator at boot so it never hands them out
 #define SERIALIN1_PPICH 16
 #define SERIALIN2_PPICH 15
 #define SERIALOUT_PPICH 1
 #define PPMIN_PPICH1 17
 #define PPMIN_PPICH2 18
 #define PPMOUT_PPICH 19
+#define PPI_FIXED_CHANNELS (BIT(SERIALIN1_PPICH) | BIT(SERIALIN2_PPICH) | BIT(SERIALOUT_PPICH) | \
+                            BIT(PPMIN_PPICH1) | BIT(PPMIN_PPICH2) | BIT(PPMOUT_PPICH))
 
 #define SERIAL_UARTE_CH 1
 
@@ -101,12 +153,15 @@ extern volatile bool gyro_calibrated;
 #define PPMIN_GPIOTE 6
 #define PPMOUT_GPIOTE 7
 
-#define SBUSIN_TIMER_CH 2
+#define SBUSOUT_TIMER_CH 2 // Hardware timed SBUS output
 #define PPMOUT_TIMER_CH 3
 #define PPMIN_TIMER_CH 4
 
 #define PPMIN_TMRCOMP_CH 0
 #define PPMOUT_TMRCOMP_CH 0
+#define SBUSOUT_TMRCOMP_CH 0
+
+#define ANALOG_RTC_CH 2 // RTC0 used by BT, RTC1 by Zephyr
 
 // Buffer Sizes for Serial/JSON
 #define JSON_BUF_SIZE 3000
@@ -118,13 +173,42 @@ extern volatile bool gyro_calibrated;
 #define RAD_TO_DEG 57.29577951308
 
 // Gyro Calibration Defines
-#define GYRO_STABLE_SAMPLES 50 // samples to average of not moving for a success gyro cal
+// Set in time, converted to samples at the IMU rate
+#define GYRO_STABLE_TIME 0.42 // (s) Time not moving for a success gyro cal
 #define GYRO_PASS_DIFF 5.0 // Differential less than this deg/sec^2 considered stable
-#define GYRO_LP_BETA 0.9 // Gyro Sample Moving Average Beta (0.0-1
+#define GYRO_LP_TAU 0.08 // (s) Gyro Sample Moving Average time constant
+
+// Output Prediction
+#define PREDICT_DEADZONE 3.0   // (deg/s) Gyro rates below this aren't predicted on
+#define PREDICT_MAX_ANGLE 15.0 // (deg) Most the prediction can move the orientation
 
 // Magnetometer, Initial Orientation, Samples to average
 #define MADGSTART_SAMPLES 15
 
+// Magnetometer disturbance, compared to the field at the initial orientation
+#define MAG_FIELD_TOL 0.15  // Fraction the field strength can change
+#define MAG_DIP_TOL 10.0    // (deg) Change in dip angle allowed
+#define MAG_GOOD_SAMPLES 8  // Good samples in a row before the mag is used again
+#define MAG_ACCEL_TOL 0.05  // Fraction the accel strength can differ from gravity for the dip check
+#define MAG_REF_TIME 60     // (s) Undisturbed this long, the average becomes the new reference
+
+// Fusion startup, gain starts high then falls to normal for fast settling
+#define MADG_BETA_START 2.0        // Madgwick gain right after the initial orientation
+#define MADG_BETA_DECAY 2.0        // (s) Time to fall to the normal gain, all engines
+#define MADG_ERROR_LP 0.05         // Low pass on the error used to detect settling
+#define MADG_CONVERGED_ERR 0.05    // Settled when the filtered error is under this
+#define MADG_CONVERGE_TIMEOUT 6.0  // (s) Latch the pan offset anyway after this
+#define MAHONY_KP_START 20.0       // Mahony proportional gain right after the initial orientation
+#define ESKF_ATT_START 1.0         // (rad) Kalman attitude uncertainty right after the initial orientation
+
+// Error state Kalman filter noise
+#define ESKF_GYRO_NOISE 0.005      // (rad/s) Gyro white noise
+#define ESKF_BIAS_NOISE 0.0002     // (rad/s^2) Gyro bias random walk
+#define ESKF_ACCEL_NOISE 0.05      // (g) Accel noise when only gravity is measured
+#define ESKF_ACCEL_DYN 1.0         // Accel noise added per g of extra acceleration
+#define ESKF_HEADING_NOISE 0.1     // (rad) Magnetometer heading noise
+#define ESKF_BIAS_START 0.02       // (rad/s) Gyro bias uncertainty at start
+
 // RTOS Specifics
 #if defined(RTOS_ZEPHYR)
 #define micros() k_cyc_to_us_floor32(k_cycle_get_32())
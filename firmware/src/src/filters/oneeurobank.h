@@ -0,0 +1,146 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+/* N channel One Euro Filter, same maths as SF1eFilter
+ *
+ *  State is kept as arrays, one entry per channel, in the object itself so it
+ *  can be static. All channels share one configuration and are run in a
+ *  single pass.
+ *
+ *  The low pass alpha for cutoff c at sample period te is
+ *      1 / (1 + tau / te), tau = 1 / (2 pi c)
+ *  which is rewritten as w*c / (1 + w*c) with w = 2 pi te. w and the
+ *  derivative alpha only change with the sample rate so they are computed
+ *  once, leaving one divide per channel per update instead of five.
+ */
+
+template<int N> class OneEuroBank {
+    static_assert(N > 0 && N <= 32, "OneEuroBank supports 1-32 channels");
+
+public:
+    OneEuroBank() {init(100, 1, 0, 1);}
+
+    void init(float frequency, float mincutoff, float slope, float dcutoff)
+    {
+        mincut = mincutoff;
+        cutslope = slope;
+        dcut = dcutoff;
+        setFrequency(frequency);
+        reset();
+    }
+
+    // Change the tuning, keeps the filter state
+    void setCutoff(float mincutoff, float slope)
+    {
+        mincut = mincutoff;
+        cutslope = slope;
+    }
+
+    void setFrequency(float frequency)
+    {
+        if(frequency <= 0)
+            return;
+        freq = frequency;
+        w = 2.0f * (float)M_PI / frequency;
+        dalpha = alpha(dcut);
+    }
+
+    void reset() {primed = 0;}
+    void reset(int ch) {primed &= ~(1ul << ch);}
+
+    // Filters all channels, in and out may be the same array
+    // dt (s), time since the last update. 0 uses the configured frequency
+    void update(const float in[N], float out[N], float dt=0)
+    {
+        setPeriod(dt);
+        for(int i=0; i < N; i++) {
+            if(prime(i, in[i]))
+                dx[i] += dalpha * ((in[i] - xprev[i]) * freq - dx[i]);
+            out[i] = step(i, in[i], fabsf(dx[i]));
+        }
+    }
+
+    // As above but the cutoff follows a known speed (e.g. from a gyro, in
+    // input units/s) in place of the filtered derivative of the input
+    void update(const float in[N], const float speed[N], float out[N], float dt=0)
+    {
+        setPeriod(dt);
+        for(int i=0; i < N; i++) {
+            prime(i, in[i]);
+            out[i] = step(i, in[i], fabsf(speed[i]));
+        }
+    }
+
+    // Filters one channel
+    float update(int ch, float xi)
+    {
+        if(prime(ch, xi))
+            dx[ch] += dalpha * ((xi - xprev[ch]) * freq - dx[ch]);
+        return step(ch, xi, fabsf(dx[ch]));
+    }
+
+    float value(int ch) const {return x[ch];}
+    float derivative(int ch) const {return dx[ch];} // Filtered, units/s
+
+private:
+    void setPeriod(float dt)
+    {
+        if(dt > 0) {
+            float f = 1.0f / dt;
+            if(f != freq)
+                setFrequency(f);
+        }
+    }
+
+    // Starts a channel on it's first sample, false if it was just started
+    bool prime(int ch, float xi)
+    {
+        if(primed & (1ul << ch))
+            return true;
+        x[ch] = xi;
+        xprev[ch] = xi;
+        dx[ch] = 0;
+        primed |= 1ul << ch;
+        return false;
+    }
+
+    float step(int ch, float xi, float speed)
+    {
+        x[ch] += alpha(mincut + cutslope * speed) * (xi - x[ch]);
+        xprev[ch] = xi;
+        return x[ch];
+    }
+
+    float alpha(float cutoff) const
+    {
+        float wc = w * cutoff;
+        return wc / (1.0f + wc);
+    }
+
+    float x[N];     // Filtered output
+    float xprev[N]; // Last raw input
+    float dx[N];    // Filtered derivative
+    uint32_t primed; // Bit per channel, has had a first sample
+
+    float freq, w, dalpha;
+    float mincut, cutslope, dcut;
+};
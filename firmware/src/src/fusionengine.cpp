@@ -0,0 +1,88 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <zephyr.h>
+#include "fusionengine.h"
+#include "defines.h"
+
+float FusionEngine::deltatUpdate()
+{
+    int64_t now = micros64();
+    float deltat = (float)(now - lastupdate) / 1000000.0f;
+    lastupdate = now;
+    return deltat;
+}
+
+/* Builds the sensor to earth rotation from the sensor axes expressed in
+ * the earth frame. Up is the accel, east is up x mag, north is east x up.
+ * These are the rows of the rotation matrix, converted to a quaternion.
+ */
+
+void FusionEngine::initialQuat(float ax, float ay, float az, float mx, float my, float mz, float q[4])
+{
+    q[0] = 1; q[1] = 0; q[2] = 0; q[3] = 0;
+
+    float an = sqrtf(ax*ax + ay*ay + az*az);
+    if(an == 0)
+        return;
+    ax /= an; ay /= an; az /= an;
+
+    // West = Up x Mag (y axis)
+    float wx = ay*mz - az*my;
+    float wy = az*mx - ax*mz;
+    float wz = ax*my - ay*mx;
+    float wn = sqrtf(wx*wx + wy*wy + wz*wz);
+    if(wn == 0)
+        return;
+    wx /= wn; wy /= wn; wz /= wn;
+
+    // North = West x Up (x axis)
+    float nx = wy*az - wz*ay;
+    float ny = wz*ax - wx*az;
+    float nz = wx*ay - wy*ax;
+
+    // Rotation matrix rows N, W, U to a quaternion
+    float m00 = nx, m01 = ny, m02 = nz;
+    float m10 = wx, m11 = wy, m12 = wz;
+    float m20 = ax, m21 = ay, m22 = az;
+    float tr = m00 + m11 + m22;
+    if(tr > 0) {
+        float s = sqrtf(tr + 1.0f) * 2.0f;
+        q[0] = 0.25f * s;
+        q[1] = (m21 - m12) / s;
+        q[2] = (m02 - m20) / s;
+        q[3] = (m10 - m01) / s;
+    } else if(m00 > m11 && m00 > m22) {
+        float s = sqrtf(1.0f + m00 - m11 - m22) * 2.0f;
+        q[0] = (m21 - m12) / s;
+        q[1] = 0.25f * s;
+        q[2] = (m01 + m10) / s;
+        q[3] = (m02 + m20) / s;
+    } else if(m11 > m22) {
+        float s = sqrtf(1.0f + m11 - m00 - m22) * 2.0f;
+        q[0] = (m02 - m20) / s;
+        q[1] = (m01 + m10) / s;
+        q[2] = 0.25f * s;
+        q[3] = (m12 + m21) / s;
+    } else {
+        float s = sqrtf(1.0f + m22 - m00 - m11) * 2.0f;
+        q[0] = (m10 - m01) / s;
+        q[1] = (m02 + m20) / s;
+        q[2] = (m12 + m21) / s;
+        q[3] = 0.25f * s;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+/* Common interface of the orientation fusion algorithms
+ *
+ *  Gyro rates are in rad/s, accel and mag in any units (only the direction is
+ *  used). The quaternion (w,x,y,z) rotates the sensor frame into the earth
+ *  frame, x = magnetic north, z = up. Angles are in degrees.
+ */
+
+class FusionEngine {
+public:
+    virtual ~FusionEngine() {}
+
+    virtual const char *name() = 0;
+
+    // Sets the orientation straight from averaged accel + mag readings
+    virtual void begin(float ax, float ay, float az, float mx, float my, float mz) = 0;
+    virtual void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float deltat) = 0;
+    virtual void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float deltat) = 0;
+
+    virtual float *getQuat() = 0;
+
+    virtual float getRoll() {
+        float *q = getQuat();
+        return atan2f(q[0]*q[1] + q[2]*q[3], 0.5f - q[1]*q[1] - q[2]*q[2]) * 57.29578f;
+    }
+    virtual float getPitch() {
+        float *q = getQuat();
+        float s = -2.0f * (q[1]*q[3] - q[0]*q[2]);
+        return asinf(s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s)) * 57.29578f;
+    }
+    virtual float getYaw() {
+        float *q = getQuat();
+        return atan2f(q[1]*q[2] + q[0]*q[3], 0.5f - q[2]*q[2] - q[3]*q[3]) * 57.29578f;
+    }
+
+    // Optional startup help, gain starts at startgain and falls to normal over time (s)
+    virtual void startConvergence(float /*startgain*/, float /*time*/) {}
+    virtual bool converging() {return false;}
+
+    // How much the sensors disagree with the orientation, 0 = fully agree
+    virtual float getError() {return 0;}
+
+    // Seconds since the last call
+    float deltatUpdate();
+
+protected:
+    // Orientation from gravity and the magnetic field
+    static void initialQuat(float ax, float ay, float az, float mx, float my, float mz, float q[4]);
+
+private:
+    int64_t lastupdate = 0;
+};
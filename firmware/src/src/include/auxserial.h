@@ -21,6 +21,7 @@
 
 #define SERIAL_TX_SIZE 512
 #define SERIAL_RX_SIZE 512
+#define SERIAL_RX_FRAME_MAX 64 // Longest fixed length receive frame
 
 #define BAUD1200 UART_BAUDRATE_BAUDRATE_Baud1200
 #define BAUD2400 UART_BAUDRATE_BAUDRATE_Baud2400
@@ -38,10 +39,12 @@
 #define BAUD115200 UART_BAUDRATE_BAUDRATE_Baud115200
 #define BAUD230400 UART_BAUDRATE_BAUDRATE_Baud230400
 #define BAUD250000 UART_BAUDRATE_BAUDRATE_Baud250000
+#define BAUD420000 0x06B85000
 #define BAUD460800 UART_BAUDRATE_BAUDRATE_Baud460800
 #define BAUD921600 UART_BAUDRATE_BAUDRATE_Baud921600
 #define BAUD1000000 UART_BAUDRATE_BAUDRATE_Baud1M
 
+#define CONF8N1         0x00000000
 #define CONF8E2         0x0000001E
 #define CONFINV_TX      (1<<0)
 #define CONFINV_RX      (1<<1)
@@ -53,8 +56,25 @@ enum SerialStatus{
     SERIAL_BUFFER_FULL=-3,
 };
 
-int AuxSerial_Open(uint32_t baudrate, uint16_t settings, uint8_t inversions=0);
+/* Fixed length frame receive
+ *   Given a complete frame, returns 0 if it's aligned, how many bytes in the
+ * next frame starts if it isn't or -1 if that can't be told.
+ */
+typedef int (*AuxFrameSync)(const uint8_t *frame, uint32_t len);
+
+int AuxSerial_Open(uint32_t baudrate, uint16_t settings, uint8_t inversions=0,
+                   uint32_t framelen=0, AuxFrameSync sync=nullptr);
 bool AuxSerial_Available();
 void AuxSerial_Close();
 uint32_t AuxSerial_Write(uint8_t *buffer, uint32_t len);
-uint32_t AuxSerial_Read(uint8_t *buffer, uint32_t bufsize);
\ No newline at end of file
+uint32_t AuxSerial_Read(uint8_t *buffer, uint32_t bufsize);
+uint32_t AuxSerial_ReadFrame(uint8_t *frame); // One whole frame if opened with a framelen
+uint32_t AuxSerial_TXPending(); // Bytes queued behind the transfer in progress
+
+// Hardware timed output, sends one frame every period with no CPU load
+int AuxSerial_TimedTXStart(const uint8_t *frame, uint32_t len, uint32_t periodus);
+void AuxSerial_TimedTXStop();
+void AuxSerial_TimedTXPeriod(uint32_t periodus);
+void AuxSerial_TimedTXFrame(const uint8_t *frame); // Frame sent from the next period on
+bool AuxSerial_TimedTXStarted(); // A frame started since the last call
+bool AuxSerial_TimedTXActive();
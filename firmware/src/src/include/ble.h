@@ -18,6 +18,7 @@ extern struct bt_uuid_16 frskychar;
 extern struct bt_uuid_16 htoverridech;
 extern struct bt_uuid_16 btbutton;
 extern struct bt_uuid_16 jsonuuid;
+extern struct k_sem btchansem;
 
 typedef enum {
     BTDISABLE=0,
@@ -35,6 +36,41 @@ void BTSetChannel(int channel, const uint16_t value);
 bool BTGetConnected();
 const char *BTGetAddress();
 int8_t BTGetRSSI();
+void BTChannelsUpdated();
+uint16_t BTGetNotifyLatency();
+uint8_t BTGetNotifyQueue();
+uint16_t BTGetReconnectTime();
+int BTJSONWrite(const char *data, int len);
+int BTJSONRead(char *data, int len);
+int BTJSONSpace();
+uint8_t BTGetPeerStats(uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS]);
+
+// PHY policy, starts on 2M and drops to Coded S8 when the link is poor
+enum {BT_PHY_STAT_1M, BT_PHY_STAT_2M, BT_PHY_STAT_CODED, BT_PHY_STAT_CNT};
+
+// Policy state of one connection, kept by whoever owns the connection
+struct btphy {
+  struct bt_conn *conn;
+  volatile uint8_t curphy;
+  uint8_t wantphy;
+  float rssi;          // (dBm) filtered
+  bool rssivalid;
+  uint32_t interval;   // (us) connection interval
+  int64_t next;        // (ms) Next policy run
+  int bad, good;       // Periods in a row
+  volatile uint16_t packets[BT_PHY_STAT_CNT];
+  volatile uint16_t late[BT_PHY_STAT_CNT];
+  volatile uint16_t winpackets, winlate;
+};
+
+void BTPhyConnected(btphy &phy, struct bt_conn *conn);
+void BTPhyDisconnected(btphy &phy);
+void BTPhyExecute();
+void BTPhyPacket(btphy &phy, bool late);
+uint32_t BTPhyInterval(const btphy &phy);
+int8_t BTPhyRSSI();
+uint8_t BTGetPhy();
+void BTGetPhyStats(uint16_t packets[BT_PHY_STAT_CNT], uint16_t late[BT_PHY_STAT_CNT]);
 
 bool leparamrequested(struct bt_conn *conn, struct bt_le_conn_param *param);
 void leparamupdated(struct bt_conn *conn,
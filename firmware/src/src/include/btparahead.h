@@ -8,3 +8,9 @@ void BTHeadSetChannel(int channel, const uint16_t value);
 uint16_t BTHeadGetChannel(int channel);
 const char * BTHeadGetAddress();
 int8_t BTHeadGetRSSI();
+uint16_t BTHeadGetNotifyLatency();
+uint8_t BTHeadGetNotifyQueue();
+int BTHeadJSONWrite(const char *data, int len);
+int BTHeadJSONRead(char *data, int len);
+int BTHeadJSONSpace();
+uint8_t BTHeadGetPeerStats(uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS]);
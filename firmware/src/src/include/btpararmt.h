@@ -12,3 +12,4 @@ uint16_t BTRmtGetChannel(int channel);
 const char * BTRmtGetAddress();
 void BTRmtSendButtonPress(bool longpress=false);
 int8_t BTRmtGetRSSI();
+uint16_t BTRmtGetReconnectTime();
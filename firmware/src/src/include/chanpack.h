@@ -0,0 +1,123 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Channel packing shared by the serial receiver protocols
+ *
+ *  SBUS, CRSF and FPort all send 16 channels of 11 bits as one little endian
+ *  bit stream, channel 0 in the lowest bits of the first byte. The channel
+ *  count and width are template constants so this compiles down to the same
+ *  fixed shifts that used to be written out by hand.
+ *
+ *  Channel values use the SBUS/CRSF scale, 992 is center and there are 1.6
+ *  counts per microsecond of PPM. The conversions are done in integers and
+ *  give the same results the float math did.
+ *
+ *  Nothing here depends on Zephyr so it can be built on a host.
+ */
+
+namespace chanpack {
+
+constexpr int CH_CENTER = 992;
+constexpr int PPM_CENTER = 1500;
+constexpr int CH_MAX = 2047;
+constexpr int PPM_AT_ZERO = PPM_CENTER - (CH_CENTER * 5) / 8; // 880us
+
+// Bytes needed for NCh channels of Bits each
+template<int NCh, int Bits>
+constexpr size_t packedSize() { return (NCh * Bits + 7) / 8; }
+
+namespace detail {
+
+// One channel per level so the whole frame is unrolled even with -Os. Where
+// each channel sits is known at compile time, all the ifs go away.
+template<int I, int NCh, int Bits>
+struct Channel {
+    static constexpr int byte = I * Bits / 8;
+    static constexpr int shift = I * Bits % 8;
+    static constexpr uint32_t mask = (1UL << Bits) - 1;
+
+    static inline void pack(uint8_t *out, const uint16_t *ch)
+    {
+        uint32_t v = ch[I] & mask;
+        // Channels are written in order, so only the first byte can already
+        // hold bits of the channel before
+        if(shift == 0)
+            out[byte] = v;
+        else
+            out[byte] |= v << shift;
+        if(shift + Bits > 8)
+            out[byte + 1] = v >> (8 - shift);
+        if(shift + Bits > 16)
+            out[byte + 2] = v >> (16 - shift);
+        Channel<I + 1, NCh, Bits>::pack(out, ch);
+    }
+
+    static inline void unpack(const uint8_t *in, uint16_t *ch)
+    {
+        uint32_t v = in[byte];
+        if(shift + Bits > 8)
+            v |= (uint32_t)in[byte + 1] << 8;
+        if(shift + Bits > 16)
+            v |= (uint32_t)in[byte + 2] << 16;
+        ch[I] = (v >> shift) & mask;
+        Channel<I + 1, NCh, Bits>::unpack(in, ch);
+    }
+};
+
+template<int NCh, int Bits>
+struct Channel<NCh, NCh, Bits> {
+    static inline void pack(uint8_t *, const uint16_t *) {}
+    static inline void unpack(const uint8_t *, uint16_t *) {}
+};
+
+}
+
+// Writes packedSize<NCh, Bits>() bytes, unused bits in the last one are zero
+template<int NCh, int Bits>
+inline void pack(uint8_t *out, const uint16_t ch[NCh])
+{
+    static_assert(Bits > 0 && Bits <= 16, "Channels must fit a uint16_t");
+    detail::Channel<0, NCh, Bits>::pack(out, ch);
+}
+
+template<int NCh, int Bits>
+inline void unpack(const uint8_t *in, uint16_t ch[NCh])
+{
+    static_assert(Bits > 0 && Bits <= 16, "Channels must fit a uint16_t");
+    detail::Channel<0, NCh, Bits>::unpack(in, ch);
+}
+
+// Channel value to PPM microseconds, us = (v - 992) * 5/8 + 1500
+constexpr uint16_t toPPM(uint16_t v)
+{
+    return (((int32_t)v - CH_CENTER) * 5 + PPM_CENTER * 8) >> 3;
+}
+
+// PPM microseconds to channel value, v = (us - 1500) * 8/5 + 992
+constexpr uint16_t fromPPM(uint16_t us)
+{
+    return us <= PPM_AT_ZERO ? 0 :
+           (((int32_t)us - PPM_CENTER) * 8 + CH_CENTER * 5) / 5 > CH_MAX ? CH_MAX :
+           (((int32_t)us - PPM_CENTER) * 8 + CH_CENTER * 5) / 5;
+}
+
+}
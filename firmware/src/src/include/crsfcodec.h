@@ -0,0 +1,167 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chanpack.h"
+
+/* Crossfire (CRSF) serial frames, as used by TBS Crossfire and ExpressLRS
+ *
+ *  [address] [length] [type] [payload] [crc]
+ *
+ *  Length counts the type, payload and crc bytes. The crc is CRC8 with the
+ *  DVB-S2 polynomial 0xD5 over the type and payload.
+ *
+ *  Nothing here depends on Zephyr so it can be built on a host.
+ */
+
+constexpr uint8_t CRSF_ADDR_FC = 0xC8;     // Flight controller, also the sync byte
+constexpr uint8_t CRSF_ADDR_RADIO = 0xEA;  // Handset
+constexpr uint8_t CRSF_ADDR_MODULE = 0xEE; // Transmitter module
+
+constexpr uint8_t CRSF_FRAMETYPE_LINK_STATISTICS = 0x14;
+constexpr uint8_t CRSF_FRAMETYPE_RC_CHANNELS_PACKED = 0x16;
+
+constexpr int CRSF_CHANNELS = 16;
+constexpr int CRSF_MAX_FRAME = 64; // Address and length, plus up to 62
+constexpr int CRSF_MAX_LENGTH = CRSF_MAX_FRAME - 2;
+constexpr int CRSF_RC_PAYLOAD = chanpack::packedSize<CRSF_CHANNELS, 11>(); // 22
+constexpr int CRSF_RC_FRAME = CRSF_RC_PAYLOAD + 4; // 26
+constexpr int CRSF_LINK_STATS_PAYLOAD = 10;
+
+// CRC8 of every byte value, polynomial 0xD5
+static const uint8_t CRSF_CRC8_TABLE[256] = {
+    0x00, 0xD5, 0x7F, 0xAA, 0xFE, 0x2B, 0x81, 0x54, 0x29, 0xFC, 0x56, 0x83, 0xD7, 0x02, 0xA8, 0x7D,
+    0x52, 0x87, 0x2D, 0xF8, 0xAC, 0x79, 0xD3, 0x06, 0x7B, 0xAE, 0x04, 0xD1, 0x85, 0x50, 0xFA, 0x2F,
+    0xA4, 0x71, 0xDB, 0x0E, 0x5A, 0x8F, 0x25, 0xF0, 0x8D, 0x58, 0xF2, 0x27, 0x73, 0xA6, 0x0C, 0xD9,
+    0xF6, 0x23, 0x89, 0x5C, 0x08, 0xDD, 0x77, 0xA2, 0xDF, 0x0A, 0xA0, 0x75, 0x21, 0xF4, 0x5E, 0x8B,
+    0x9D, 0x48, 0xE2, 0x37, 0x63, 0xB6, 0x1C, 0xC9, 0xB4, 0x61, 0xCB, 0x1E, 0x4A, 0x9F, 0x35, 0xE0,
+    0xCF, 0x1A, 0xB0, 0x65, 0x31, 0xE4, 0x4E, 0x9B, 0xE6, 0x33, 0x99, 0x4C, 0x18, 0xCD, 0x67, 0xB2,
+    0x39, 0xEC, 0x46, 0x93, 0xC7, 0x12, 0xB8, 0x6D, 0x10, 0xC5, 0x6F, 0xBA, 0xEE, 0x3B, 0x91, 0x44,
+    0x6B, 0xBE, 0x14, 0xC1, 0x95, 0x40, 0xEA, 0x3F, 0x42, 0x97, 0x3D, 0xE8, 0xBC, 0x69, 0xC3, 0x16,
+    0xEF, 0x3A, 0x90, 0x45, 0x11, 0xC4, 0x6E, 0xBB, 0xC6, 0x13, 0xB9, 0x6C, 0x38, 0xED, 0x47, 0x92,
+    0xBD, 0x68, 0xC2, 0x17, 0x43, 0x96, 0x3C, 0xE9, 0x94, 0x41, 0xEB, 0x3E, 0x6A, 0xBF, 0x15, 0xC0,
+    0x4B, 0x9E, 0x34, 0xE1, 0xB5, 0x60, 0xCA, 0x1F, 0x62, 0xB7, 0x1D, 0xC8, 0x9C, 0x49, 0xE3, 0x36,
+    0x19, 0xCC, 0x66, 0xB3, 0xE7, 0x32, 0x98, 0x4D, 0x30, 0xE5, 0x4F, 0x9A, 0xCE, 0x1B, 0xB1, 0x64,
+    0x72, 0xA7, 0x0D, 0xD8, 0x8C, 0x59, 0xF3, 0x26, 0x5B, 0x8E, 0x24, 0xF1, 0xA5, 0x70, 0xDA, 0x0F,
+    0x20, 0xF5, 0x5F, 0x8A, 0xDE, 0x0B, 0xA1, 0x74, 0x09, 0xDC, 0x76, 0xA3, 0xF7, 0x22, 0x88, 0x5D,
+    0xD6, 0x03, 0xA9, 0x7C, 0x28, 0xFD, 0x57, 0x82, 0xFF, 0x2A, 0x80, 0x55, 0x01, 0xD4, 0x7E, 0xAB,
+    0x84, 0x51, 0xFB, 0x2E, 0x7A, 0xAF, 0x05, 0xD0, 0xAD, 0x78, 0xD2, 0x07, 0x53, 0x86, 0x2C, 0xF9
+};
+
+static inline uint8_t crsfCrc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for(size_t i=0; i < len; i++)
+        crc = CRSF_CRC8_TABLE[crc ^ data[i]];
+    return crc;
+}
+
+/* Builds an RC_CHANNELS_PACKED frame. Channels use the SBUS scale, 172 to
+ * 1811 with 992 at center. out must hold CRSF_RC_FRAME bytes.
+ *    Returns the length written
+ */
+
+static inline int crsfEncodeChannels(uint8_t *out, const uint16_t ch[CRSF_CHANNELS])
+{
+    out[0] = CRSF_ADDR_FC;
+    out[1] = CRSF_RC_PAYLOAD + 2;
+    out[2] = CRSF_FRAMETYPE_RC_CHANNELS_PACKED;
+    chanpack::pack<CRSF_CHANNELS, 11>(out + 3, ch);
+    out[CRSF_RC_FRAME - 1] = crsfCrc8(out + 2, CRSF_RC_PAYLOAD + 1);
+    return CRSF_RC_FRAME;
+}
+
+struct CrsfLinkStats {
+    uint8_t uplinkRssi1; // -dBm
+    uint8_t uplinkRssi2; // -dBm
+    uint8_t uplinkLq;    // %
+    int8_t uplinkSnr;    // dB
+    uint8_t antenna;
+    uint8_t rfMode;
+    uint8_t txPower;
+    uint8_t downlinkRssi; // -dBm
+    uint8_t downlinkLq;   // %
+    int8_t downlinkSnr;   // dB
+};
+
+static inline bool crsfParseLinkStats(const uint8_t *payload, int len, CrsfLinkStats &ls)
+{
+    if(len < CRSF_LINK_STATS_PAYLOAD)
+        return false;
+    ls.uplinkRssi1 = payload[0];
+    ls.uplinkRssi2 = payload[1];
+    ls.uplinkLq = payload[2];
+    ls.uplinkSnr = (int8_t)payload[3];
+    ls.antenna = payload[4];
+    ls.rfMode = payload[5];
+    ls.txPower = payload[6];
+    ls.downlinkRssi = payload[7];
+    ls.downlinkLq = payload[8];
+    ls.downlinkSnr = (int8_t)payload[9];
+    return true;
+}
+
+/* Finds frames in received bytes
+ *
+ *  Give it bytes as they arrive. A frame only starts on one of the known
+ *  addresses, anything with a bad length or crc is dropped and the search
+ *  starts again from the next byte.
+ */
+
+class CrsfDecoder {
+public:
+    // Returns the frame type once a frame with a good crc is complete, 0 otherwise
+    uint8_t feed(uint8_t byte)
+    {
+        if(index == 0) {
+            if(byte == CRSF_ADDR_FC || byte == CRSF_ADDR_RADIO || byte == CRSF_ADDR_MODULE)
+                frame[index++] = byte;
+            return 0;
+        }
+
+        if(index == 1) {
+            if(byte < 2 || byte > CRSF_MAX_LENGTH) {
+                index = 0;
+                return feed(byte);
+            }
+            frame[index++] = byte;
+            return 0;
+        }
+
+        frame[index++] = byte;
+        if(index < frame[1] + 2)
+            return 0;
+
+        index = 0;
+        if(crsfCrc8(frame + 2, frame[1] - 1) != byte)
+            return 0;
+        return frame[2];
+    }
+
+    // Valid after feed returns a type, until the next byte is fed
+    const uint8_t *payload() const { return frame + 3; }
+    int payloadLength() const { return frame[1] - 2; }
+
+    void reset() { index = 0; }
+
+private:
+    uint8_t frame[CRSF_MAX_FRAME];
+    int index = 0;
+};
@@ -0,0 +1,185 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* MAVLink 2 frames, only the few messages the tracker sends
+ *
+ *  [0xFD] [len] [incompat] [compat] [seq] [sysid] [compid] [msgid x3]
+ *  [payload] [crc x2]
+ *
+ *  Payload fields go largest type first, in the order the message definition
+ *  lists them within each size, and trailing zero bytes are cut off. The crc
+ *  is X.25 over everything after the 0xFD, then the message's crc extra byte.
+ *
+ *  Frames are built in place in a buffer sized for the message, nothing is
+ *  allocated. Nothing here depends on Zephyr so it can be built on a host.
+ */
+
+constexpr uint8_t MAVLINK_STX = 0xFD;
+constexpr int MAVLINK_HEADER_LEN = 10;
+constexpr int MAVLINK_CHECKSUM_LEN = 2;
+
+constexpr int mavlinkFrameLen(int payload) { return MAVLINK_HEADER_LEN + payload + MAVLINK_CHECKSUM_LEN; }
+
+struct MavlinkMsg {
+    uint32_t id;
+    uint8_t length; // Payload length before zeros are cut off
+    uint8_t crcExtra;
+};
+
+constexpr MavlinkMsg MAVLINK_MSG_HEARTBEAT = {0, 9, 50};
+constexpr MavlinkMsg MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE = {282, 35, 123};
+constexpr MavlinkMsg MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE = {284, 32, 99};
+
+constexpr uint8_t MAV_TYPE_GCS = 6;
+constexpr uint8_t MAV_AUTOPILOT_INVALID = 8;
+constexpr uint8_t MAV_STATE_ACTIVE = 4;
+constexpr uint8_t MAV_COMP_ID_AUTOPILOT1 = 1;
+constexpr uint8_t MAV_COMP_ID_GIMBAL = 154;
+
+// Same bits in the manager's uint32_t and the device's uint16_t flags
+constexpr uint32_t GIMBAL_FLAGS_ROLL_LOCK = 4;  // Roll relative to the horizon
+constexpr uint32_t GIMBAL_FLAGS_PITCH_LOCK = 8; // Pitch relative to the horizon
+constexpr uint32_t GIMBAL_FLAGS_YAW_LOCK = 16;  // Yaw relative to north, else the vehicle
+
+static inline uint16_t mavlinkCrcAccumulate(uint8_t byte, uint16_t crc)
+{
+    uint8_t tmp = byte ^ (uint8_t)crc;
+    tmp ^= tmp << 4;
+    return (crc >> 8) ^ ((uint16_t)tmp << 8) ^ ((uint16_t)tmp << 3) ^ (tmp >> 4);
+}
+
+static inline uint16_t mavlinkCrc(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF)
+{
+    for(size_t i=0; i < len; i++)
+        crc = mavlinkCrcAccumulate(data[i], crc);
+    return crc;
+}
+
+/* Writes one frame into a caller's buffer of mavlinkFrameLen(msg.length)
+ *
+ *  Add the payload fields in wire order then call finish(). Everything is
+ *  written little endian a byte at a time, so it doesn't matter what the
+ *  buffer's alignment or the host's byte order is.
+ */
+
+class MavlinkBuilder {
+public:
+    explicit MavlinkBuilder(uint8_t *frame) : buf(frame), pos(frame + MAVLINK_HEADER_LEN) {}
+
+    MavlinkBuilder &u8(uint8_t v) { *pos++ = v; return *this; }
+    MavlinkBuilder &u16(uint16_t v) { u8(v); return u8(v >> 8); }
+    MavlinkBuilder &u32(uint32_t v) { u16(v); return u16(v >> 16); }
+    MavlinkBuilder &f32(float v)
+    {
+        uint32_t u;
+        memcpy(&u, &v, sizeof(u));
+        return u32(u);
+    }
+
+    // Fills in the header and crc, returns the frame length
+    int finish(const MavlinkMsg &msg, uint8_t seq, uint8_t sysid, uint8_t compid)
+    {
+        // Cut trailing zeros, one payload byte always stays
+        int len = pos - (buf + MAVLINK_HEADER_LEN);
+        while(len > 1 && buf[MAVLINK_HEADER_LEN + len - 1] == 0)
+            len--;
+
+        buf[0] = MAVLINK_STX;
+        buf[1] = len;
+        buf[2] = 0; // No incompatible flags, frames aren't signed
+        buf[3] = 0;
+        buf[4] = seq;
+        buf[5] = sysid;
+        buf[6] = compid;
+        buf[7] = msg.id;
+        buf[8] = msg.id >> 8;
+        buf[9] = msg.id >> 16;
+
+        uint16_t crc = mavlinkCrc(buf + 1, MAVLINK_HEADER_LEN - 1 + len);
+        crc = mavlinkCrcAccumulate(msg.crcExtra, crc);
+        buf[MAVLINK_HEADER_LEN + len] = crc;
+        buf[MAVLINK_HEADER_LEN + len + 1] = crc >> 8;
+        return mavlinkFrameLen(len);
+    }
+
+private:
+    uint8_t *buf;
+    uint8_t *pos;
+};
+
+struct MavlinkHeader {
+    uint8_t seq;
+    uint8_t sysid;
+    uint8_t compid;
+};
+
+/* Encoders, out must hold mavlinkFrameLen() of the message's length
+ *    Return the length written
+ */
+
+static inline int mavlinkEncodeHeartbeat(uint8_t *out, const MavlinkHeader &hdr,
+                                         uint8_t type, uint8_t autopilot, uint8_t state)
+{
+    return MavlinkBuilder(out)
+        .u32(0)         // custom_mode
+        .u8(type)
+        .u8(autopilot)
+        .u8(0)          // base_mode
+        .u8(state)      // system_status
+        .u8(3)          // mavlink_version
+        .finish(MAVLINK_MSG_HEARTBEAT, hdr.seq, hdr.sysid, hdr.compid);
+}
+
+// q is w, x, y, z. Angular velocities of NaN leave the rates to the gimbal
+static inline int mavlinkEncodeGimbalManagerSetAttitude(uint8_t *out, const MavlinkHeader &hdr,
+                                                        uint8_t tgtsys, uint8_t tgtcomp,
+                                                        uint8_t deviceid, uint32_t flags,
+                                                        const float q[4], const float angvel[3])
+{
+    MavlinkBuilder b(out);
+    b.u32(flags);
+    for(int i=0; i < 4; i++)
+        b.f32(q[i]);
+    for(int i=0; i < 3; i++)
+        b.f32(angvel[i]);
+    return b.u8(tgtsys)
+        .u8(tgtcomp)
+        .u8(deviceid)
+        .finish(MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE, hdr.seq, hdr.sysid, hdr.compid);
+}
+
+static inline int mavlinkEncodeGimbalDeviceSetAttitude(uint8_t *out, const MavlinkHeader &hdr,
+                                                       uint8_t tgtsys, uint8_t tgtcomp,
+                                                       uint16_t flags,
+                                                       const float q[4], const float angvel[3])
+{
+    MavlinkBuilder b(out);
+    for(int i=0; i < 4; i++)
+        b.f32(q[i]);
+    for(int i=0; i < 3; i++)
+        b.f32(angvel[i]);
+    return b.u16(flags)
+        .u8(tgtsys)
+        .u8(tgtcomp)
+        .finish(MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE, hdr.seq, hdr.sysid, hdr.compid);
+}
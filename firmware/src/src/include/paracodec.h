@@ -0,0 +1,167 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* PARA / OpenTX Bluetooth trainer frame
+ *
+ *  7E 80 [8 channels, 12 bits each, two per 3 bytes] crc 7E
+ *
+ *  The crc is the xor of the 13 bytes from 0x80 on. Any 7E or 7D between the
+ *  start and end bytes is sent as 7D followed by the byte ^ 0x20.
+ *
+ *  OpenTX sends the crc without stuffing it, so the decoder takes the byte at
+ *  the crc position as is, unless it's a 7D that's followed by a stuffed byte.
+ *  The encoder stuffs it, which OpenTX's decoder also reads correctly.
+ *
+ *  Nothing here depends on Zephyr so it can be built on a host.
+ */
+
+constexpr int PARA_CHANNELS = 8;
+constexpr int PARA_PACKET_SIZE = 14; // Type, channel data, crc
+constexpr int PARA_MAX_FRAME = 2 + PARA_PACKET_SIZE * 2; // Everything stuffed
+
+constexpr uint8_t PARA_START_STOP = 0x7E;
+constexpr uint8_t PARA_BYTE_STUFF = 0x7D;
+constexpr uint8_t PARA_STUFF_MASK = 0x20;
+constexpr uint8_t PARA_TRAINER_FRAME = 0x80;
+
+/* Encodes the channels into out, which must hold PARA_MAX_FRAME bytes
+ *    Returns the length written
+ */
+
+static inline int paraEncode(uint8_t *out, const uint16_t ch[PARA_CHANNELS])
+{
+    uint8_t *p = out;
+    uint8_t crc = 0;
+
+    auto push = [&p, &crc](uint8_t byte) {
+        crc ^= byte;
+        if(byte == PARA_START_STOP || byte == PARA_BYTE_STUFF) {
+            *p++ = PARA_BYTE_STUFF;
+            byte ^= PARA_STUFF_MASK;
+        }
+        *p++ = byte;
+    };
+
+    *p++ = PARA_START_STOP;
+    push(PARA_TRAINER_FRAME);
+    for(int i=0; i < PARA_CHANNELS; i+=2) {
+        uint16_t v1 = ch[i];
+        uint16_t v2 = ch[i+1];
+        push(v1 & 0xFF);
+        push(((v1 & 0xF00) >> 4) | ((v2 & 0xF0) >> 4));
+        push(((v2 & 0x0F) << 4) | ((v2 & 0xF00) >> 8));
+    }
+    uint8_t fcrc = crc;
+    push(fcrc);
+    *p++ = PARA_START_STOP;
+
+    return p - out;
+}
+
+/* Decodes received bytes into channels
+ *
+ *  Give it each notification as it arrives, a frame can be split over more
+ *  than one. Only the last complete frame in the data is written to ch.
+ */
+
+class ParaDecoder {
+public:
+    // Returns true if ch was updated
+    bool decode(const uint8_t *data, size_t len, uint16_t ch[PARA_CHANNELS])
+    {
+        bool found = false;
+
+        // Locals so the loop keeps them in registers
+        int idx = index;
+        bool esc = escaped;
+        bool inframe = framing;
+
+        for(size_t i=0; i < len; i++) {
+            uint8_t byte = data[i];
+
+            if(esc) {
+                esc = false;
+                if(idx == PARA_PACKET_SIZE - 1 && byte == PARA_START_STOP) {
+                    // Unstuffed 7D crc, this is the end byte
+                    packet[idx++] = PARA_BYTE_STUFF;
+                    found |= finish(ch);
+                    idx = 0;
+                    inframe = false;
+                    continue;
+                }
+                byte ^= PARA_STUFF_MASK;
+            } else if(byte == PARA_START_STOP && idx != PARA_PACKET_SIZE - 1) {
+                // Start, end or a resync, the end byte of one frame starts the
+                // next. A 7E in the crc position is an unstuffed crc.
+                idx = 0;
+                inframe = true;
+                continue;
+            } else if(!inframe) {
+                continue;
+            } else if(byte == PARA_BYTE_STUFF) {
+                esc = true;
+                continue;
+            }
+
+            packet[idx++] = byte;
+            if(idx == PARA_PACKET_SIZE) {
+                found |= finish(ch);
+                idx = 0;
+                inframe = false;
+            }
+        }
+
+        index = idx;
+        escaped = esc;
+        framing = inframe;
+        return found;
+    }
+
+    void reset()
+    {
+        index = 0;
+        escaped = false;
+        framing = false;
+    }
+
+private:
+    bool finish(uint16_t ch[PARA_CHANNELS])
+    {
+        uint8_t crc = 0;
+        for(int i=0; i < PARA_PACKET_SIZE - 1; i++)
+            crc ^= packet[i];
+        if(crc != packet[PARA_PACKET_SIZE - 1] || packet[0] != PARA_TRAINER_FRAME)
+            return false;
+
+        for(int c=0, i=1; c < PARA_CHANNELS; c+=2, i+=3) {
+            ch[c] = packet[i] | ((packet[i+1] & 0xF0) << 4);
+            ch[c+1] = ((packet[i+1] & 0x0F) << 4) | ((packet[i+2] & 0xF0) >> 4) |
+                      ((packet[i+2] & 0x0F) << 8);
+        }
+        return true;
+    }
+
+    uint8_t packet[PARA_PACKET_SIZE];
+    int index = 0;
+    bool escaped = false;
+    bool framing = false;
+};
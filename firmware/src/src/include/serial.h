@@ -5,16 +5,31 @@
 #include <include/arduinojsonwrp.h>
 #include "defines.h"
 
+// Where a command came from, the reply goes back the same way
+typedef enum {
+  TRANSPORT_USB=0,
+  TRANSPORT_BLE
+} transportt;
+
+// Collects one STX (0x02) ... ETX (0x03) framed command
+struct jsonframer {
+  char buffer[JSON_BUF_SIZE];
+  char *ptr;
+  bool started;
+};
+
 void serial_init();
 void serial_Thread();
 
 // ONLY use these serial write methods, they are buffered & thread safe
-void serialWrite(const char *data, int len);
-void serialWrite(const char *data);
+int serialWrite(const char *data, int len);
+int serialWrite(const char *data);
 int serialWriteF(const char *format, ...);
-void serialWriteJSON(DynamicJsonDocument &json);
+int serialWriteJSON(DynamicJsonDocument &json);
+int serialWriteJSON(DynamicJsonDocument &json, transportt to);
 
-void JSON_Process(char *jsonbuf);
+void JSON_Receive(jsonframer &frm, const char *data, int len, transportt from);
+void JSON_Process(char *jsonbuf, transportt from);
 
 extern struct k_mutex data_mutex;
 extern DynamicJsonDocument json;
\ No newline at end of file
@@ -0,0 +1,130 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/atomic.h>
+
+/* Fixed size snapshot ring, one producer many readers
+ *
+ *  The producer never blocks, it always writes over the oldest slot.
+ *  Each reader keeps it's own sequence cursor, starting at zero, so it can read
+ *  at it's own rate and knows how many frames went by since it last looked.
+ *
+ *  Every slot holds the sequence number of the frame in it. It's cleared while
+ *  the slot is being written so a reader can tell if it's copy was torn and try
+ *  again. Sequence zero is never published.
+ *
+ *  T must be a POD type, N a power of two.
+ */
+
+template<typename T, uint32_t N> class snapshotring {
+    static_assert((N & (N - 1)) == 0, "snapshotring size must be a power of two");
+
+public:
+    snapshotring()
+    {
+        atomic_set(&head, 0);
+        for(uint32_t i=0; i < N; i++)
+            atomic_set(&slots[i].seq, 0);
+    }
+
+    // Producer only. Copies item into the ring, returns it's sequence number
+    uint32_t publish(const T &item)
+    {
+        uint32_t seq = (uint32_t)atomic_get(&head) + 1;
+        if(seq == 0) // Wrapped (~300 days at 166hz), skip the invalid sequence
+            seq = 1;
+
+        slot_t &s = slots[seq & (N - 1)];
+        atomic_set(&s.seq, 0);
+        memcpy(&s.data, &item, sizeof(T));
+        atomic_set(&s.seq, seq);
+        atomic_set(&head, seq);
+        return seq;
+    }
+
+    // Sequence of the newest published frame, 0 if none yet
+    uint32_t latestSeq() const
+    {
+        return (uint32_t)atomic_get(const_cast<atomic_t*>(&head));
+    }
+
+    // Copies the newest frame if it's newer than lastseq
+    //  Returns the number of frames skipped since lastseq, -1 if nothing new
+    int readLatest(T &item, uint32_t &lastseq)
+    {
+        for(int tries=0; tries < MAX_TRIES; tries++) {
+            uint32_t seq = latestSeq();
+            if(seq == lastseq || seq == 0)
+                return -1;
+            if(copy(seq, item))
+                return advance(seq, lastseq);
+        }
+        return -1;
+    }
+
+    // Copies the oldest frame still held which is newer than lastseq, for
+    // readers that want every frame (e.g. a recorder)
+    //  Returns the number of frames lost since lastseq, -1 if nothing new
+    int readNext(T &item, uint32_t &lastseq)
+    {
+        for(int tries=0; tries < MAX_TRIES; tries++) {
+            uint32_t newest = latestSeq();
+            if(newest == lastseq || newest == 0)
+                return -1;
+
+            // Fell too far behind, jump to the oldest frame still in the ring
+            uint32_t seq = lastseq + 1;
+            if(newest - seq >= N - 1)
+                seq = newest - (N - 2);
+
+            if(copy(seq, item))
+                return advance(seq, lastseq);
+        }
+        return -1;
+    }
+
+private:
+    static constexpr int MAX_TRIES = 3;
+
+    struct slot_t {
+        atomic_t seq;
+        T data;
+    };
+
+    bool copy(uint32_t seq, T &item)
+    {
+        slot_t &s = slots[seq & (N - 1)];
+        if((uint32_t)atomic_get(&s.seq) != seq)
+            return false;
+        memcpy(&item, &s.data, sizeof(T));
+        return (uint32_t)atomic_get(&s.seq) == seq; // Producer didn't overwrite it while copying
+    }
+
+    int advance(uint32_t seq, uint32_t &lastseq)
+    {
+        int skipped = lastseq == 0 ? 0 : (int)(seq - lastseq - 1);
+        lastseq = seq;
+        return skipped;
+    }
+
+    atomic_t head;
+    slot_t slots[N];
+};
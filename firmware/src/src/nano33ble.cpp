@@ -8,6 +8,8 @@
 #include "PPMOut.h"
 #include "PPMIn.h"
 #include "SBUS/sbus.h"
+#include "CRSF/crsf.h"
+#include "MAVLINK/mavlink.h"
 #include "pmw.h"
 #include "joystick.h"
 #include "log.h"
@@ -18,6 +20,7 @@
 #include <drivers/clock_control/nrf_clock_control.h>
 #include <drivers/counter.h>
 #include <nrfx_clock.h>
+#include <nrfx_ppi.h>
 
 #define CLOCK_NODE DT_INST(0, nordic_nrf_clock)
 static const struct device *clock0;
@@ -26,6 +29,29 @@ bool led_is_on = false;
 
 TrackerSettings trkset;
 
+// Marks the fixed PPI channels in defines.h as used in the nrfx allocator,
+// so a channel allocated later can't be one of them
+static void reservePPI()
+{
+  uint32_t reserved = 0, others = 0;
+  nrf_ppi_channel_t ch;
+  while(reserved != PPI_FIXED_CHANNELS && nrfx_ppi_channel_alloc(&ch) == NRFX_SUCCESS) {
+    if(PPI_FIXED_CHANNELS & BIT(ch))
+      reserved |= BIT(ch);
+    else
+      others |= BIT(ch);
+  }
+
+  // Give back the ones that were only in the way
+  for(int i=0; i < 32; i++) {
+    if(others & BIT(i))
+      nrfx_ppi_channel_free((nrf_ppi_channel_t)i);
+  }
+
+  if(reserved != PPI_FIXED_CHANNELS)
+    LOGW("PPI channels 0x%x not in the allocator", PPI_FIXED_CHANNELS & ~reserved);
+}
+
 void start(void)
 {
   // Force High Accuracy Clock
@@ -36,6 +62,9 @@ void start(void)
 	}
   clock_control_on(clock0,CLOCK_CONTROL_NRF_SUBSYS_HF);
 
+  // Before anything allocates a PPI channel
+  reservePPI();
+
   // USB Joystick
   joystick_init();
 
@@ -69,6 +98,8 @@ K_THREAD_DEFINE(bt_Thread_id, 4096, bt_Thread, NULL, NULL, NULL, BT_THREAD_PRIO,
 K_THREAD_DEFINE(sensor_Thread_id, 4096, sensor_Thread, NULL, NULL, NULL, SENSOR_THREAD_PRIO, K_FP_REGS, 1000);
 K_THREAD_DEFINE(calculate_Thread_id, 4096, calculate_Thread, NULL, NULL, NULL, CALCULATE_THREAD_PRIO, K_FP_REGS, 1000);
 K_THREAD_DEFINE(SBUS_Thread_id, 1024, sbus_Thread, NULL, NULL, NULL, SBUS_THREAD_PRIO, 0, 1000);
+K_THREAD_DEFINE(CRSF_Thread_id, 1024, crsf_Thread, NULL, NULL, NULL, CRSF_THREAD_PRIO, 0, 1000);
+K_THREAD_DEFINE(MAVLink_Thread_id, 1024, mavlink_Thread, NULL, NULL, NULL, MAVLINK_THREAD_PRIO, 0, 1000);
 
 #elif defined(RTOS_FREERTOS)
   #error "TODO... Add tasks for FreeRTOS"
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Quaternion helpers for the outputs. Only uses libm so it can also be
+// built on a host
+
+#include <math.h>
+#include <string.h>
+#include "orientation.h"
+#include "defines.h"
+
+/* predictOrientation()
+ *      Rotates quaternion q forward by the gyro rate (deg/s, sensor frame) over
+ *      horizon seconds. Rates below PREDICT_DEADZONE are treated as noise and
+ *      the step is limited to PREDICT_MAX_ANGLE, so a still or jittery head
+ *      isn't moved around by the prediction.
+ */
+
+void predictOrientation(const float q[4], float gx, float gy, float gz, float horizon, float out[4])
+{
+    memcpy(out, q, sizeof(float) * 4);
+
+    float rate = sqrtf(gx*gx + gy*gy + gz*gz);
+    if(rate <= PREDICT_DEADZONE || horizon <= 0)
+        return;
+
+    // Soft deadzone, prediction grows from zero instead of stepping in
+    float angle = (rate - PREDICT_DEADZONE) * horizon;
+    angle = fminf(angle, PREDICT_MAX_ANGLE) * DEG_TO_RAD;
+
+    // Rotation of angle about the gyro axis, q' = q * dq
+    float s = sinf(angle * 0.5f) / rate;
+    float d0 = cosf(angle * 0.5f);
+    float d1 = gx * s, d2 = gy * s, d3 = gz * s;
+    out[0] = q[0]*d0 - q[1]*d1 - q[2]*d2 - q[3]*d3;
+    out[1] = q[0]*d1 + q[1]*d0 + q[2]*d3 - q[3]*d2;
+    out[2] = q[0]*d2 - q[1]*d3 + q[2]*d0 + q[3]*d1;
+    out[3] = q[0]*d3 + q[1]*d2 - q[2]*d1 + q[3]*d0;
+}
+
+/* quatToAngles()
+ *      Tilt, roll and pan in degrees from a quaternion, matching the
+ *      fusion getters as sense.cpp uses them (tilt = roll, roll = pitch, pan = yaw)
+ */
+
+void quatToAngles(const float q[4], float &t, float &r, float &p)
+{
+    t = atan2f(q[0]*q[1] + q[2]*q[3], 0.5f - q[1]*q[1] - q[2]*q[2]) * RAD_TO_DEG;
+    r = asinf(fmaxf(-1.0f, fminf(1.0f, -2.0f * (q[1]*q[3] - q[0]*q[2])))) * RAD_TO_DEG;
+    p = atan2f(q[1]*q[2] + q[0]*q[3], 0.5f - q[2]*q[2] - q[3]*q[3]) * RAD_TO_DEG;
+}
+
+/* anglesToQuat()
+ *      MAVLink attitude quaternion from tilt, roll and pan in degrees. The
+ *      Euler angles are roll = head roll about x, pitch = tilt about y and
+ *      yaw = pan about z, in the front-right-down body frame. Pitch is
+ *      positive nose up and yaw positive clockwise from above. Pan from the
+ *      fusion is about z up, counterclockwise, so it changes sign. Tilt and
+ *      roll go through as they are, the reverse settings make head up and
+ *      right ear down positive.
+ */
+
+void anglesToQuat(float t, float r, float p, float q[4])
+{
+    float cr = cosf(r * 0.5f * DEG_TO_RAD), sr = sinf(r * 0.5f * DEG_TO_RAD);
+    float cp = cosf(t * 0.5f * DEG_TO_RAD), sp = sinf(t * 0.5f * DEG_TO_RAD);
+    float cy = cosf(-p * 0.5f * DEG_TO_RAD), sy = sinf(-p * 0.5f * DEG_TO_RAD);
+    q[0] = cr*cp*cy + sr*sp*sy;
+    q[1] = sr*cp*cy - cr*sp*sy;
+    q[2] = cr*sp*cy + sr*cp*sy;
+    q[3] = cr*cp*sy - sr*sp*cy;
+}
@@ -0,0 +1,132 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2021 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <zephyr.h>
+#include "router.h"
+#include "trackersettings.h"
+#include "log.h"
+
+static_assert(ROUTE_SRC_CNT <= 64, "Too many route sources for the used bitmap");
+
+static routeop_t ops[ROUTE_MAX_OPS];
+static int opcnt=0;
+static uint64_t srcused=0;
+
+static void addOp(routeop_t list[], int &cnt, int src, int ch, int xform, float gain=1.0f, float offset=0.0f)
+{
+    if(ch < 1 || ch > 16 || cnt >= ROUTE_MAX_OPS)
+        return;
+    list[cnt].src = src;
+    list[cnt].dst = ch - 1;
+    list[cnt].xform = xform;
+    list[cnt].gain = gain;
+    list[cnt].offset = offset;
+    cnt++;
+}
+
+// Builds the op list from the current settings. Call from the calculate thread
+// only, the list isn't protected.
+
+void Router_Compile()
+{
+    routeop_t list[ROUTE_MAX_OPS];
+    int cnt=0;
+
+    // Lowest precedence first
+    for(int i=0; i < 16; i++)
+        addOp(list, cnt, ROUTE_SRC_PPMIN + i, i + 1, ROUTE_COPY_VALID);
+    for(int i=0; i < 16; i++)
+        addOp(list, cnt, ROUTE_SRC_SBUSIN + i, i + 1, ROUTE_COPY_VALID);
+    for(int i=0; i < BT_CHANNELS; i++)
+        addOp(list, cnt, ROUTE_SRC_BTIN + i, i + 1, ROUTE_COPY_VALID);
+
+    addOp(list, cnt, ROUTE_SRC_AUX + 0, trkset.auxFunc0Ch(), ROUTE_COPY);
+    addOp(list, cnt, ROUTE_SRC_AUX + 1, trkset.auxFunc1Ch(), ROUTE_COPY);
+    addOp(list, cnt, ROUTE_SRC_AUX + 2, trkset.auxFunc2Ch(), ROUTE_COPY);
+
+    addOp(list, cnt, ROUTE_SRC_ANALOG + 0, trkset.analog4Ch(), ROUTE_SCALE,
+          trkset.analog4Gain(), trkset.analog4Offset() + TrackerSettings::MIN_PWM);
+    addOp(list, cnt, ROUTE_SRC_ANALOG + 1, trkset.analog5Ch(), ROUTE_SCALE,
+          trkset.analog5Gain(), trkset.analog5Offset() + TrackerSettings::MIN_PWM);
+    addOp(list, cnt, ROUTE_SRC_ANALOG + 2, trkset.analog6Ch(), ROUTE_SCALE,
+          trkset.analog6Gain(), trkset.analog6Offset() + TrackerSettings::MIN_PWM);
+    addOp(list, cnt, ROUTE_SRC_ANALOG + 3, trkset.analog7Ch(), ROUTE_SCALE,
+          trkset.analog7Gain(), trkset.analog7Offset() + TrackerSettings::MIN_PWM);
+
+    // Reset center pulse, then T/R/P last so they win on overlap
+    addOp(list, cnt, ROUTE_SRC_ALERT, trkset.alertCh(), ROUTE_COPY);
+    addOp(list, cnt, ROUTE_SRC_TILT, trkset.tiltCh(), ROUTE_COPY);
+    addOp(list, cnt, ROUTE_SRC_ROLL, trkset.rollCh(), ROUTE_COPY);
+    addOp(list, cnt, ROUTE_SRC_PAN, trkset.panCh(), ROUTE_COPY);
+
+    // Walk backwards keeping only ops that can still change the output
+    routeop_t kept[ROUTE_MAX_OPS];
+    int keptcnt=0;
+    uint16_t overwritten=0;
+    for(int i=cnt-1; i >= 0; i--) {
+        uint16_t chbit = 1 << list[i].dst;
+        if(overwritten & chbit)
+            continue;
+        if(list[i].xform != ROUTE_COPY_VALID)
+            overwritten |= chbit;
+        kept[keptcnt++] = list[i];
+    }
+
+    srcused = 0;
+    for(int i=0; i < keptcnt; i++) {
+        ops[i] = kept[keptcnt - 1 - i];
+        srcused |= (uint64_t)1 << ops[i].src;
+    }
+    opcnt = keptcnt;
+
+    LOGD("Channel routes compiled, %d ops", opcnt);
+}
+
+// True if a compiled op reads the source, so it's worth filling in
+
+bool Router_SourceUsed(int src)
+{
+    if(src < 0 || src >= ROUTE_SRC_CNT)
+        return false;
+    return srcused & ((uint64_t)1 << src);
+}
+
+// Runs the op list. Channels without a route are left at zero (no data)
+
+void Router_Execute(const float src[ROUTE_SRC_CNT], uint16_t channels[16])
+{
+    for(int i=0; i < 16; i++)
+        channels[i] = 0;
+
+    for(int i=0; i < opcnt; i++) {
+        const routeop_t &op = ops[i];
+        float value = src[op.src];
+        switch(op.xform) {
+        case ROUTE_COPY_VALID:
+            if(value > 0)
+                channels[op.dst] = value;
+            break;
+        case ROUTE_COPY:
+            channels[op.dst] = value;
+            break;
+        case ROUTE_SCALE:
+            value = value * op.gain + op.offset;
+            channels[op.dst] = MAX(TrackerSettings::MIN_PWM, MIN(TrackerSettings::MAX_PWM, value));
+            break;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include "ble.h"
+#include "defines.h"
+
+/* Channel routing table
+ *  The settings (which input, aux, analog or T/R/P value goes to which output
+ *  channel) are compiled into a flat list of ops when they change. The calculate
+ *  thread fills one source array per cycle and runs the list.
+ *
+ *  Ops run in order, later ones win. Conditional ops (PPM, SBUS and BT inputs)
+ *  only write if their source is non-zero. Ops that can never win because a
+ *  later unconditional op writes the same channel are dropped when compiled.
+ */
+
+// Layout of the source array
+enum {
+    ROUTE_SRC_PPMIN = 0,
+    ROUTE_SRC_SBUSIN = ROUTE_SRC_PPMIN + 16,
+    ROUTE_SRC_BTIN = ROUTE_SRC_SBUSIN + 16,
+    ROUTE_SRC_AUX = ROUTE_SRC_BTIN + BT_CHANNELS,
+    ROUTE_SRC_ANALOG = ROUTE_SRC_AUX + 3,
+    ROUTE_SRC_ALERT = ROUTE_SRC_ANALOG + AN_CH_CNT,
+    ROUTE_SRC_TILT,
+    ROUTE_SRC_ROLL,
+    ROUTE_SRC_PAN,
+    ROUTE_SRC_CNT
+};
+
+// Source to channel transforms
+enum {
+    ROUTE_COPY,        // Channel = source
+    ROUTE_COPY_VALID,  // Channel = source, only if source is non-zero
+    ROUTE_SCALE,       // Channel = source * gain + offset, limited to MIN_PWM-MAX_PWM
+};
+
+#define ROUTE_MAX_OPS ROUTE_SRC_CNT
+
+struct routeop_t {
+    uint8_t src;
+    uint8_t dst;    // Output channel 0-15
+    uint8_t xform;
+    float gain;
+    float offset;
+};
+
+void Router_Compile();
+bool Router_SourceUsed(int src);
+void Router_Execute(const float src[ROUTE_SRC_CNT], uint16_t channels[16]);
@@ -20,11 +20,17 @@
 #include <device.h>
 #include "trackersettings.h"
 #include "sense.h"
+#include "orientation.h"
 #include "nano33ble.h"
 #include "log.h"
 #include "ble.h"
 #include "MadgwickAHRS/MadgwickAHRS.h"
+#include "MahonyAHRS/MahonyAHRS.h"
+#include "ESKF/ESKF.h"
 #include "SBUS/sbus.h"
+#include "CRSF/crsf.h"
+#include "MAVLINK/mavlink.h"
+#include "chanpack.h"
 #include "APDS9960/APDS9960.h"
 #include "pmw.h"
 #include "LSM9DS1/LSM9DS1.h"
@@ -32,7 +38,9 @@
 #include "filters.h"
 #include "io.h"
 #include "analog.h"
-#include "filters/SF1eFilter.h"
+#include "filters/oneeurobank.h"
+#include "telemetry.h"
+#include "router.h"
 
 static float auxdata[10];
 static float raccx=0,raccy=0,raccz=0;
@@ -41,6 +49,8 @@ static float rgyrx=0,rgyry=0,rgyrz=0;
 static float accx=0,accy=0,accz=0;
 static float magx=0,magy=0,magz=0;
 static float gyrx=0,gyry=0,gyrz=0;
+static float accsum[3]={0,0,0}, gyrsum[3]={0,0,0}; // Samples since the last fusion update
+static int acccnt=0, gyrcnt=0;
 static float tilt=0,roll=0,pan=0;
 static float rolloffset=0, panoffset=0, tiltoffset=0;
 static float magxoff=0, magyoff=0, magzoff=0;
@@ -59,7 +69,16 @@ static float bt_chansf[BT_CHANNELS];
 // Output channel data
 static uint16_t channel_data[16];
 
-Madgwick madgwick;
+// Sensor fusion, selected by the fusion setting
+static Madgwick madgwick;
+static Mahony mahony;
+static ESKF eskf;
+static FusionEngine *fusion = &madgwick;
+static uint32_t fusioncycles=0; // CPU cycles of the last fusion update
+
+// Thread periods, follow the IMU rate settings
+static volatile uint32_t sensorperiod=1000000 / (2 * TrackerSettings::DEF_IMU_ODR); // (us)
+static volatile uint32_t calcperiod=1000000 / TrackerSettings::DEF_IMU_ODR; // (us)
 
 int64_t usduration=0;
 
@@ -78,11 +97,28 @@ LSM9DS1Class IMU;
 static int madgreads=0;
 static uint8_t madgsensbits=0;
 static volatile bool firstrun=true;
+static float madgerror=1.0f; // Filtered fusion error, decides when startup is done
+static float madgconvtime=0;
 static float aacc[3]={0,0,0};
 static float amag[3]={0,0,0};
+static volatile bool magnew=false; // Mag sample read since the last fusion update
+static float magref=0, dipref=0;   // Field strength and dip angle at the initial orientation
+static float accref=0;             // Accel strength there
+static bool magdisturbed=false;
+static int maggood=0;
+static float magsum=0, dipsum=0;   // Undisturbed samples since magreftime, for a new reference
+static int magsumcnt=0, dipsumcnt=0;
+static uint32_t magreftime=0;      // (ms)
 
 // Analog Filters
-SF1eFilter *anFilter[AN_CH_CNT];
+static OneEuroBank<AN_CH_CNT> anFilter;
+
+// Adaptive Tilt/Roll/Pan output filter
+static OneEuroBank<3> trpFilter;
+
+// Data out to the GUI, Bluetooth, etc.
+snapshotring<TelemetryFrame, TELEMETRY_RING_SIZE> telemetry;
+static TelemetryFrame tlmframe;
 
 volatile bool senseTreadRun = false;
 
@@ -106,11 +142,15 @@ int sense_Init()
         bt_chansf[i] = 0;
     }
 
-    // Create analog filters
-    for(int i=0; i < AN_CH_CNT; i++) {
-        anFilter[i] = SF1eFilterCreate(AN_FILT_FREQ, AN_FILT_MINCO, AN_FILT_SLOPE, AN_FILT_DERCO);
-        SF1eFilterInit(anFilter[i]);
-    }
+    // Start the cycle counter used to time the fusion update
+#if defined(DWT)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    // Setup analog filters
+    anFilter.init(AN_FILT_FREQ, AN_FILT_MINCO, AN_FILT_SLOPE, AN_FILT_DERCO);
 
     setLEDFlag(LED_GYROCAL);
 
@@ -120,6 +160,160 @@ int sense_Init()
     return 0;
 }
 
+// Free running CPU cycle counter, 0 if there isn't one
+static inline uint32_t cycleCount()
+{
+#if defined(DWT)
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
+
+static FusionEngine *selectFusion(int engine)
+{
+    switch(engine) {
+    case TrackerSettings::FUSION_MAHONY:
+        return &mahony;
+    case TrackerSettings::FUSION_ESKF:
+        return &eskf;
+    default:
+        return &madgwick;
+    }
+}
+
+/* Applies the IMU rate and range settings when they change. Starting values
+ * are what LSM9DS1::begin() sets up. Setting the gyro or mag rate measures
+ * the real rate, that blocks for a few hundred ms.
+ */
+
+static void configureIMU()
+{
+    static int imuodr=119, gyrobw=0, gyrofs=2000, accfs=4, magodr=80;
+
+    if(trkset.imuODR() != imuodr) {
+        imuodr = trkset.imuODR();
+        switch(imuodr) {
+        case 238: IMU.setGyroODR(4); break; // Also sets the accel rate
+        case 476: IMU.setGyroODR(5); break;
+        default: IMU.setGyroODR(3); break;
+        }
+        LOGI("IMU rate %dhz", imuodr);
+    }
+    if(trkset.gyroBW() != gyrobw) {
+        gyrobw = trkset.gyroBW();
+        IMU.setGyroBW(gyrobw);
+    }
+    if(trkset.gyroFS() != gyrofs) {
+        gyrofs = trkset.gyroFS();
+        switch(gyrofs) {
+        case 245: IMU.setGyroFS(0); break;
+        case 500: IMU.setGyroFS(1); break;
+        default: IMU.setGyroFS(3); break;
+        }
+    }
+    if(trkset.accFS() != accfs) {
+        accfs = trkset.accFS();
+        switch(accfs) {
+        case 2: IMU.setAccelFS(0); break;
+        case 8: IMU.setAccelFS(3); break;
+        case 16: IMU.setAccelFS(1); break;
+        default: IMU.setAccelFS(2); break;
+        }
+    }
+    if(trkset.magODR() != magodr) {
+        magodr = trkset.magODR();
+        switch(magodr) {
+        case 20: IMU.setMagnetODR(5); break;
+        case 40: IMU.setMagnetODR(6); break;
+        default: IMU.setMagnetODR(7); break;
+        }
+    }
+
+    // Poll at twice the output rate so no samples are missed, fusion runs
+    // once per fusiondiv samples
+    sensorperiod = 1000000 / (2 * imuodr);
+    calcperiod = 1000000 * trkset.fusionDivider() / imuodr;
+}
+
+// Angle of the field below horizontal (deg)
+static float dipAngle(const float a[3], const float m[3])
+{
+    float nn = sqrtf((a[0]*a[0] + a[1]*a[1] + a[2]*a[2]) * (m[0]*m[0] + m[1]*m[1] + m[2]*m[2]));
+    if(nn == 0)
+        return 0;
+    float s = -(a[0]*m[0] + a[1]*m[1] + a[2]*m[2]) / nn;
+    return asinf(s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s)) * RAD_TO_DEG;
+}
+
+static void resetMagRef()
+{
+    magsum = dipsum = 0;
+    magsumcnt = dipsumcnt = 0;
+    magreftime = millis();
+}
+
+/* Compares the mag sample to the field at the initial orientation. Motors,
+ * VTX's, etc. nearby change the strength or the dip angle, headings from
+ * those samples are wrong. It must look good for a few samples in a row
+ * before it's used again.
+ *
+ * The dip angle is only checked while the accel is close to gravity alone,
+ * when the head is accelerating it doesn't point down. After MAG_REF_TIME
+ * undisturbed the reference becomes the average of that time, so slow
+ * changes like the sensor warming up don't end up flagged as disturbed.
+ */
+
+static void checkMagDisturbed()
+{
+    float a[3] = {accx, accy, accz};
+    float m[3] = {magx, magy, magz};
+    float field = sqrtf(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+    float accel = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+    float dip = dipAngle(a, m);
+    bool accstable = accref > 0 && fabsf(accel / accref - 1.0f) < MAG_ACCEL_TOL;
+
+    bool bad = magref <= 0 ||
+               fabsf(field / magref - 1.0f) > MAG_FIELD_TOL ||
+               (accstable && fabsf(dip - dipref) > MAG_DIP_TOL);
+
+    if(bad) {
+        if(!magdisturbed)
+            LOGD("Magnetometer disturbed, field %.2f ref %.2f", field, magref);
+        magdisturbed = true;
+        maggood = 0;
+        resetMagRef();
+    } else if(magdisturbed) {
+        if(++maggood >= MAG_GOOD_SAMPLES) {
+            magdisturbed = false;
+            resetMagRef();
+        }
+    } else {
+        magsum += field;
+        magsumcnt++;
+        if(accstable) {
+            dipsum += dip;
+            dipsumcnt++;
+        }
+        if(millis() - magreftime > MAG_REF_TIME * 1000) {
+            magref = magsum / magsumcnt;
+            if(dipsumcnt > 0)
+                dipref = dipsum / dipsumcnt;
+            resetMagRef();
+        }
+    }
+}
+
+// Startup gain of the active engine, each has it's own meaning
+static float fusionStartGain()
+{
+    if(fusion == &mahony)
+        return MAHONY_KP_START;
+    if(fusion == &eskf)
+        return ESKF_ATT_START;
+    return MADG_BETA_START;
+}
+
 //----------------------------------------------------------------------
 // Calculations and Main Channel Thread
 //----------------------------------------------------------------------
@@ -134,12 +328,33 @@ void calculate_Thread()
 
         usduration = micros64();
 
+        // Switch fusion engine, it starts over from the initial orientation
+        FusionEngine *selfusion = selectFusion(trkset.fusionEngine());
+        if(selfusion != fusion) {
+            fusion = selfusion;
+            LOGI("Using %s sensor fusion", fusion->name());
+            reset_fusion();
+        }
+
         // Period Between Samples
-        float deltat = madgwick.deltatUpdate();
+        float deltat = fusion->deltatUpdate();
 
         // Use a mutex so sensor data can't be updated part way
         k_mutex_lock(&sensor_mutex, K_FOREVER);
 
+        // Average the samples read since the last update, anti alias for the
+        // lower fusion rate. Hold the last values if none came in
+        if(acccnt > 0) {
+            accx = accsum[0] / acccnt; accy = accsum[1] / acccnt; accz = accsum[2] / acccnt;
+            accsum[0] = 0; accsum[1] = 0; accsum[2] = 0;
+            acccnt = 0;
+        }
+        if(gyrcnt > 0) {
+            gyrx = gyrsum[0] / gyrcnt; gyry = gyrsum[1] / gyrcnt; gyrz = gyrsum[2] / gyrcnt;
+            gyrsum[0] = 0; gyrsum[1] = 0; gyrsum[2] = 0;
+            gyrcnt = 0;
+        }
+
         // Only do this update after the first mag and accel data have been read.
         if(madgreads == 0) {
             if(madgsensbits == MADGINIT_READY) {
@@ -164,24 +379,65 @@ void calculate_Thread()
         // Got the averaged values, apply the initial orientation.
         } else if(madgreads == MADGSTART_SAMPLES-1) {
             // Pass it averaged values
-            madgwick.begin(aacc[0], aacc[1], aacc[2], amag[0], amag[1], amag[2]);
-            panoffset = pan;
+            fusion->begin(aacc[0], aacc[1], aacc[2], amag[0], amag[1], amag[2]);
+            magref = sqrtf(amag[0]*amag[0] + amag[1]*amag[1] + amag[2]*amag[2]);
+            dipref = dipAngle(aacc, amag);
+            accref = sqrtf(aacc[0]*aacc[0] + aacc[1]*aacc[1] + aacc[2]*aacc[2]);
+            magdisturbed = false;
+            resetMagRef();
+            fusion->startConvergence(fusionStartGain(), MADG_BETA_DECAY);
+            madgerror = 1.0f;
+            madgconvtime = 0;
             madgreads = MADGSTART_SAMPLES;
         }
 
         // Do the AHRS calculations
         if(madgreads == MADGSTART_SAMPLES) {
-            madgwick.update(gyrx * DEG_TO_RAD, gyry * DEG_TO_RAD, gyrz * DEG_TO_RAD,
-                            accx, accy, accz,
-                            magx, magy, magz,
-                            deltat);
-            roll = madgwick.getPitch();
-            tilt = madgwick.getRoll();
-            pan = madgwick.getYaw();
+            // Full update only when a new mag sample came in and it looks
+            // like the earth's field, gyro + accel only otherwise
+            bool usemag = false;
+            if(magnew) {
+                magnew = false;
+                checkMagDisturbed();
+                usemag = !magdisturbed;
+            }
+
+            uint32_t cycstart = cycleCount();
+            if(usemag)
+                fusion->update(gyrx * DEG_TO_RAD, gyry * DEG_TO_RAD, gyrz * DEG_TO_RAD,
+                               accx, accy, accz,
+                               magx, magy, magz,
+                               deltat);
+            else
+                fusion->updateIMU(gyrx * DEG_TO_RAD, gyry * DEG_TO_RAD, gyrz * DEG_TO_RAD,
+                                  accx, accy, accz,
+                                  deltat);
+            fusioncycles = cycleCount() - cycstart;
+
+            // Look ahead by the gyro rate to make up for output latency,
+            // the angles come from the predicted quaternion in that case
+            float horizon = (float)trkset.predictTime() / 1000.0f;
+            if(horizon > 0 && !firstrun) {
+                float q[4];
+                predictOrientation(fusion->getQuat(), gyrx, gyry, gyrz, horizon, q);
+                quatToAngles(q, tilt, roll, pan);
+            } else {
+                roll = fusion->getPitch();
+                tilt = fusion->getRoll();
+                pan = fusion->getYaw();
+            }
 
+            // Keep pan centered while the filter settles, only latch the
+            // offset once the sensors agree with the orientation (or it times out)
             if(firstrun) {
                 panoffset = pan;
-                firstrun = false;
+                madgerror += MADG_ERROR_LP * (fusion->getError() - madgerror);
+                madgconvtime += deltat;
+                if(!fusion->converging() &&
+                   (madgerror < MADG_CONVERGED_ERR || madgconvtime > MADG_CONVERGE_TIMEOUT)) {
+                    LOGI("Fusion settled in %.2fs, error %.3f", madgconvtime, madgerror);
+                    firstrun = false;
+                }
             }
         }
 
@@ -234,24 +490,54 @@ void calculate_Thread()
             }
         }
 
-        // Tilt output
+        // Tilt/Roll/Pan outputs, Pan normalized to +/- 180 Degrees
         float tiltout = (tilt - tiltoffset) * trkset.Tlt_gain() * (trkset.isTiltReversed()?-1.0:1.0);
-        float beta = (float)trkset.lpTiltRoll() / 100;                        // LP Beta
-        filter_expAverage(&tiltout, beta, &l_tiltout);
+        float rollout = (roll - rolloffset) * trkset.Rll_gain() * (trkset.isRollReversed()? -1.0:1.0);
+        float panout = normalize((pan-panoffset),-180,180)  * trkset.Pan_gain() * (trkset.isPanReversed()? -1.0:1.0);
+
+        // MAVLink gimbals take real angles, so the same without the gains
+        float gimangles[3] = {(tilt - tiltoffset) * (trkset.isTiltReversed()?-1.0f:1.0f),
+                              (roll - rolloffset) * (trkset.isRollReversed()?-1.0f:1.0f),
+                              normalize((pan-panoffset),-180,180) * (trkset.isPanReversed()?-1.0f:1.0f)};
+
+        // Time since last cycle for the adaptive filter
+        static int64_t lastcycle=0;
+        float cycledt = (float)(usduration - lastcycle) / 1000000.0f;
+        if(lastcycle == 0 || cycledt <= 0 || cycledt > 0.1f)
+            cycledt = (float)calcperiod / 1000000.0f;
+        lastcycle = usduration;
+
+        // Smoothing
+        static int lastlpmode = -1;
+        int lpmode = trkset.lpMode();
+        if(lpmode == TrackerSettings::LP_MODE_ADAPTIVE) {
+            // One Euro filter, cutoff rises with the head's rotation rate. Still
+            // jitter is removed while fast turns are barely delayed
+            if(lastlpmode != lpmode)
+                trpFilter.reset();
+            trpFilter.setCutoff(trkset.lpMinCutoff(), trkset.lpSlope());
+            float gyrrate = sqrtf(gyrx*gyrx + gyry*gyry + gyrz*gyrz); // deg/s
+            float trp[3] = {tiltout, rollout, panout};
+            float speed[3] = {gyrrate, gyrrate, gyrrate};
+            trpFilter.update(trp, speed, trp, cycledt);
+            tiltout = trp[0]; rollout = trp[1]; panout = trp[2];
+
+            // Keep the fixed filters following so switching modes doesn't jump
+            l_tiltout = tiltout; l_rollout = rollout; l_panout = panout;
+        } else {
+            float beta = (float)trkset.lpTiltRoll() / 100;                    // LP Beta
+            filter_expAverage(&tiltout, beta, &l_tiltout);
+            filter_expAverage(&rollout, beta, &l_rollout);
+            filter_expAverage(&panout, (float)trkset.lpPan() / 100, &l_panout);
+        }
+        lastlpmode = lpmode;
+
         uint16_t tiltout_ui = tiltout + trkset.Tlt_cnt();                     // Apply Center Offset
         tiltout_ui = MAX(MIN(tiltout_ui,trkset.Tlt_max()),trkset.Tlt_min());  // Limit Output
-
-        // Roll output
-        float rollout = (roll - rolloffset) * trkset.Rll_gain() * (trkset.isRollReversed()? -1.0:1.0);
-        filter_expAverage(&rollout, beta, &l_rollout);
         uint16_t rollout_ui = rollout + trkset.Rll_cnt();                     // Apply Center Offset
         rollout_ui = MAX(MIN(rollout_ui,trkset.Rll_max()),trkset.Rll_min());  // Limit Output
-
-        // Pan output, Normalize to +/- 180 Degrees
-        float panout = normalize((pan-panoffset),-180,180)  * trkset.Pan_gain() * (trkset.isPanReversed()? -1.0:1.0);
-        filter_expAverage(&panout, (float)trkset.lpPan() / 100, &l_panout);
-        uint16_t panout_ui = panout + trkset.Pan_cnt();                    // Apply Center Offset
-        panout_ui = MAX(MIN(panout_ui,trkset.Pan_max()),trkset.Pan_min()); // Limit Output
+        uint16_t panout_ui = panout + trkset.Pan_cnt();                       // Apply Center Offset
+        panout_ui = MAX(MIN(panout_ui,trkset.Pan_max()),trkset.Pan_min());    // Limit Output
 
         // Reset on tilt
         static bool doresetontilt=false;
@@ -289,7 +575,7 @@ void calculate_Thread()
 
             // If hit a max/min wait an amount of time and reset it
             if(tiltpeak == true) {
-                resettime += (float)CALCULATE_PERIOD / 1000000.0;
+                resettime += (float)calcperiod / 1000000.0;
                 if(resettime > TrackerSettings::RESET_ON_TILT_TIME) {
                     tiltpeak = false;
                     minmax = HITNONE;
@@ -306,22 +592,22 @@ void calculate_Thread()
                 timetoreset = 0;
                 pressButton();
             }
-            timetoreset += (float)CALCULATE_PERIOD / 1000000.0;
+            timetoreset += (float)calcperiod / 1000000.0;
         }
 
         /* ************************************************************
         *       Build channel data
         *
         * Build Channel Data
-        *   1) Reset all channels to disabled
-        *   2) Set PPMin channels
-        *   3) Set SBUSin channels
-        *   4) Set received BT channels
+        *   1) Recompile the channel routes if the settings changed
+        *   2) Read PPMin channels
+        *   3) Read SBUSin channels
+        *   4) Read received BT channels
         *   5) Reset Center on PPM channel
-        *   6) Set auxiliary functions
-        *   7) Set analog channels
-        *   8) Set Reset Center pulse channel
-        *   9) Override desired channels with pan/tilt/roll
+        *   6) Auxiliary functions
+        *   7) Analog channels
+        *   8) Reset Center pulse
+        *   9) Pan/tilt/roll, then run the routes into the channels
         *  10) Output to PPMout
         *  11) Output to Bluetooth
         *  12) Output to SBUS
@@ -333,26 +619,28 @@ void calculate_Thread()
         *  Allows the GUI to know which channels are valid
         */
 
-        // 1) Reset all Channels to zero which means they have no data
-        for(int i=0;i<16;i++)
-            channel_data[i] = 0;
+        // 1) Routes are only rebuilt when the settings change, not every cycle
+        static uint32_t routeversion=0;
+        if(routeversion != trkset.settingsVersion()) {
+            routeversion = trkset.settingsVersion();
+            Router_Compile();
+        }
+        static float routesrc[ROUTE_SRC_CNT];
 
         // 2) Read all PPM inputs
         PpmIn_execute();
         for(int i=0;i<16;i++)
             ppm_in_chans[i] = 0;    // Reset all PPM in channels to Zero (Not active)
         int ppm_in_chcnt = PpmIn_getChannels(ppm_in_chans);
-        if(ppm_in_chcnt >= 4 && ppm_in_chcnt <= 16) {
-            for(int i=0;i<MIN(ppm_in_chcnt,16);i++) {
-                channel_data[i] = ppm_in_chans[i];
-            }
-        }
+        bool ppm_in_valid = ppm_in_chcnt >= 4 && ppm_in_chcnt <= 16;
+        for(int i=0;i<16;i++)
+            routesrc[ROUTE_SRC_PPMIN + i] = ppm_in_valid ? ppm_in_chans[i] : 0;
 
-        // 3) Set all incoming SBUS values
+        // 3) Read all incoming SBUS values
         static float sbustimer=TrackerSettings::SBUS_ACTIVE_TIME;
         static bool lostmsgsent=false;
         static bool recmsgsent=false;
-        sbustimer += (float)CALCULATE_PERIOD / 1000000.0;
+        sbustimer += (float)calcperiod / 1000000.0;
         if(SBUS_Read_Data(sbus_in_chans)) { // Valid SBUS packet received?
             sbustimer = 0;
         }
@@ -365,31 +653,25 @@ void calculate_Thread()
                 lostmsgsent = true;
             }
             recmsgsent = false;
-        // SBUS data still valid, set the channel values to the last SBUS
+        // SBUS data still valid, use the last SBUS values
         } else {
-            for(int i=0; i < 16; i++)
-                channel_data[i] = sbus_in_chans[i];
             if(!recmsgsent) {
                 LOGD("SBUS Data Received");
                 recmsgsent = true;
             }
             lostmsgsent = false;
         }
+        for(int i=0; i < 16; i++)
+            routesrc[ROUTE_SRC_SBUSIN + i] = sbus_in_chans[i];
 
-        // 4) Set all incoming BT values
+        // 4) Read all incoming BT values
         // Bluetooth cannot send a zero value for a channel with PARA. Radios see this as invalid data.
         // So, if the data is coming from a BLE head unit it also has a characteristic to nofity which
         // ones are valid alloww PPM/SBUS pass through on the head or remote boards on ch 1-8
         // If the data is coming from a PARA radio all 8ch's are going to have values, all PPM/SBUS inputs 1-8 will be overridden
-
-        for(int i=0;i<BT_CHANNELS;i++)
-            bt_chans[i] = 0;    // Reset all BT in channels to Zero (Not active)
         for(int i=0;i<BT_CHANNELS;i++) {
-            uint16_t btvalue = BTGetChannel(i);
-            if(btvalue > 0) {
-                bt_chans[i] = btvalue;
-                channel_data[i] = btvalue;
-            }
+            bt_chans[i] = BTGetChannel(i);
+            routesrc[ROUTE_SRC_BTIN + i] = bt_chans[i];
         }
 
         // 5) If selected input channel went > 1800us reset the center
@@ -406,76 +688,51 @@ void calculate_Thread()
             }
         }*/ //REMOVED as of V2.1
 
-        // 6) Set Auxiliary Functions
-        int aux0ch = trkset.auxFunc0Ch();
-        int aux1ch = trkset.auxFunc1Ch();
-        int aux2ch = trkset.auxFunc2Ch();
-        if(aux0ch > 0 || aux1ch > 0) {
+        // 6) Auxiliary Functions, only built if routed somewhere
+        if(Router_SourceUsed(ROUTE_SRC_AUX + 0) ||
+           Router_SourceUsed(ROUTE_SRC_AUX + 1) ||
+           Router_SourceUsed(ROUTE_SRC_AUX + 2)) {
             buildAuxData();
-            if(aux0ch > 0)
-                channel_data[aux0ch - 1] = auxdata[trkset.auxFunc0()];
-            if(aux1ch > 0)
-                channel_data[aux1ch - 1] = auxdata[trkset.auxFunc1()];
-            if(aux2ch > 0)
-                channel_data[aux2ch - 1] = auxdata[trkset.auxFunc2()];
-        }
-
-        // 7) Set Analog Channels
-        if(trkset.analog4Ch() > 0) {
-            float an4 = SF1eFilterDo(anFilter[0], analogRead(AN4));
-            an4 *= trkset.analog4Gain();
-            an4 += trkset.analog4Offset();
-            an4 += TrackerSettings::MIN_PWM;
-            an4 = MAX(TrackerSettings::MIN_PWM,MIN(TrackerSettings::MAX_PWM,an4));
-            channel_data[trkset.analog4Ch()-1] = an4;
-        }
-        if(trkset.analog5Ch() > 0) {
-            float an5 = SF1eFilterDo(anFilter[1], analogRead(AN5));
-            an5 *= trkset.analog5Gain();
-            an5 += trkset.analog5Offset();
-            an5 += TrackerSettings::MIN_PWM;
-            an5 = MAX(TrackerSettings::MIN_PWM,MIN(TrackerSettings::MAX_PWM,an5));
-            channel_data[trkset.analog5Ch()-1] = an5;
-        }
-        if(trkset.analog6Ch() > 0) {
-	        float an6 = SF1eFilterDo(anFilter[2], analogRead(AN6));
-            an6 *= trkset.analog6Gain();
-            an6 += trkset.analog6Offset();
-            an6 += TrackerSettings::MIN_PWM;
-            an6 = MAX(TrackerSettings::MIN_PWM,MIN(TrackerSettings::MAX_PWM,an6));
-            channel_data[trkset.analog6Ch()-1] = an6;
-        }
-        if(trkset.analog7Ch() > 0) {
-            float an7 = SF1eFilterDo(anFilter[3], analogRead(AN7));
-            an7 *= trkset.analog7Gain();
-            an7 += trkset.analog7Offset();
-            an7 += TrackerSettings::MIN_PWM;
-            an7 = MAX(TrackerSettings::MIN_PWM,MIN(TrackerSettings::MAX_PWM,an7));
-            channel_data[trkset.analog7Ch()-1] = an7;
+            int auxfunc[3] = {trkset.auxFunc0(), trkset.auxFunc1(), trkset.auxFunc2()};
+            for(int i=0; i < 3; i++) {
+                if(auxfunc[i] >= 0 && auxfunc[i] < (int)(sizeof(auxdata)/sizeof(auxdata[0])))
+                    routesrc[ROUTE_SRC_AUX + i] = auxdata[auxfunc[i]];
+            }
         }
 
-        // 8) First decide if 'reset center' pulse should be sent
+        // 7) Analog Channels, filtered together. Gain and offset are applied by the route
+        static const int anpins[AN_CH_CNT] = {AN4, AN5, AN6, AN7};
+        static float anvalues[AN_CH_CNT] = {0};
+        bool anused = false;
+        for(int i=0; i < AN_CH_CNT; i++) {
+            if(Router_SourceUsed(ROUTE_SRC_ANALOG + i)) {
+                anvalues[i] = analogRead(anpins[i]);
+                anused = true;
+            }
+        }
+        if(anused)
+            anFilter.update(anvalues, &routesrc[ROUTE_SRC_ANALOG]);
 
+        // 8) First decide if 'reset center' pulse should be sent
         static float pulsetimer=0;
         static bool sendingresetpulse = false;
-        int alertch = trkset.alertCh();
-        if (alertch > 0) {
+        routesrc[ROUTE_SRC_ALERT] = TrackerSettings::MIN_PWM;
+        if (Router_SourceUsed(ROUTE_SRC_ALERT)) {
             // Synthesize a pulse indicating reset center started
-            channel_data[alertch - 1] = TrackerSettings::MIN_PWM;
             if (butdnw) {
                 sendingresetpulse = true;
                 pulsetimer=0;
             }
             if (sendingresetpulse) {
-                channel_data[alertch - 1] = TrackerSettings::MAX_PWM;
-                pulsetimer += (float)CALCULATE_PERIOD / 1000000.0;
+                routesrc[ROUTE_SRC_ALERT] = TrackerSettings::MAX_PWM;
+                pulsetimer += (float)calcperiod / 1000000.0;
                 if(pulsetimer > TrackerSettings::RECENTER_PULSE_DURATION) {
                     sendingresetpulse = false;
                 }
             }
         }
 
-        // 9) Then, set Tilt/Roll/Pan Channel Values (after reset center in case of channel overlap)
+        // 9) Then, Tilt/Roll/Pan Channel Values
 
         // If the long press for enable/disable isn't set or if there is no reset button configured
         //   always enable the T/R/P outputs
@@ -494,15 +751,12 @@ void calculate_Thread()
         if(!gyro_calibrated)
             trpOutputEnabled = false;
 
-        int tltch = trkset.tiltCh();
-        int rllch = trkset.rollCh();
-        int panch = trkset.panCh();
-        if(tltch > 0)
-            channel_data[tltch - 1] = trpOutputEnabled == true ? tiltout_ui : trkset.Tlt_cnt();
-        if(rllch > 0)
-            channel_data[rllch - 1] = trpOutputEnabled == true ? rollout_ui : trkset.Rll_cnt();
-        if(panch > 0)
-            channel_data[panch - 1] = trpOutputEnabled == true ? panout_ui : trkset.Pan_cnt();
+        routesrc[ROUTE_SRC_TILT] = trpOutputEnabled == true ? tiltout_ui : trkset.Tlt_cnt();
+        routesrc[ROUTE_SRC_ROLL] = trpOutputEnabled == true ? rollout_ui : trkset.Rll_cnt();
+        routesrc[ROUTE_SRC_PAN] = trpOutputEnabled == true ? panout_ui : trkset.Pan_cnt();
+
+        // Sources to channels, precedence was sorted out when the routes were compiled
+        Router_Execute(routesrc, channel_data);
 
         // 10) Set the PPM Outputs
         for(int i=0;i<PpmOut_getChnCount();i++) {
@@ -512,22 +766,31 @@ void calculate_Thread()
             PpmOut_setChannel(i,ppmout);
         }
 
-        // 11) Set all the BT Channels, send the zeros don't center
-        bool bleconnected=BTGetConnected();
-        trkset.setBLEAddress(BTGetAddress());
-        for(int i=0;i < BT_CHANNELS;i++) {
-            BTSetChannel(i,channel_data[i]);
-        }
+        // 11) Bluetooth channels are picked up by the BT thread from the telemetry frame
 
-        // 12) Set all SBUS output channels, if disabled set to center
+        // 12) Set all SBUS or CRSF output channels, if disabled set to center.
+        //     MAVLink sends the attitude instead, level when disabled
         uint16_t sbus_data[16];
         for(int i=0;i<16;i++) {
             uint16_t sbusout = channel_data[i];
             if(sbusout == 0)
                 sbusout = TrackerSettings::PPM_CENTER;
-            sbus_data[i] = (static_cast<float>(sbusout) - TrackerSettings::PPM_CENTER) * TrackerSettings::SBUS_SCALE + TrackerSettings::SBUS_CENTER;
+            sbus_data[i] = chanpack::fromPPM(sbusout);
+        }
+        switch(trkset.serialMode()) {
+        case TrackerSettings::SERMODE_CRSF:
+            CRSF_TX_Send(sbus_data); // Every cycle, CRSF has the same channel scale
+            break;
+        case TrackerSettings::SERMODE_MAVLINK: {
+            float gimq[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+            if(trpOutputEnabled)
+                anglesToQuat(gimangles[0], gimangles[1], gimangles[2], gimq);
+            MAV_TX_SendAttitude(gimq);
+            break;
+        }
+        default:
+            SBUS_TX_BuildData(sbus_data);
         }
-        SBUS_TX_BuildData(sbus_data);
 
         // 13) Set PWM Channels
         for(int i=0;i<4;i++) {
@@ -540,55 +803,46 @@ void calculate_Thread()
             }
         }
 
-        // 14 Set USB Joystick Channels, Only 8 channels
-        static int joycnt=0;
-        if(joycnt++ == 1) {
-            set_JoystickChannels(channel_data);
-            joycnt=0;
-        }
-
-        // Update the settings for the GUI
-        // Both data and sensor threads will use this data. If data thread has it locked skip this reading.
-        if(k_mutex_lock(&data_mutex, K_NO_WAIT) == 0) {
-            // Raw values for calibration
-            trkset.setRawAccel(raccx,raccy,raccz);
-            trkset.setRawGyro(rgyrx,rgyry,rgyrz);
-            trkset.setRawMag(rmagx,rmagy,rmagz);
-
-            // Offset values for debug
-            trkset.setOffAccel(accx,accy,accz);
-            trkset.setOffGyro(gyrx,gyry,gyrz);
-            trkset.setOffMag(magx,magy,magz);
-
-            trkset.setRawOrient(tilt,roll,pan);
-            trkset.setOffOrient(tilt-tiltoffset,roll-rolloffset, normalize(pan-panoffset,-180,180));
-            trkset.setPPMOut(tiltout_ui,rollout_ui,panout_ui);
-
-            // PPM Input Values
-            trkset.setPPMInValues(ppm_in_chans);
-            trkset.setBLEValues(bt_chans);
-            trkset.setSBUSValues(sbus_in_chans);
-            trkset.setChannelOutValues(channel_data);
-            trkset.setTRPEnabled(trpOutputEnabled);
-
-            trkset.setGyroCalibrated(gyro_calibrated);
-
-            // Qauterion Data
-            float *qd = madgwick.getQuat();
-            trkset.setQuaternion(qd);
-
-            // Bluetooth connected
-            trkset.setBlueToothConnected(bleconnected);
-            k_mutex_unlock(&data_mutex);
-        }
+        // 14 Set USB Joystick Channels, a report only goes out if something changed
+        set_JoystickChannels(channel_data);
+
+        // Publish this cycle's data for the GUI & Bluetooth. Never blocks, readers
+        // that fall behind just see a gap in the sequence numbers
+        tlmframe.time = micros();
+        tlmframe.raccx = raccx; tlmframe.raccy = raccy; tlmframe.raccz = raccz;
+        tlmframe.rgyrx = rgyrx; tlmframe.rgyry = rgyry; tlmframe.rgyrz = rgyrz;
+        tlmframe.rmagx = rmagx; tlmframe.rmagy = rmagy; tlmframe.rmagz = rmagz;
+        tlmframe.accx = accx; tlmframe.accy = accy; tlmframe.accz = accz;
+        tlmframe.gyrx = gyrx; tlmframe.gyry = gyry; tlmframe.gyrz = gyrz;
+        tlmframe.magx = magx; tlmframe.magy = magy; tlmframe.magz = magz;
+        tlmframe.tilt = tilt; tlmframe.roll = roll; tlmframe.pan = pan;
+        tlmframe.tiltoff = tilt - tiltoffset;
+        tlmframe.rolloff = roll - rolloffset;
+        tlmframe.panoff = normalize(pan - panoffset, -180, 180);
+        memcpy(tlmframe.quat, fusion->getQuat(), sizeof(tlmframe.quat));
+        tlmframe.tiltout = tiltout_ui;
+        tlmframe.rollout = rollout_ui;
+        tlmframe.panout = panout_ui;
+        memcpy(tlmframe.ppmch, ppm_in_chans, sizeof(tlmframe.ppmch));
+        memcpy(tlmframe.sbusch, sbus_in_chans, sizeof(tlmframe.sbusch));
+        memcpy(tlmframe.btch, bt_chans, sizeof(tlmframe.btch));
+        memcpy(tlmframe.chout, channel_data, sizeof(tlmframe.chout));
+        tlmframe.trpenabled = trpOutputEnabled;
+        tlmframe.gyroCal = gyro_calibrated;
+        tlmframe.btcon = BTGetConnected();
+        tlmframe.fusioncyc = MIN(fusioncycles, UINT16_MAX);
+        tlmframe.magdist = magdisturbed;
+        telemetry.publish(tlmframe);
+        BTChannelsUpdated();
 
         // Adjust sleep for a more accurate period
         usduration = micros64() - usduration;
-        if(CALCULATE_PERIOD - usduration < CALCULATE_PERIOD * 0.7) {  // Took a long time. Will crash if sleep is too short
+        uint32_t period = calcperiod;
+        if(period - usduration < period * 0.7) {  // Took a long time. Will crash if sleep is too short
 
-          rt_sleep_us(CALCULATE_PERIOD);
+          rt_sleep_us(period);
         } else {
-          rt_sleep_us(CALCULATE_PERIOD - usduration);
+          rt_sleep_us(period - usduration);
         }
     }
 }
@@ -604,21 +858,26 @@ void sensor_Thread()
     float avg[3] = {0,0,0};
     float lavg[3] = {0,0,0};
     bool initrun = true;
-    int passcount = GYRO_STABLE_SAMPLES;
+    int calodr = 0; // IMU rate the window and filter below were set for
+    int stablesamples = 0;
+    float lpbeta = 0;
+    int passcount = 0;
 
     while(1) {
-        rt_sleep_us(SENSOR_PERIOD);
+        rt_sleep_us(sensorperiod);
 
         if(!senseTreadRun) {
             continue;
         }
 
+        configureIMU();
+
         // Reset Center on Proximity, Don't need to update this often
-        static int sensecount=0;
+        static int64_t lastsense=0;
         static int minproximity=100; // Keeps smallest proximity read.
         static int maxproximity=0; // Keeps largest proximity value read.
-        if(blesenseboard && sensecount++ == 10) {
-            sensecount = 0;
+        if(blesenseboard && millis64() - lastsense >= APDS_PERIOD) {
+            lastsense = millis64();
             if (trkset.resetOnWave()) {
                 // Reset on Proximity
                 if(APDS.proximityAvailable()) {
@@ -657,16 +916,14 @@ void sensor_Thread()
             raccx *= -1.0; // Flip X to make classic cartesian (+X Right, +Y Up, +Z Vert)
             trkset.accOffset(accxoff,accyoff,acczoff);
 
-            k_mutex_lock(&sensor_mutex, K_FOREVER);
-
-            accx = raccx - accxoff;
-            accy = raccy - accyoff;
-            accz = raccz - acczoff;
-
             // Apply Rotation
-            float tmpacc[3] = {accx,accy,accz};
+            float tmpacc[3] = {raccx - accxoff, raccy - accyoff, raccz - acczoff};
             rotate(tmpacc,rotation);
-            accx = tmpacc[0]; accy = tmpacc[1]; accz = tmpacc[2];
+
+            k_mutex_lock(&sensor_mutex, K_FOREVER);
+
+            accsum[0] += tmpacc[0]; accsum[1] += tmpacc[1]; accsum[2] += tmpacc[2];
+            acccnt++;
 
             // For intial orientation setup
             madgsensbits |= MADGINIT_ACCEL;
@@ -680,19 +937,26 @@ void sensor_Thread()
             rgyrx *= -1.0; // Flip X to match other sensors
 
             if(!gyro_calibrated) {
+                if(trkset.imuODR() != calodr) {
+                    calodr = trkset.imuODR();
+                    stablesamples = ceilf(GYRO_STABLE_TIME * calodr);
+                    lpbeta = expf(-1.0f / (GYRO_LP_TAU * calodr));
+                    passcount = stablesamples;
+                }
+
                 if(initrun) { // Preload on first read
                     avg[0] = rgyrx; avg[1] = rgyry; avg[2] = rgyrz;
                     lavg[0] = rgyrx; lavg[1] = rgyry; lavg[2] = rgyrz;
                     initrun = false;
                 } else {
-                    avg[0] = (avg[0] * GYRO_LP_BETA) + (rgyrx * (1.0-GYRO_LP_BETA));
-                    avg[1] = (avg[1] * GYRO_LP_BETA) + (rgyry * (1.0-GYRO_LP_BETA));
-                    avg[2] = (avg[2] * GYRO_LP_BETA) + (rgyrz * (1.0-GYRO_LP_BETA));
+                    avg[0] = (avg[0] * lpbeta) + (rgyrx * (1.0f-lpbeta));
+                    avg[1] = (avg[1] * lpbeta) + (rgyry * (1.0f-lpbeta));
+                    avg[2] = (avg[2] * lpbeta) + (rgyrz * (1.0f-lpbeta));
 
                     // Calculate differential of signal
                     float diff[3];
                     for(int i=0; i < 3; i++) {
-                        diff[i] = fabs(avg[i] - lavg[i]) / (SENSOR_PERIOD/1000000.0);
+                        diff[i] = fabs(avg[i] - lavg[i]) * calodr;
                         lavg[i] = avg[i];
                     }
 
@@ -703,7 +967,7 @@ void sensor_Thread()
                         passcount--;
                     // Otherwise start over
                     else {
-                        passcount = GYRO_STABLE_SAMPLES;
+                        passcount = stablesamples;
                         initrun = true;
                     }
 
@@ -718,16 +982,14 @@ void sensor_Thread()
 
                 trkset.gyroOffset(gyrxoff,gyryoff,gyrzoff);
 
-                k_mutex_lock(&sensor_mutex, K_FOREVER);
-
-                gyrx = rgyrx - gyrxoff;
-                gyry = rgyry - gyryoff;
-                gyrz = rgyrz - gyrzoff;
-
                 // Apply Rotation
-                float tmpgyr[3] = {gyrx,gyry,gyrz};
+                float tmpgyr[3] = {rgyrx - gyrxoff, rgyry - gyryoff, rgyrz - gyrzoff};
                 rotate(tmpgyr,rotation);
-                gyrx = tmpgyr[0]; gyry = tmpgyr[1]; gyrz = tmpgyr[2];
+
+                k_mutex_lock(&sensor_mutex, K_FOREVER);
+
+                gyrsum[0] += tmpgyr[0]; gyrsum[1] += tmpgyr[1]; gyrsum[2] += tmpgyr[2];
+                gyrcnt++;
 
                 k_mutex_unlock(&sensor_mutex);
             }
@@ -760,6 +1022,7 @@ void sensor_Thread()
 
             // For inital orientation setup
             madgsensbits |= MADGINIT_MAG;
+            magnew = true;
 
             k_mutex_unlock(&sensor_mutex);
         }
@@ -818,7 +1081,7 @@ void rotate(float pn[3], const float rotation[3])
 }
 
 /* reset_fusion()
- *      Causes the madgwick filter to reset. Used when board rotation changes
+ *      Causes the fusion filter to reset. Used when board rotation changes
  */
 
 void reset_fusion()
@@ -845,4 +1108,16 @@ void buildAuxData()
     auxdata[TrackerSettings::AUX_ACCELZ] = (accz / 1.0f) * pwmrange + TrackerSettings::PPM_CENTER;
     auxdata[TrackerSettings::AUX_ACCELZO] = ((accz -1.0f) / 2.0f) * pwmrange + TrackerSettings::PPM_CENTER;
     auxdata[TrackerSettings::BT_RSSI] = static_cast<float>(BTGetRSSI()) / 127.0 * pwmrange + TrackerSettings::MIN_PWM;
+
+    // CRSF uplink from the module, minimum when there are no link statistics
+    CrsfLinkStats ls;
+    if(CRSF_LinkStats(ls)) {
+        float rssi = ls.antenna ? ls.uplinkRssi2 : ls.uplinkRssi1; // -dBm
+        rssi = MAX(MIN((CRSF_RSSI_MIN - rssi) / (CRSF_RSSI_MIN - CRSF_RSSI_MAX), 1.0f), 0.0f);
+        auxdata[TrackerSettings::CRSF_RSSI] = rssi * pwmrange + TrackerSettings::MIN_PWM;
+        auxdata[TrackerSettings::CRSF_LQ] = MIN(ls.uplinkLq, 100) / 100.0f * pwmrange + TrackerSettings::MIN_PWM;
+    } else {
+        auxdata[TrackerSettings::CRSF_RSSI] = TrackerSettings::MIN_PWM;
+        auxdata[TrackerSettings::CRSF_LQ] = TrackerSettings::MIN_PWM;
+    }
 }
\ No newline at end of file
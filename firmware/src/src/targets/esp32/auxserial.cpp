@@ -51,7 +51,8 @@ void SerialRX_isr()
 
 }
 
-int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions)
+int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions,
+                   uint32_t framelen, AuxFrameSync sync)
 {
     if(serialopened)
         return SERIAL_ALREADY_OPEN;
@@ -82,7 +83,29 @@ uint32_t AuxSerial_Read(uint8_t *buffer, uint32_t bufsize)
     return serialRxBuf.read(buffer, bufsize);
 }
 
+uint32_t AuxSerial_ReadFrame(uint8_t *frame)
+{
+    return 0;
+}
+
 bool AuxSerial_Available()
 {
     return serialRxBuf.getOccupied() > 0;
-}
\ No newline at end of file
+}
+
+uint32_t AuxSerial_TXPending()
+{
+    return serialTxBuf.getOccupied();
+}
+
+// No hardware timed output on this target
+int AuxSerial_TimedTXStart(const uint8_t *frame, uint32_t len, uint32_t periodus)
+{
+    return SERIAL_ERROR;
+}
+
+void AuxSerial_TimedTXStop() {}
+void AuxSerial_TimedTXPeriod(uint32_t periodus) {}
+void AuxSerial_TimedTXFrame(const uint8_t *frame) {}
+bool AuxSerial_TimedTXStarted() {return false;}
+bool AuxSerial_TimedTXActive() {return false;}
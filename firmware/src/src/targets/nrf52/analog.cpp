@@ -1,112 +1,199 @@
 #include <zephyr.h>
-#include "analog.h"
-#include <drivers/adc.h>
+#include <sys/util.h>
+#include <sys/atomic.h>
 #include <string.h>
-#include "serial.h"
+#include <nrfx_ppi.h>
+#include "analog.h"
+#include "defines.h"
+#include "log.h"
 
-// Simple analog input method
-// this just reads a sample then waits then returns it
+// Analog input scanner
+//
+// All requested channels are converted together in one SAADC scan, the
+// results written by EasyDMA. RTC2 ticks trigger each scan through PPI and
+// the END event restarts the SAADC on the other half of a double buffer, so
+// the CPU is only involved for a short ISR per scan.
+// analogRead() just returns the newest completed result.
+//
+// Each channel is sampled 2^ANALOG_OVERSAMPLE times back to back (BURST) and
+// averaged in hardware. Oversampling in scan mode needs BURST on every channel.
+//
+// A channel is added to the scan the first time it's read, the scan is
+// stopped and restarted with the new channel list.
+//
+// The two PPI channels come from the nrfx allocator, which already leaves out
+// the ones the Bluetooth controller uses.
 
 // ADC Sampling Settings
 // doc says that impedance of 800K == 40usec sample time
 
-#define ADC_DEVICE_NAME		DT_LABEL(DT_ALIAS(adcctrl))
-#define ADC_RESOLUTION		10
-#define ADC_GAIN			ADC_GAIN_1_6
-#define ADC_REFERENCE		ADC_REF_INTERNAL
-#define ADC_ACQUISITION_TIME	ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 40)
-#define BUFFER_SIZE			6
-
-static bool _IsInitialized = false;
-static uint8_t _LastChannel = 250;
-static int16_t m_sample_buffer[BUFFER_SIZE];
-
-// the channel configuration with channel not yet filled in
-static struct adc_channel_cfg m_1st_channel_cfg = {
-	.gain             = ADC_GAIN,
-	.reference        = ADC_REFERENCE,
-	.acquisition_time = ADC_ACQUISITION_TIME,
-	.channel_id       = 0, // gets set during init
-	.differential	  = 0,
-#if CONFIG_ADC_CONFIGURABLE_INPUTS
-	.input_positive   = 0, // gets set during init
-#endif
-};
-
-// initialize the adc channel
-static const struct device* init_adc(int channel)
+#define ANALOG_CHANNELS	8 // AIN0-AIN7
+
+#define ANALOG_RTC CONCAT(NRF_RTC, ANALOG_RTC_CH)
+
+// RTC runs from the 32.768khz LFCLK
+#define ANALOG_RTC_PRESCALER ((32768 / ANALOG_SAMPLE_RATE) - 1)
+
+static volatile int16_t scanbuf[2][ANALOG_CHANNELS];
+static volatile int nextbuf=0;    // Buffer the SAADC will latch on the next START
+static volatile int fillingbuf=0; // Buffer the SAADC is writing
+static atomic_t latestbuf = ATOMIC_INIT(-1); // Last completed buffer, -1 = none yet
+static atomic_t scancount = ATOMIC_INIT(0);
+
+static uint8_t scanmask=0;   // AIN channels in the scan
+static nrf_ppi_channel_t ppisample;  // RTC tick -> SAMPLE
+static nrf_ppi_channel_t ppirestart; // END -> START
+static bool ppiallocated=false;
+static int scanindex[ANALOG_CHANNELS]; // Channel to position in the results
+
+static void saadc_isr(void *)
 {
-	int ret;
-	const struct device *adc_dev = device_get_binding(ADC_DEVICE_NAME);
-	if(_LastChannel != channel)
-	{
-		_IsInitialized = false;
-		_LastChannel = channel;
+	// END before STARTED, both can be pending if the ISR was held off
+	if(NRF_SAADC->EVENTS_END) {
+		NRF_SAADC->EVENTS_END = 0;
+		atomic_set(&latestbuf, fillingbuf);
+		atomic_inc(&scancount);
 	}
 
-	if ( adc_dev != NULL && !_IsInitialized)
-	{
-		// strangely channel_id gets the channel id and input_positive gets id+1
-		m_1st_channel_cfg.channel_id = channel;
-#if CONFIG_ADC_CONFIGURABLE_INPUTS
-        m_1st_channel_cfg.input_positive = channel+1;
-#endif
+	// The buffer pointer is double buffered, once started the next can be set
+	if(NRF_SAADC->EVENTS_STARTED) {
+		NRF_SAADC->EVENTS_STARTED = 0;
+		fillingbuf = nextbuf;
+		nextbuf ^= 1;
+		NRF_SAADC->RESULT.PTR = (uint32_t)scanbuf[nextbuf];
+	}
+}
 
-		ret = adc_channel_setup(adc_dev, &m_1st_channel_cfg);
+static void stopScan()
+{
+	if(ppiallocated) {
+		nrfx_ppi_channel_disable(ppisample);
+		nrfx_ppi_channel_disable(ppirestart);
+	}
+	ANALOG_RTC->TASKS_STOP = 1;
 
-		if(ret != 0)
-		{
-			adc_dev = NULL;
-		}
-		else
-		{
-			_IsInitialized = true;	// we don't have any other analog users
-		}
+	if(NRF_SAADC->ENABLE) {
+		NRF_SAADC->EVENTS_STOPPED = 0;
+		NRF_SAADC->TASKS_STOP = 1;
+		for(int i=0; i < 100 && !NRF_SAADC->EVENTS_STOPPED; i++)
+			k_busy_wait(10);
+		NRF_SAADC->EVENTS_STOPPED = 0;
 	}
+	NRF_SAADC->INTENCLR = 0xFFFFFFFF;
+	NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos;
+	atomic_set(&latestbuf, -1);
+}
 
-	memset(m_sample_buffer, 0, sizeof(m_sample_buffer));
-	return adc_dev;
+// Takes the two channels once, they're kept for good after
+static bool allocPPI()
+{
+	if(ppiallocated)
+		return true;
+	if(nrfx_ppi_channel_alloc(&ppisample) != NRFX_SUCCESS)
+		return false;
+	if(nrfx_ppi_channel_alloc(&ppirestart) != NRFX_SUCCESS) {
+		nrfx_ppi_channel_free(ppisample);
+		return false;
+	}
+	ppiallocated = true;
+	return true;
 }
 
-// ------------------------------------------------
-// read one channel of adc
-// ------------------------------------------------
-static int16_t readOneChannel(int channel)
+static void startScan()
 {
-	const struct adc_sequence sequence = {
-		.options     = NULL,				// extra samples and callback
-		.channels    = BIT(channel),		// bit mask of channels to read
-		.buffer      = m_sample_buffer,		// where to put samples read
-		.buffer_size = sizeof(m_sample_buffer),
-		.resolution  = ADC_RESOLUTION,		// desired resolution
-		.oversampling = 0,					// don't oversample
-		.calibrate = 0						// don't calibrate
-	};
-
-	int ret;
-	int16_t sample_value = BAD_ANALOG_READ;
-	const struct device *adc_dev = init_adc(channel);
-	if (adc_dev)
-	{
-		ret = adc_read(adc_dev, &sequence);
-		if(ret == 0)
-		{
-			sample_value = m_sample_buffer[0];
+	static bool irqinit=false;
+	if(!irqinit) {
+		IRQ_CONNECT(SAADC_IRQn, 4, saadc_isr, NULL, 0);
+		irq_enable(SAADC_IRQn);
+		irqinit = true;
+	}
+
+	if(!allocPPI()) {
+		LOGE("Analog, no free PPI channels");
+		return;
+	}
+
+	// Channels, results are stored in CH[n] order
+	int count=0;
+	for(int i=0; i < ANALOG_CHANNELS; i++) {
+		if(scanmask & (1 << i)) {
+			NRF_SAADC->CH[i].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+			                          (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+			                          (SAADC_CH_CONFIG_TACQ_40us << SAADC_CH_CONFIG_TACQ_Pos) |
+			                          (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos) |
+			                          (SAADC_CH_CONFIG_BURST_Enabled << SAADC_CH_CONFIG_BURST_Pos);
+			NRF_SAADC->CH[i].PSELP = i + 1; // AIN0 = 1
+			NRF_SAADC->CH[i].PSELN = SAADC_CH_PSELN_PSELN_NC;
+			scanindex[i] = count++;
+		} else {
+			NRF_SAADC->CH[i].PSELP = SAADC_CH_PSELP_PSELP_NC;
+			scanindex[i] = -1;
 		}
 	}
+	if(count == 0)
+		return;
+
+	NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_10bit;
+	NRF_SAADC->OVERSAMPLE = ANALOG_OVERSAMPLE;
+	NRF_SAADC->SAMPLERATE = SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos;
+	NRF_SAADC->RESULT.MAXCNT = count;
+	NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos;
+
+	// Offset calibration, takes a few hundred us
+	NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
+	NRF_SAADC->TASKS_CALIBRATEOFFSET = 1;
+	for(int i=0; i < 100 && !NRF_SAADC->EVENTS_CALIBRATEDONE; i++)
+		k_busy_wait(10);
+	NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
 
-	return sample_value;
+	// RTC tick -> SAMPLE, every sample task converts all channels (BURST)
+	ANALOG_RTC->TASKS_STOP = 1;
+	ANALOG_RTC->TASKS_CLEAR = 1;
+	ANALOG_RTC->PRESCALER = ANALOG_RTC_PRESCALER;
+	ANALOG_RTC->EVTENSET = RTC_EVTENSET_TICK_Msk;
+	nrfx_ppi_channel_assign(ppisample, (uint32_t)&ANALOG_RTC->EVENTS_TICK,
+	                        (uint32_t)&NRF_SAADC->TASKS_SAMPLE);
+
+	// END -> START, latches the next buffer without waiting on the ISR
+	nrfx_ppi_channel_assign(ppirestart, (uint32_t)&NRF_SAADC->EVENTS_END,
+	                        (uint32_t)&NRF_SAADC->TASKS_START);
+
+	nextbuf = 0;
+	NRF_SAADC->RESULT.PTR = (uint32_t)scanbuf[nextbuf];
+	NRF_SAADC->EVENTS_STARTED = 0;
+	NRF_SAADC->EVENTS_END = 0;
+	NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+	NRF_SAADC->TASKS_START = 1;
+
+	nrfx_ppi_channel_enable(ppisample);
+	nrfx_ppi_channel_enable(ppirestart);
+	ANALOG_RTC->TASKS_START = 1;
 }
 
 // ------------------------------------------------
-// high level read adc channel and convert to float voltage
+// Newest scan result of a channel as a voltage
 // ------------------------------------------------
 float analogRead(int channel)
 {
-	int16_t sv = readOneChannel(channel);
-	if(sv == BAD_ANALOG_READ)
-	{
-		return sv;
+	if(channel < 0 || channel >= ANALOG_CHANNELS)
+		return BAD_ANALOG_READ;
+
+	// New channel, rescan and wait for the first result
+	if(!(scanmask & (1 << channel))) {
+		stopScan();
+		scanmask |= 1 << channel;
+		atomic_val_t startcount = atomic_get(&scancount);
+		startScan();
+		for(int i=0; i < 20 && atomic_get(&scancount) - startcount < 1; i++)
+			k_msleep(1);
+		LOGD("Analog scan mask 0x%.2x", scanmask);
 	}
-    return (float)sv / 287.0;
-}
\ No newline at end of file
+
+	int buf = atomic_get(&latestbuf);
+	if(buf < 0)
+		return BAD_ANALOG_READ;
+
+	// The SAADC won't write this buffer again for another whole scan period
+	int16_t sv = scanbuf[buf][scanindex[channel]];
+	return (float)sv / 287.0;
+}
@@ -29,9 +29,14 @@ static bool serialopened=false;
 #define SERIALIN2_PPICH_MSK CONCAT(CONCAT(PPI_CHENSET_CH, SERIALIN2_PPICH), _Msk )
 #define SERIALOUT_PPICH_MSK CONCAT(CONCAT(PPI_CHENSET_CH, SERIALOUT_PPICH), _Msk )
 
+#define SBUSOUT_TIMER CONCAT(NRF_TIMER, SBUSOUT_TIMER_CH)
+
 #define SERIAL_UARTE CONCAT(NRF_UARTE, SERIAL_UARTE_CH)
 #define SERIAL_UARTE_IRQ CONCAT(CONCAT(UARTE, SERIAL_UARTE_CH),_IRQn)
 
+// Same peripheral as UART0, used instead of it when receiving fixed length frames
+#define SERIAL_RX_UARTE NRF_UARTE0
+
 // Temp Pin, They are not broken out on the NANO33BLE
 #define SERIALOUT_TPIN  4
 #define SERIALOUT_TPORT 1
@@ -44,6 +49,13 @@ static bool serialopened=false;
 
 static uint8_t serialDMATx[SERIAL_TX_SIZE]; // DMA Access Buffer Write
 
+// Frame receive, the UARTE fills one buffer while the other waits to be next
+static uint8_t serialDMARx[2][SERIAL_RX_FRAME_MAX];
+static uint32_t rxframelen=0; // 0 = byte at a time on UART0
+static AuxFrameSync rxsync=nullptr;
+static int rxdone=0; // Buffer the next ENDRX completes
+static bool rxrealign=false; // The running buffer is known to be off
+
 // In/Out Buffers
 ringbuffer<uint8_t> serialRxBuf(SERIAL_RX_SIZE);
 ringbuffer<uint8_t> serialTxBuf(SERIAL_TX_SIZE);
@@ -51,10 +63,19 @@ ringbuffer<uint8_t> serialTxBuf(SERIAL_TX_SIZE);
 static bool invertTX=false;
 static bool invertRX=false;
 
+// Timed output, timer compare -> STARTTX. Allocated on first use and kept
+static nrf_ppi_channel_t sbusoutppi;
+static bool sbusoutppiallocated=false;
+
 volatile bool isTransmitting=false;
+volatile bool timedTX=false;
 
 void Serial_Start_TX(bool disableint=true)
 {
+    // The timer owns STARTTX and TXD.PTR while timed output is on
+    if(timedTX)
+        return;
+
     size_t len = MIN(serialTxBuf.getOccupied(), sizeof(serialDMATx));
     if(len == 0)
         return;
@@ -105,20 +126,66 @@ void SerialTX_isr()
     }
 }
 
+static void SerialRX_frame()
+{
+    if(SERIAL_RX_UARTE->EVENTS_ERROR) {
+        SERIAL_RX_UARTE->EVENTS_ERROR = 0;
+        SERIAL_RX_UARTE->ERRORSRC = SERIAL_RX_UARTE->ERRORSRC; // Bytes still land, sync catches bad frames
+    }
+
+    if(!SERIAL_RX_UARTE->EVENTS_ENDRX)
+        return;
+    SERIAL_RX_UARTE->EVENTS_ENDRX = 0;
+
+    // The ENDRX_STARTRX short has already started the other buffer. This one
+    // is free again once it's copied and becomes the one after that.
+    uint8_t *buf = serialDMARx[rxdone];
+    uint32_t amount = SERIAL_RX_UARTE->RXD.AMOUNT;
+    uint32_t next = rxframelen;
+
+    if(rxrealign) {
+        // Received with the old alignment, the short one after it fixes that
+        rxrealign = false;
+    } else if(amount == rxframelen) {
+        int offset = rxsync(buf, amount);
+        if(offset == 0) {
+            if(serialRxBuf.getFree() >= amount)
+                serialRxBuf.write(buf, amount);
+        } else if(offset > 0) {
+            // A frame starts offset bytes in, receiving only that many
+            // puts everything after it back on a boundary
+            next = offset;
+            rxrealign = true;
+        }
+    }
+
+    SERIAL_RX_UARTE->RXD.PTR = (uint32_t)buf;
+    SERIAL_RX_UARTE->RXD.MAXCNT = next;
+    rxdone ^= 1;
+}
+
 void SerialRX_isr()
 {
     ISR_DIRECT_HEADER();
-    NRF_UART0->EVENTS_RXDRDY = 0;
-    uint8_t rxv = (uint8_t)NRF_UART0->RXD;
-    serialRxBuf.write(&rxv,1);
+    if(rxframelen) {
+        SerialRX_frame();
+    } else {
+        NRF_UART0->EVENTS_RXDRDY = 0;
+        uint8_t rxv = (uint8_t)NRF_UART0->RXD;
+        serialRxBuf.write(&rxv,1);
+    }
     ISR_DIRECT_FOOTER(1);
 }
 
-int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions)
+int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions,
+                   uint32_t framelen, AuxFrameSync sync)
 {
     if(serialopened)
         return SERIAL_ALREADY_OPEN;
 
+    if(framelen > SERIAL_RX_FRAME_MAX || (framelen && sync == nullptr))
+        return SERIAL_ERROR;
+
     AuxSerial_Close(); // Put the periferial in a good off state
 
     // Set inversion from flags
@@ -240,7 +307,8 @@ int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions)
 
     // Enable TX Pin, no flow control
 
-    // Use UART for receive... Gave up on the UARTE RX DMA method.. maybe will re-visit one day. Would be less interrupts, but the ISR is pretty simple.
+    // Fixed length frames are received with EasyDMA on UARTE0, one interrupt
+    // per frame. Anything else uses UART0 a byte at a time.
 
     // Enable the interrupt vector in IRQ Controller
     IRQ_CONNECT(SERIAL_UARTE_IRQ, 2, SerialTX_isr, NULL, 0);
@@ -254,10 +322,30 @@ int AuxSerial_Open(uint32_t baudrate, uint16_t prtset, uint8_t inversions)
     //IRQ_CONNECT(UART0_IRQn, 0, SBUSRX_Interrupt, NULL, 0);
     irq_enable(UART0_IRQn);
 
-    // Enable UART Interrupt and UART
-    NRF_UART0->INTENSET = UART_INTENSET_RXDRDY_Msk;
-    NRF_UART0->ENABLE = UART_ENABLE_ENABLE_Enabled << UART_ENABLE_ENABLE_Pos;
-    NRF_UART0->TASKS_STARTRX = 1;
+    rxframelen = framelen;
+    rxsync = sync;
+    if(rxframelen) {
+        rxdone = 0;
+        rxrealign = false;
+        SERIAL_RX_UARTE->RXD.PTR = (uint32_t)serialDMARx[0];
+        SERIAL_RX_UARTE->RXD.MAXCNT = rxframelen;
+        SERIAL_RX_UARTE->SHORTS = UARTE_SHORTS_ENDRX_STARTRX_Msk;
+        SERIAL_RX_UARTE->ERRORSRC = 0x0F;
+        SERIAL_RX_UARTE->EVENTS_RXSTARTED = 0;
+        SERIAL_RX_UARTE->ENABLE = UARTE_ENABLE_ENABLE_Enabled << UARTE_ENABLE_ENABLE_Pos;
+        SERIAL_RX_UARTE->TASKS_STARTRX = 1;
+
+        // PTR and MAXCNT are latched on start, the second buffer can go in now
+        while(!SERIAL_RX_UARTE->EVENTS_RXSTARTED);
+        SERIAL_RX_UARTE->EVENTS_RXSTARTED = 0;
+        SERIAL_RX_UARTE->RXD.PTR = (uint32_t)serialDMARx[1];
+        SERIAL_RX_UARTE->INTENSET = UARTE_INTENSET_ENDRX_Msk | UARTE_INTENSET_ERROR_Msk;
+    } else {
+        // Enable UART Interrupt and UART
+        NRF_UART0->INTENSET = UART_INTENSET_RXDRDY_Msk;
+        NRF_UART0->ENABLE = UART_ENABLE_ENABLE_Enabled << UART_ENABLE_ENABLE_Pos;
+        NRF_UART0->TASKS_STARTRX = 1;
+    }
 
     // Start Receiving
     //SBUS_UARTE->ERRORSRC = 0x0F; // Clear any errors
@@ -320,9 +408,25 @@ void AuxSerial_Close()
 
     // Disable PPI's
     NRF_PPI->CHENCLR = SERIALIN1_PPICH_MSK | SERIALIN2_PPICH_MSK | SERIALOUT_PPICH_MSK;
+    if(sbusoutppiallocated)
+        nrfx_ppi_channel_disable(sbusoutppi);
+
+    // Stop timed output
+    SBUSOUT_TIMER->TASKS_STOP = 1;
+    SBUSOUT_TIMER->SHORTS = 0;
+    timedTX = false;
 
-    // Disable UART
+    // Disable UART, stops the UARTE0 frame receive too. Without the short
+    // the stop can't restart it.
+    NRF_UART0->SHORTS = 0;
     NRF_UART0->TASKS_STOPRX = 1;
+    if(rxframelen) {
+        for(int i=0; i < 1000 && !SERIAL_RX_UARTE->EVENTS_RXTO; i++)
+            k_busy_wait(1);
+        SERIAL_RX_UARTE->EVENTS_RXTO = 0;
+        SERIAL_RX_UARTE->EVENTS_ENDRX = 0;
+        rxframelen = 0;
+    }
     NRF_UART0->TASKS_STOPTX = 1;
     NRF_UART0->ENABLE = 0;
     NRF_UART0->CONFIG = 0;
@@ -356,6 +460,8 @@ void AuxSerial_Close()
 
 uint32_t AuxSerial_Write(uint8_t *buffer, uint32_t len)
 {
+    if(timedTX)
+        return SERIAL_ERROR;
     if(serialTxBuf.getFree() < len)
         return SERIAL_BUFFER_FULL;
     serialTxBuf.write(buffer,len);
@@ -368,7 +474,112 @@ uint32_t AuxSerial_Read(uint8_t *buffer, uint32_t bufsize)
     return serialRxBuf.read(buffer, bufsize);
 }
 
+uint32_t AuxSerial_ReadFrame(uint8_t *frame)
+{
+    // Only whole frames are written in frame mode
+    if(rxframelen == 0 || serialRxBuf.getOccupied() < rxframelen)
+        return 0;
+    return serialRxBuf.read(frame, rxframelen);
+}
+
 bool AuxSerial_Available()
 {
     return serialRxBuf.getOccupied() > 0;
-}
\ No newline at end of file
+}
+
+uint32_t AuxSerial_TXPending()
+{
+    return serialTxBuf.getOccupied();
+}
+
+/* Hardware timed output
+ *   A timer compare triggers STARTTX through PPI every period, sending len
+ * bytes from wherever TXD.PTR points. TXD.PTR is latched on STARTTX so it can
+ * be moved to a new frame at any time without the CPU being involved in the
+ * sending.
+ */
+
+int AuxSerial_TimedTXStart(const uint8_t *frame, uint32_t len, uint32_t periodus)
+{
+    if(!serialopened)
+        return SERIAL_ERROR;
+
+    if(!sbusoutppiallocated) {
+        if(nrfx_ppi_channel_alloc(&sbusoutppi) != NRFX_SUCCESS)
+            return SERIAL_ERROR;
+        sbusoutppiallocated = true;
+    }
+
+    irq_disable(SERIAL_UARTE_IRQ);
+    timedTX = true;
+    irq_enable(SERIAL_UARTE_IRQ);
+
+    SBUSOUT_TIMER->TASKS_STOP = 1;
+    SBUSOUT_TIMER->PRESCALER = 4; // 16Mhz/2^(4) = 1Mhz = 1us Resolution
+    SBUSOUT_TIMER->MODE = TIMER_MODE_MODE_Timer << TIMER_MODE_MODE_Pos;
+    SBUSOUT_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit << TIMER_BITMODE_BITMODE_Pos;
+    SBUSOUT_TIMER->CC[SBUSOUT_TMRCOMP_CH] = periodus;
+    SBUSOUT_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk << SBUSOUT_TMRCOMP_CH;
+    SBUSOUT_TIMER->INTENCLR = 0xFFFFFFFF;
+    SBUSOUT_TIMER->EVENTS_COMPARE[SBUSOUT_TMRCOMP_CH] = 0;
+
+    // Anything already going out finishes first, PTR is only used at the next STARTTX
+    SERIAL_UARTE->TXD.PTR = (uint32_t)frame;
+    SERIAL_UARTE->TXD.MAXCNT = len;
+
+    nrfx_ppi_channel_assign(sbusoutppi, (uint32_t)&SBUSOUT_TIMER->EVENTS_COMPARE[SBUSOUT_TMRCOMP_CH],
+                            (uint32_t)&SERIAL_UARTE->TASKS_STARTTX);
+    nrfx_ppi_channel_enable(sbusoutppi);
+
+    SBUSOUT_TIMER->TASKS_CLEAR = 1;
+    SBUSOUT_TIMER->TASKS_START = 1;
+    return SERIAL_OK;
+}
+
+void AuxSerial_TimedTXStop()
+{
+    if(!timedTX)
+        return;
+
+    nrfx_ppi_channel_disable(sbusoutppi);
+    SBUSOUT_TIMER->TASKS_STOP = 1;
+    SBUSOUT_TIMER->SHORTS = 0;
+
+    // Back to the ring buffer
+    unsigned int key = irq_lock();
+    SERIAL_UARTE->TXD.PTR = (uint32_t)serialDMATx;
+    timedTX = false;
+    irq_unlock(key);
+}
+
+void AuxSerial_TimedTXPeriod(uint32_t periodus)
+{
+    if(SBUSOUT_TIMER->CC[SBUSOUT_TMRCOMP_CH] == periodus)
+        return;
+
+    // Restart the count, it may already be past a shorter period
+    SBUSOUT_TIMER->CC[SBUSOUT_TMRCOMP_CH] = periodus;
+    SBUSOUT_TIMER->TASKS_CLEAR = 1;
+}
+
+void AuxSerial_TimedTXFrame(const uint8_t *frame)
+{
+    // Don't move the pointer once it belongs to the ring buffer again
+    unsigned int key = irq_lock();
+    if(timedTX)
+        SERIAL_UARTE->TXD.PTR = (uint32_t)frame;
+    irq_unlock(key);
+}
+
+bool AuxSerial_TimedTXStarted()
+{
+    if(!SBUSOUT_TIMER->EVENTS_COMPARE[SBUSOUT_TMRCOMP_CH])
+        return false;
+    SBUSOUT_TIMER->EVENTS_COMPARE[SBUSOUT_TMRCOMP_CH] = 0;
+    return true;
+}
+
+bool AuxSerial_TimedTXActive()
+{
+    return timedTX;
+}
@@ -16,14 +16,18 @@
  */
 
 #include <zephyr.h>
+#include <math.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/conn.h>
 #include <bluetooth/uuid.h>
+#include <bluetooth/hci.h>
+#include <sys/byteorder.h>
 
 #include "log.h"
 #include "io.h"
 #include "nano33ble.h"
 #include "ble.h"
+#include "telemetry.h"
 
 // Globals
 volatile bool bleconnected=false;
@@ -41,6 +45,9 @@ struct bt_uuid_16 jsonuuid = BT_UUID_INIT_16(0xAFF3);
 // Switching modes, don't execute
 volatile bool btThreadRun = false;
 
+// Given by the calculate thread when it has new channel data
+K_SEM_DEFINE(btchansem, 0, 1);
+
 void bt_init()
 {
     int err = bt_enable(NULL);
@@ -56,6 +63,9 @@ void bt_init()
 void bt_Thread()
 {
   int64_t usduration=0;
+  uint32_t tlmseq=0;
+  static TelemetryFrame tlmframe;
+
   while(1) {
     usduration = micros64();
 
@@ -64,6 +74,12 @@ void bt_Thread()
       continue;
     }
 
+    // Pick up the newest channel data from the calculate thread, send the zeros don't center
+    if(telemetry.readLatest(tlmframe, tlmseq) >= 0) {
+      for(int i=0;i < BT_CHANNELS;i++)
+        BTSetChannel(i,tlmframe.chout[i]);
+    }
+
     switch(curmode) {
     case BTPARAHEAD:
       BTHeadExecute();
@@ -77,11 +93,20 @@ void bt_Thread()
       break;
     }
 
+    BTPhyExecute();
+
     if(bleconnected)
       setLEDFlag(LED_BTCONNECTED);
     else
       clearLEDFlag(LED_BTCONNECTED);
 
+    // Head mode sends as soon as new channels are ready, BT_PERIOD is
+    // only a backup if the calculate thread stops
+    if(curmode == BTPARAHEAD) {
+      k_sem_take(&btchansem, K_USEC(BT_PERIOD));
+      continue;
+    }
+
     // Adjust sleep for a more accurate period
     usduration = micros64() - usduration;
     if(BT_PERIOD - usduration < BT_PERIOD * 0.7) {  // Took a long time. Will crash if sleep is too short
@@ -92,6 +117,12 @@ void bt_Thread()
   }
 }
 
+// Called from the calculate thread after each new telemetry frame
+void BTChannelsUpdated()
+{
+  k_sem_give(&btchansem);
+}
+
 void BTSetMode(btmodet mode)
 {
     // Requested same mode, just return
@@ -209,6 +240,66 @@ int8_t BTGetRSSI()
     return -1;
 }
 
+// (us) Filtered time a trainer notify waited for a connection event
+uint16_t BTGetNotifyLatency()
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadGetNotifyLatency();
+    return 0;
+}
+
+// Most trainer notifies waiting to be sent since the last call
+uint8_t BTGetNotifyQueue()
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadGetNotifyQueue();
+    return 0;
+}
+
+// Config replies and live data to the GUI over BLE, head only. Returns bytes queued
+int BTJSONWrite(const char *data, int len)
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadJSONWrite(data, len);
+    return 0;
+}
+
+// Commands from the GUI over BLE, head only. Returns bytes read
+int BTJSONRead(char *data, int len)
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadJSONRead(data, len);
+    return 0;
+}
+
+// Bytes free for BTJSONWrite
+int BTJSONSpace()
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadJSONSpace();
+    return 0;
+}
+
+// Per peer notify rate and latency, head only. Returns peers connected
+uint8_t BTGetPeerStats(uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS])
+{
+    if(curmode == BTPARAHEAD)
+        return BTHeadGetPeerStats(rate, latency);
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        rate[i] = 0;
+        latency[i] = 0;
+    }
+    return 0;
+}
+
+// (ms) Last disconnect until channel data flowed again, remote only
+uint16_t BTGetReconnectTime()
+{
+    if(curmode == BTPARARMT)
+        return BTRmtGetReconnectTime();
+    return 0;
+}
+
 bool leparamrequested(struct bt_conn *conn, struct bt_le_conn_param *param)
 {
   LOGI("Bluetooth Params Request. IntMax:%d IntMin:%d Lat:%d Timeout:%d",
@@ -247,7 +338,282 @@ const char *printPhy(int phy)
   return "Unknown";
 }
 
+//----------------------------------------------------------------------
+// PHY Policy
+//----------------------------------------------------------------------
+
+/* Every connection runs it's own policy, a gimbal controller on the far
+ * side of the body can need Coded while the radio stays on 2M. The links
+ * are registered here so the PHY updated callback and the GUI stats can
+ * find them.
+ */
+
+static btphy *phylinks[BT_MAX_PEERS];
+K_MUTEX_DEFINE(phy_mutex);
+
+static const struct bt_conn_le_phy_param phy2m = {
+  .options = BT_CONN_LE_PHY_OPT_NONE,
+  .pref_tx_phy = BT_GAP_LE_PHY_2M,
+  .pref_rx_phy = BT_GAP_LE_PHY_2M,
+};
+
+static const struct bt_conn_le_phy_param phycoded = {
+  .options = BT_CONN_LE_PHY_OPT_CODED_S8,
+  .pref_tx_phy = BT_GAP_LE_PHY_CODED,
+  .pref_rx_phy = BT_GAP_LE_PHY_CODED,
+};
+
+static int phyStatIndex(uint8_t phy)
+{
+  switch(phy) {
+  case BT_GAP_LE_PHY_2M:
+    return BT_PHY_STAT_2M;
+  case BT_GAP_LE_PHY_CODED:
+    return BT_PHY_STAT_CODED;
+  default:
+    return BT_PHY_STAT_1M;
+  }
+}
+
+static void requestPhy(btphy &phy, struct bt_conn *conn, uint8_t want)
+{
+  phy.wantphy = want;
+  phy.bad = 0;
+  phy.good = 0;
+  int err = bt_conn_le_phy_update(conn, want == BT_GAP_LE_PHY_CODED ? &phycoded : &phy2m);
+  LOGI("Requesting %s PHY - %s", printPhy(want), err ? "FAILED" : "Success");
+}
+
+// HCI Read RSSI of the connection, the host has no API for it
+static int readRSSI(struct bt_conn *conn, int8_t &rssi)
+{
+  uint16_t handle;
+  if(bt_hci_get_conn_handle(conn, &handle))
+    return -EINVAL;
+
+  struct net_buf *buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(struct bt_hci_cp_read_rssi));
+  if(!buf)
+    return -ENOBUFS;
+
+  struct bt_hci_cp_read_rssi *cp = (struct bt_hci_cp_read_rssi *)net_buf_add(buf, sizeof(*cp));
+  cp->handle = sys_cpu_to_le16(handle);
+
+  struct net_buf *rsp = NULL;
+  int err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+  if(err)
+    return err;
+
+  struct bt_hci_rp_read_rssi *rp = (struct bt_hci_rp_read_rssi *)rsp->data;
+  err = rp->status ? -EIO : 0;
+  rssi = rp->rssi;
+  net_buf_unref(rsp);
+  return err;
+}
+
+void BTPhyConnected(btphy &phy, struct bt_conn *conn)
+{
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  if(phy.conn)
+    bt_conn_unref(phy.conn);
+  phy.conn = bt_conn_ref(conn);
+
+  struct bt_conn_info info;
+  bt_conn_get_info(conn, &info);
+  phy.curphy = info.le.phy->tx_phy;
+  phy.interval = info.le.interval * 1250;
+
+  for(int i=0; i < BT_PHY_STAT_CNT; i++) {
+    phy.packets[i] = 0;
+    phy.late[i] = 0;
+  }
+  phy.winpackets = 0;
+  phy.winlate = 0;
+  phy.rssivalid = false;
+  phy.next = millis64() + BT_PHY_PERIOD;
+
+  bool listed = false;
+  for(int i=0; i < BT_MAX_PEERS; i++)
+    listed |= phylinks[i] == &phy;
+  for(int i=0; i < BT_MAX_PEERS && !listed; i++) {
+    if(phylinks[i] == NULL) {
+      phylinks[i] = &phy;
+      listed = true;
+    }
+  }
+  k_mutex_unlock(&phy_mutex);
+
+  requestPhy(phy, conn, BT_GAP_LE_PHY_2M);
+}
+
+void BTPhyDisconnected(btphy &phy)
+{
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  for(int i=0; i < BT_MAX_PEERS; i++) {
+    if(phylinks[i] == &phy)
+      phylinks[i] = NULL;
+  }
+  if(phy.conn)
+    bt_conn_unref(phy.conn);
+  phy.conn = NULL;
+  phy.curphy = BT_GAP_LE_PHY_NONE;
+  phy.rssivalid = false;
+  k_mutex_unlock(&phy_mutex);
+}
+
+/* Count a packet on the link's current PHY. Late means it needed more than
+ * one connection event, e.g. it was retransmitted.
+ */
+
+void BTPhyPacket(btphy &phy, bool late)
+{
+  int i = phyStatIndex(phy.curphy);
+  if(phy.packets[i] < UINT16_MAX)
+    phy.packets[i]++;
+  phy.winpackets++;
+  if(late) {
+    if(phy.late[i] < UINT16_MAX)
+      phy.late[i]++;
+    phy.winlate++;
+  }
+}
+
+/* Runs every BT_PHY_PERIOD. Low RSSI or a lot of late packets for a couple
+ * periods moves to Coded S8. It has to be good for much longer, with a
+ * higher RSSI, before going back to 2M.
+ */
+
+static void phyPolicy(btphy &phy, struct bt_conn *conn)
+{
+  struct bt_conn_info info;
+  if(bt_conn_get_info(conn, &info) == 0)
+    phy.interval = info.le.interval * 1250;
+
+  int8_t rssi;
+  if(readRSSI(conn, rssi) == 0 && rssi != BT_HCI_LE_RSSI_NOT_AVAILABLE) {
+    if(!phy.rssivalid)
+      phy.rssi = rssi;
+    phy.rssi += BT_PHY_RSSI_LP * (rssi - phy.rssi);
+    phy.rssivalid = true;
+  }
+
+  float latefrac = phy.winpackets > 0 ? (float)phy.winlate / phy.winpackets : 0;
+  phy.winpackets = 0;
+  phy.winlate = 0;
+
+  if(!phy.rssivalid)
+    return;
+
+  if(phy.wantphy == BT_GAP_LE_PHY_2M) {
+    if(phy.rssi < BT_PHY_RSSI_CODED || latefrac > BT_PHY_LATE_CODED)
+      phy.bad++;
+    else
+      phy.bad = 0;
+    if(phy.bad >= BT_PHY_BAD_PERIODS)
+      requestPhy(phy, conn, BT_GAP_LE_PHY_CODED);
+  } else {
+    if(phy.rssi > BT_PHY_RSSI_2M && latefrac < BT_PHY_LATE_2M)
+      phy.good++;
+    else
+      phy.good = 0;
+    if(phy.good >= BT_PHY_GOOD_PERIODS)
+      requestPhy(phy, conn, BT_GAP_LE_PHY_2M);
+  }
+}
+
+// Runs the policy of each link that's due, from the BT thread
+void BTPhyExecute()
+{
+  int64_t now = millis64();
+  for(int i=0; i < BT_MAX_PEERS; i++) {
+    // The RSSI read waits on the controller, don't hold the lock for it
+    k_mutex_lock(&phy_mutex, K_FOREVER);
+    btphy *phy = phylinks[i];
+    struct bt_conn *conn = NULL;
+    if(phy && phy->conn && now >= phy->next) {
+      phy->next = now + BT_PHY_PERIOD;
+      conn = bt_conn_ref(phy->conn);
+    }
+    k_mutex_unlock(&phy_mutex);
+
+    if(conn) {
+      phyPolicy(*phy, conn);
+      bt_conn_unref(conn);
+    }
+  }
+}
+
+// (us) Connection interval, a packet taking longer than this was late
+uint32_t BTPhyInterval(const btphy &phy)
+{
+  return phy.interval;
+}
+
+// Link with the lowest RSSI, the first one until they have been read
+static btphy *weakestLink()
+{
+  btphy *weakest = NULL;
+  for(int i=0; i < BT_MAX_PEERS; i++) {
+    btphy *phy = phylinks[i];
+    if(phy == NULL)
+      continue;
+    if(weakest == NULL || (phy->rssivalid && (!weakest->rssivalid || phy->rssi < weakest->rssi)))
+      weakest = phy;
+  }
+  return weakest;
+}
+
+// Filtered RSSI of the weakest connection, -1 if there isn't one
+int8_t BTPhyRSSI()
+{
+  int8_t rssi = -1;
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  btphy *phy = weakestLink();
+  if(phy && phy->rssivalid)
+    rssi = (int8_t)roundf(phy->rssi);
+  k_mutex_unlock(&phy_mutex);
+  return rssi;
+}
+
+// PHY of the weakest connection
+uint8_t BTGetPhy()
+{
+  uint8_t curphy = BT_GAP_LE_PHY_NONE;
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  btphy *phy = weakestLink();
+  if(phy)
+    curphy = phy->curphy;
+  k_mutex_unlock(&phy_mutex);
+  return curphy;
+}
+
+// Packets on each PHY, all connections added up
+void BTGetPhyStats(uint16_t packets[BT_PHY_STAT_CNT], uint16_t late[BT_PHY_STAT_CNT])
+{
+  uint32_t pkt[BT_PHY_STAT_CNT] = {0}, lt[BT_PHY_STAT_CNT] = {0};
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  for(int i=0; i < BT_MAX_PEERS; i++) {
+    if(phylinks[i] == NULL)
+      continue;
+    for(int j=0; j < BT_PHY_STAT_CNT; j++) {
+      pkt[j] += phylinks[i]->packets[j];
+      lt[j] += phylinks[i]->late[j];
+    }
+  }
+  k_mutex_unlock(&phy_mutex);
+
+  for(int j=0; j < BT_PHY_STAT_CNT; j++) {
+    packets[j] = MIN(pkt[j], UINT16_MAX);
+    late[j] = MIN(lt[j], UINT16_MAX);
+  }
+}
+
 void lephyupdated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
 {
-  LOGI("Bluetooth PHY Updated. RxPHY:%s TxPHY:%s", param->rx_phy, param->tx_phy);
+  LOGI("Bluetooth PHY Updated. RxPHY:%s TxPHY:%s", printPhy(param->rx_phy), printPhy(param->tx_phy));
+  k_mutex_lock(&phy_mutex, K_FOREVER);
+  for(int i=0; i < BT_MAX_PEERS; i++) {
+    if(phylinks[i] && phylinks[i]->conn == conn)
+      phylinks[i]->curphy = param->tx_phy;
+  }
+  k_mutex_unlock(&phy_mutex);
 }
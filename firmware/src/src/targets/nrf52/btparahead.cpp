@@ -21,6 +21,8 @@
 #include <bluetooth/conn.h>
 #include <bluetooth/uuid.h>
 #include <bluetooth/gatt.h>
+#include <sys/ring_buffer.h>
+#include <sys/atomic.h>
 
 #include "trackersettings.h"
 #include "btparahead.h"
@@ -28,10 +30,9 @@
 #include "io.h"
 #include "nano33ble.h"
 #include "defines.h"
+#include "paracodec.h"
 
 void sendTrainer();
-int setTrainer(uint8_t *addr);
-void pushByte(uint8_t byte);
 
 static void disconnected(struct bt_conn *conn, uint8_t reason);
 static void connected(struct bt_conn *conn, uint8_t err);
@@ -43,23 +44,67 @@ static ssize_t write_but(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 static ssize_t read_over(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 static void ct_ccc_cfg_changed_frsky(const struct bt_gatt_attr *attr, uint16_t value);
 static void ct_ccc_cfg_changed_overr(const struct bt_gatt_attr *attr, uint16_t value);
+static void ct_ccc_cfg_changed_json(const struct bt_gatt_attr *attr, uint16_t value);
+void hasSecurityChangedTimer(struct k_timer *tmr);
+static void jsonFlush();
+
+static_assert(BT_CHANNELS == PARA_CHANNELS, "Trainer frame holds 8 channels");
+static_assert(BT_MAX_PEERS <= CONFIG_BT_MAX_CONN, "Raise CONFIG_BT_MAX_CONN");
 
-static constexpr uint8_t START_STOP = 0x7E;
-static constexpr uint8_t BYTE_STUFF = 0x7D;
-static constexpr uint8_t STUFF_MASK = 0x20;
-static uint8_t buffer[BLUETOOTH_LINE_LENGTH+1];
 static uint16_t chan_vals[BT_CHANNELS];
-static uint8_t bufferIndex;
-static uint8_t crc;
 static uint8_t ct[40];
 static uint8_t overdata[2];
 static char _address[18] = "00:00:00:00:00:00";
 uint16_t ovridech = 0xFFFF;
 
-// JSON Ring Buffer Reader
-DynamicJsonDocument blejson(JSON_BUF_SIZE);
-char blejsonbuffer[JSON_BUF_SIZE] = "";
-char *blejsonbufptr = blejsonbuffer;
+/* Each connected central, e.g. a radio and a gimbal controller, all get
+ * the same channels. Only one trainer notify per peer is given to the stack
+ * at a time. Newer channels replace the pending ones until it goes out in
+ * that peer's connection event, then the newest are sent straight away, so a
+ * slow link doesn't hold up the others or build up a backlog of old frames.
+ * Frames are kept per peer, the one not last sent is the next to fill.
+ * Each peer also runs it's own PHY policy.
+ */
+
+struct btpeer {
+    struct bt_conn *conn;
+    uint8_t frames[2][PARA_MAX_FRAME];
+    int lastframe;
+    int lastlen;
+    int64_t lastsent;
+    atomic_t notifyqueued;           // Given to the stack, not sent yet
+    volatile uint32_t notifylatency; // (us) filtered
+    atomic_t notifycount;            // Frames that went out
+    uint32_t ratecount;              // notifycount at the last rate calc
+    int64_t ratetime;                // (ms) Time of the last rate calc
+    struct bt_gatt_notify_params notifyparams;
+    struct bt_gatt_exchange_params mtuparams;
+    struct k_timer sectimer;
+    btphy phy;
+};
+
+static btpeer peers[BT_MAX_PEERS];
+static int peercount = 0;
+static int nextpeer = 0;  // First one notified next round, rotates
+static volatile bool advertise = false; // Restart advertising, more room
+static atomic_t notifypeak = ATOMIC_INIT(0);
+
+/* Configuration over BLE, same framing and commands as USB. Writes are
+ * queued for the serial thread to process, so parsing, flash saves and the
+ * replies don't run on the BT RX thread. Replies and live data go out as
+ * notifies on the JSON characteristic to the peer that last wrote to it,
+ * as big as the MTU allows
+ */
+
+static struct bt_conn *jsonconn = NULL;
+static const struct bt_gatt_attr *jsonattr = NULL;
+static uint8_t jsontxbuf[TX_RNGBUF_SIZE];
+static struct ring_buf jsontx;
+K_MUTEX_DEFINE(jsontx_mutex);
+static volatile int jsonqueued = 0;
+static uint8_t jsonrxbuf[RX_RNGBUF_SIZE];
+static struct ring_buf jsonrx;
+K_MUTEX_DEFINE(jsonrx_mutex);
 
 // Service UUID
 static struct bt_uuid_128 btparaserv = BT_UUID_INIT_128(
@@ -90,10 +135,12 @@ BT_GATT_SERVICE_DEFINE(bt_srv,
                            BT_GATT_CHRC_WRITE,
                            BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, NULL, write_but, NULL),
 
-    // Remote Button Press Characteristic, Indicate ATTRIBUTE 8
+    // Configuration, commands written and replies notified ATTRIBUTE 9,10
     BT_GATT_CHARACTERISTIC(&jsonuuid.uuid,
-                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP | BT_GATT_CHRC_NOTIFY,
                            BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, read_json, write_json, NULL),
+    // ATTRIBUTE 11
+    BT_GATT_CCC(ct_ccc_cfg_changed_json, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 
     );
 
@@ -115,11 +162,6 @@ static struct bt_le_adv_param my_param = {
         .peer = (NULL), \
     };
 
-struct bt_conn *curconn = NULL;
-struct bt_le_conn_param *conparms = BT_LE_CONN_PARAM(BT_MIN_CONN_INTER_PERIF,
-                                                     BT_MAX_CONN_INTER_PERIF,
-                                                     0,
-                                                     BT_CONN_LOST_TIME);
 
 static struct bt_conn_cb conn_callbacks = {
 	.connected = connected,
@@ -130,18 +172,24 @@ static struct bt_conn_cb conn_callbacks = {
   //.security_changed = securitychanged
 };
 
-static struct bt_conn_le_phy_param phy_params = {
-  .options = BT_CONN_LE_PHY_OPT_CODED_S8,
-  .pref_tx_phy = BT_GAP_LE_PHY_CODED,
-  .pref_rx_phy = BT_GAP_LE_PHY_CODED,
-};
-
 bt_addr_le_t addrarry[CONFIG_BT_ID_MAX];
 size_t addrcnt=1;
 
 void BTHeadStart()
 {
     bleconnected = false;
+    peercount = 0;
+    advertise = false;
+    jsonconn = NULL;
+    jsonqueued = 0;
+    ring_buf_init(&jsontx, sizeof(jsontxbuf), jsontxbuf);
+    ring_buf_init(&jsonrx, sizeof(jsonrxbuf), jsonrxbuf);
+    jsonattr = bt_gatt_find_by_uuid(bt_srv.attrs, bt_srv.attr_count, &jsonuuid.uuid);
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        peers[i].conn = NULL;
+        k_timer_init(&peers[i].sectimer, hasSecurityChangedTimer, NULL);
+        k_timer_user_data_set(&peers[i].sectimer, &peers[i]);
+    }
 
     // Center all Channels
     for(int i=0;i < BT_CHANNELS;i++) {
@@ -166,9 +214,6 @@ void BTHeadStart()
     bt_id_get(addrarry, &addrcnt);
     if(addrcnt > 0)
         bt_addr_le_to_str(&addrarry[0],_address,sizeof(_address));
-
-    crc = 0;
-    bufferIndex = 0;
 }
 
 void BTHeadStop()
@@ -183,26 +228,254 @@ void BTHeadStop()
         LOGI("BLE Stopped Advertising");
     }
 
-    if(curconn){
-        LOGI("BLE Disconnecting Active Connection");
-        bt_conn_disconnect(curconn,0);
-        bt_conn_unref(curconn);
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        if(peers[i].conn) {
+            LOGI("BLE Disconnecting Active Connection");
+            k_timer_stop(&peers[i].sectimer);
+            BTPhyDisconnected(peers[i].phy);
+            bt_conn_disconnect(peers[i].conn, 0);
+            bt_conn_unref(peers[i].conn);
+            peers[i].conn = NULL;
+        }
     }
-    curconn = NULL;
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    if(jsonconn)
+        bt_conn_unref(jsonconn);
+    jsonconn = NULL;
+    k_mutex_unlock(&jsontx_mutex);
+    peercount = 0;
+    advertise = false;
 
     bleconnected = false;
 }
 
+static btpeer *findPeer(struct bt_conn *conn)
+{
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        if(peers[i].conn == conn)
+            return &peers[i];
+    }
+    return NULL;
+}
+
+// Raises a to v if it's lower, the notify callback can change it meanwhile
+static void atomicMax(atomic_t *a, atomic_val_t v)
+{
+    atomic_val_t old;
+    do {
+        old = atomic_get(a);
+        if(old >= v)
+            return;
+    } while(!atomic_cas(a, old, v));
+}
+
+// Trainer notify went out in a connection event, user_data is when it was queued
+static void notifySent(struct bt_conn *conn, void *user_data)
+{
+    btpeer *peer = findPeer(conn);
+    if(peer == NULL)
+        return;
+
+    uint32_t delay = micros() - (uint32_t)user_data;
+    peer->notifylatency += ((int32_t)delay - (int32_t)peer->notifylatency) / 8;
+    atomic_inc(&peer->notifycount);
+
+    // Should go out in the next connection event, longer was a retransmit
+    BTPhyPacket(peer->phy, delay > BTPhyInterval(peer->phy) * 3 / 2);
+    if(atomic_get(&peer->notifyqueued) > 0)
+        atomic_dec(&peer->notifyqueued);
+
+    // Room again, wake the BT thread to queue the newest channels now
+    // instead of at the next calculate cycle
+    k_sem_give(&btchansem);
+}
+
+static void notifyPeer(btpeer &peer, const uint8_t *frame, int len, int64_t now)
+{
+    // Last one still waiting for a connection event, these channels are
+    // sent once it's gone if they haven't been replaced by then
+    if(atomic_get(&peer.notifyqueued) > 0)
+        return;
+
+    if(!bt_gatt_is_subscribed(peer.conn, &bt_srv.attrs[1], BT_GATT_CCC_NOTIFY))
+        return;
+
+    // Unchanged frames only sent as a keep alive
+    if(trkset.btNotifyOnChange() &&
+       len == peer.lastlen && memcmp(frame, peer.frames[peer.lastframe], len) == 0 &&
+       now - peer.lastsent < BT_NOTIFY_KEEPALIVE)
+        return;
+
+    // Nothing is queued so the stack has neither of this peer's frames
+    uint8_t *out = peer.frames[!peer.lastframe];
+    memcpy(out, frame, len);
+    peer.lastframe = !peer.lastframe;
+    peer.lastlen = len;
+    peer.lastsent = now;
+
+    struct bt_gatt_notify_params &params = peer.notifyparams;
+    memset(&params, 0, sizeof(params));
+    params.attr = &bt_srv.attrs[1];
+    params.data = out;
+    params.len = len;
+    params.func = notifySent;
+    params.user_data = (void *)micros();
+
+    atomic_inc(&peer.notifyqueued);
+    if(bt_gatt_notify_cb(peer.conn, &params))
+        atomic_dec(&peer.notifyqueued);
+    atomicMax(&notifypeak, atomic_get(&peer.notifyqueued));
+}
+
 void BTHeadExecute()
 {
-    if(bleconnected) {
-        // Send Trainer Data
-        uint8_t output[BLUETOOTH_LINE_LENGTH+1];
-        int len;
-        len = setTrainer(output);
+    // Connecting stops advertising, start it again if there is room for more
+    if(advertise) {
+        int err = bt_le_adv_start(&my_param, ad, ARRAY_SIZE(ad), NULL, 0);
+        if(err == 0 || err == -EALREADY)
+            advertise = false;
+    }
+
+    if(!bleconnected)
+        return;
+
+    // Send Trainer Data, encoded once for everyone
+    uint8_t frame[PARA_MAX_FRAME];
+    int len = paraEncode(frame, chan_vals);
+    int64_t now = millis64();
+
+    // Take turns going first, the controller only has a few TX buffers
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        btpeer &peer = peers[(nextpeer + i) % BT_MAX_PEERS];
+        if(peer.conn)
+            notifyPeer(peer, frame, len, now);
+    }
+    nextpeer = (nextpeer + 1) % BT_MAX_PEERS;
+
+    jsonFlush();
+}
+
+static void jsonSent(struct bt_conn *conn, void *user_data)
+{
+    if(jsonqueued > 0)
+        jsonqueued--;
+}
+
+// Send queued config data, a few notifies at a time so the trainer frames still get through
+static void jsonFlush()
+{
+    // jsonconn is swapped by the BT RX thread, this one is kept until the end
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    if(jsonconn == NULL || jsonattr == NULL) {
+        k_mutex_unlock(&jsontx_mutex);
+        return;
+    }
+    struct bt_conn *conn = bt_conn_ref(jsonconn);
+
+    if(!bt_gatt_is_subscribed(conn, jsonattr, BT_GATT_CCC_NOTIFY)) {
+        ring_buf_reset(&jsontx);
+        k_mutex_unlock(&jsontx_mutex);
+        bt_conn_unref(conn);
+        return;
+    }
+
+    uint32_t chunk = MIN(bt_gatt_get_mtu(conn) - 3, BT_JSON_CHUNK);
+    uint8_t *data;
+    uint32_t claimed;
+    while(jsonqueued < BT_JSON_NOTIFY_MAX &&
+          (claimed = ring_buf_get_claim(&jsontx, &data, chunk)) > 0) {
+        struct bt_gatt_notify_params params;
+        memset(&params, 0, sizeof(params));
+        params.attr = jsonattr;
+        params.data = data;
+        params.len = claimed;
+        params.func = jsonSent;
+
+        // Data is copied into the stack's buffer, the ring space can be freed
+        jsonqueued++;
+        if(bt_gatt_notify_cb(conn, &params)) {
+            jsonqueued--;
+            ring_buf_get_finish(&jsontx, 0);
+            break;
+        }
+        ring_buf_get_finish(&jsontx, claimed);
+    }
+    k_mutex_unlock(&jsontx_mutex);
+    bt_conn_unref(conn);
+}
+
+// Queue config data for the GUI, all or nothing. Returns bytes queued
+int BTHeadJSONWrite(const char *data, int len)
+{
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    int rv = 0;
+    if(jsonconn != NULL && ring_buf_space_get(&jsontx) >= (uint32_t)len)
+        rv = ring_buf_put(&jsontx, (const uint8_t *)data, len);
+    k_mutex_unlock(&jsontx_mutex);
+    return rv;
+}
+
+// Take config data the GUI wrote, from the serial thread. Returns bytes read
+int BTHeadJSONRead(char *data, int len)
+{
+    k_mutex_lock(&jsonrx_mutex, K_FOREVER);
+    int rv = ring_buf_get(&jsonrx, (uint8_t *)data, len);
+    k_mutex_unlock(&jsonrx_mutex);
+    return rv;
+}
 
-        bt_gatt_notify(NULL, &bt_srv.attrs[1], output, len);
+int BTHeadJSONSpace()
+{
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    int rv = jsonconn == NULL ? 0 : ring_buf_space_get(&jsontx);
+    k_mutex_unlock(&jsontx_mutex);
+    return rv;
+}
+
+// Worst of the connected peers
+uint16_t BTHeadGetNotifyLatency()
+{
+    uint32_t latency = 0;
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        if(peers[i].conn)
+            latency = MAX(latency, peers[i].notifylatency);
     }
+    return MIN(latency, UINT16_MAX);
+}
+
+// 1 if a peer had a trainer notify waiting since the last call
+uint8_t BTHeadGetNotifyQueue()
+{
+    uint8_t peak = atomic_clear(&notifypeak);
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        if(peers[i].conn)
+            atomicMax(&notifypeak, atomic_get(&peers[i].notifyqueued));
+    }
+    return peak;
+}
+
+/* Per peer (hz) frames sent since the last call and (us) notify latency,
+ * zero for empty slots. Returns how many are connected
+ */
+
+uint8_t BTHeadGetPeerStats(uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS])
+{
+    int64_t now = millis64();
+    for(int i=0; i < BT_MAX_PEERS; i++) {
+        btpeer &peer = peers[i];
+        rate[i] = 0;
+        latency[i] = 0;
+        if(peer.conn == NULL)
+            continue;
+
+        uint32_t count = atomic_get(&peer.notifycount);
+        if(now > peer.ratetime)
+            rate[i] = MIN((count - peer.ratecount) * 1000 / (now - peer.ratetime), UINT16_MAX);
+        peer.ratecount = count;
+        peer.ratetime = now;
+        latency[i] = MIN(peer.notifylatency, UINT16_MAX);
+    }
+    return peercount;
 }
 
 const char * BTHeadGetAddress()
@@ -250,8 +523,7 @@ uint16_t BTHeadGetChannel(int channel)
 
 int8_t BTHeadGetRSSI()
 {
-    // *** Implement
-    return -1;
+    return BTPhyRSSI();
 }
 
 static void ct_ccc_cfg_changed_overr(const struct bt_gatt_attr *attr, uint16_t value)
@@ -264,6 +536,11 @@ static void ct_ccc_cfg_changed_frsky(const struct bt_gatt_attr *attr, uint16_t v
     LOGI("FrSky CCC Value Changed (%d)", value);
 }
 
+static void ct_ccc_cfg_changed_json(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOGI("JSON CCC Value Changed (%d)", value);
+}
+
 static ssize_t read_ct(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 		       void *buf, uint16_t len, uint16_t offset)
 {
@@ -300,40 +577,33 @@ static ssize_t write_json(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 			const void *buf, uint16_t len, uint16_t offset,
 			uint8_t flags)
 {
-    char sc=0;
-
-    LOGI("BLE:%.*s", len, buf);
-
-    for(int i=0; i < len; i++) {
-        sc = *((char*)buf + i);
-        // Start Of Text Character, clear buffer
-        if(sc == 0x02) {
-            // Reset Buffer
-            blejsonbufptr = blejsonbuffer + 1;
-            blejsonbuffer[0] = 0x02; // Save SOT
-
-        // End of Text Characher, parse JSON data
-        } else if (sc == 0x03) {
-            // Make sure it's a complete frame, SOT at beginning
-            if(blejsonbuffer[0] == 0x02) {
-                *blejsonbufptr = 0; // Null terminate
-                LOGI("BLE Data RX:%s", blejsonbuffer);
-                JSON_Process(blejsonbuffer+1);
-            }
-            // Reset Buffer
-            blejsonbufptr = blejsonbuffer;
-            blejsonbuffer[0] = 0;
-        } else {
-            // Check how much free data is in the buffer
-            if(blejsonbufptr >= blejsonbuffer + sizeof(blejsonbuffer) - 3) {
-                LOGE("JSON data too long, overflow");
-                blejsonbufptr = blejsonbuffer; // Reset Buffer
-                blejsonbuffer[0] = 0;
-            // Add data to buffer
-            } else {
-                *(blejsonbufptr++) = sc;
-            }
-        }
+    // Replies go to whoever sent the command
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    bool newpeer = conn != jsonconn;
+    if(newpeer) {
+        ring_buf_reset(&jsontx);
+        if(jsonconn)
+            bt_conn_unref(jsonconn);
+        jsonconn = bt_conn_ref(conn);
+    }
+    k_mutex_unlock(&jsontx_mutex);
+
+    if(newpeer) {
+        k_mutex_lock(&jsonrx_mutex, K_FOREVER);
+        ring_buf_reset(&jsonrx);
+        k_mutex_unlock(&jsonrx_mutex);
+    }
+
+    // All or nothing, a partial write would only fail the crc
+    k_mutex_lock(&jsonrx_mutex, K_FOREVER);
+    uint32_t put = 0;
+    if(ring_buf_space_get(&jsonrx) >= len)
+        put = ring_buf_put(&jsonrx, (const uint8_t *)buf, len);
+    k_mutex_unlock(&jsonrx_mutex);
+
+    if(put == 0) {
+        LOGE("BLE JSON RX Buffer Full");
+        return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
     }
 
 	return len;
@@ -373,36 +643,63 @@ void hasSecurityChangedTimer(struct k_timer *tmr)
 {
     k_timer_stop(tmr);
 
-    if(!curconn)
+    btpeer *peer = (btpeer *)k_timer_user_data_get(tmr);
+    if(!peer->conn)
         return;
 
-    bt_security_t sl = bt_conn_get_security(curconn);
+    bt_security_t sl = bt_conn_get_security(peer->conn);
 
     // If a CC2540 device, is should have changed the security level to 2 by now
     // If you force the notify subscription on a CC2540 right away it won't send data
     if(sl == BT_SECURITY_L1) {
         uint8_t ccv = BT_GATT_CCC_NOTIFY;
-        bt_gatt_attr_write_ccc(curconn, &bt_srv.attrs[3], &ccv, 1 , 0, 0);
+        bt_gatt_attr_write_ccc(peer->conn, &bt_srv.attrs[3], &ccv, 1 , 0, 0);
         LOGI("Detected a CC2650 Chip (PARA Wireless)");
     }
     else
         LOGI("Detected a CC2540 Chip (non-PARA)");
 }
 
-K_TIMER_DEFINE(my_timer, hasSecurityChangedTimer, NULL);
+static void mtuExchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+    LOGI("MTU Exchange %s, MTU %d", err ? "Failed" : "Done", bt_gatt_get_mtu(conn));
+}
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err) {
 		LOGE("Bluetooth Connection failed %d", err);
-	} else {
-		LOGI("Bluetooth connected :)");
+		advertise = true;
+		return;
 	}
 
+	LOGI("Bluetooth connected :)");
+
     // Stop Advertising
     bt_le_adv_stop();
 
-    curconn = bt_conn_ref(conn);
+    int slot = -1;
+    for(int i=0; i < BT_MAX_PEERS && slot < 0; i++) {
+        if(peers[i].conn == NULL)
+            slot = i;
+    }
+    if(slot < 0) {
+        LOGW("No room for another peer");
+        bt_conn_disconnect(conn, BT_HCI_ERR_CONN_LIMIT_EXCEEDED);
+        return;
+    }
+
+    btpeer &peer = peers[slot];
+    peer.conn = bt_conn_ref(conn);
+    peer.lastframe = 0;
+    peer.lastlen = 0;
+    peer.lastsent = 0;
+    atomic_set(&peer.notifyqueued, 0);
+    peer.notifylatency = 0;
+    atomic_set(&peer.notifycount, 0);
+    peer.ratecount = 0;
+    peer.ratetime = millis64();
+    peercount++;
 
     struct bt_conn_info info;
     bt_conn_get_info(conn, &info);
@@ -410,21 +707,36 @@ static void connected(struct bt_conn *conn, uint8_t err)
     char addr_str[50];
     bt_addr_le_to_str(info.le.dst, addr_str, sizeof(addr_str));
 
-    LOGI("Connected to Address %s", addr_str);
+    LOGI("Connected to Address %s, peer %d of %d", addr_str, peercount, BT_MAX_PEERS);
 
     bt_conn_info info2;
     bt_conn_get_info(conn, &info2);
     LOGI("PHY Connection Rx:%s TX:%s", printPhy(info2.le.phy->rx_phy), printPhy(info2.le.phy->tx_phy));
- 
-    // Set Connection Parameters - Request updated rate
-    bt_conn_le_param_update(curconn,conparms);
 
-    LOGI("Requesting coded PHY - %s", bt_conn_le_phy_update(curconn, &phy_params) ? "FAILED" : "Success");
+    // Set Connection Parameters - Request updated rate. Each slot asks for a
+    // slightly different interval so two links' events can't keep landing
+    // on top of each other, one starving the other
+    uint16_t interval = BT_MIN_CONN_INTER_PERIF + slot * BT_PEER_INTERVAL_STEP;
+    struct bt_le_conn_param conparms = BT_LE_CONN_PARAM_INIT(interval,
+                                                             MAX(interval, BT_MAX_CONN_INTER_PERIF),
+                                                             0,
+                                                             BT_CONN_LOST_TIME);
+    bt_conn_le_param_update(conn, &conparms);
+
+    // Longest packets and largest MTU the central allows, for configuration
+    // and live data. Trainer frames fit in the defaults
+    bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    peer.mtuparams.func = mtuExchanged;
+    bt_gatt_exchange_mtu(conn, &peer.mtuparams);
+
+    // Start on 2M, this peer's PHY policy moves it to coded if needed
+    BTPhyConnected(peer.phy, conn);
 
     // Start a Timer, If we don't see a Security Change within this time
     // e.g. a CC2540 chip then force a subscription for the PARA chip
-    k_timer_start(&my_timer, K_SECONDS(2), K_SECONDS(0));
+    k_timer_start(&peer.sectimer, K_SECONDS(2), K_SECONDS(0));
 
+    advertise = peercount < BT_MAX_PEERS;
     bleconnected = true;
 }
 
@@ -433,60 +745,25 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
     LOGW("Bluetooth disconnected (reason %d)", reason);
 
-    // Start advertising
-    int err = bt_le_adv_start(&my_param, ad, ARRAY_SIZE(ad), NULL, 0);
-	if (err) {
-		LOGE("Advertising failed to start (err %d)", err);
-		return;
-	}
-
-    if(curconn)
-        bt_conn_unref(curconn);
-
-    curconn = NULL;
-    bleconnected = false;
-}
-
-// Part of setTrainer to calculate CRC
-// From OpenTX
+    btpeer *peer = findPeer(conn);
+    if(peer == NULL)
+        return;
 
-void pushByte(uint8_t byte)
-{
-    crc ^= byte;
-    if (byte == START_STOP || byte == BYTE_STUFF) {
-        buffer[bufferIndex++] = BYTE_STUFF;
-        byte ^= STUFF_MASK;
+    k_timer_stop(&peer->sectimer);
+    k_mutex_lock(&jsontx_mutex, K_FOREVER);
+    if(conn == jsonconn) {
+        ring_buf_reset(&jsontx);
+        bt_conn_unref(jsonconn);
+        jsonconn = NULL;
     }
-    buffer[bufferIndex++] = byte;
+    k_mutex_unlock(&jsontx_mutex);
+    BTPhyDisconnected(peer->phy);
+    bt_conn_unref(peer->conn);
+    peer->conn = NULL;
+    atomic_set(&peer->notifyqueued, 0);
+    peercount--;
+
+    // Start advertising, from the BT thread once this connection is freed
+    advertise = true;
+    bleconnected = peercount > 0;
 }
-
-/* Builds Trainer Data
-*     Returns the length of the encoded PPM + CRC
-*     Data saved into addr pointer
-*/
-int setTrainer(uint8_t *addr)
-{
-    // Allocate Channel Mappings, Set Default to all Center
-    uint8_t * cur = buffer;
-    bufferIndex = 0;
-    crc = 0x00;
-
-    buffer[bufferIndex++] = START_STOP; // start byte
-    pushByte(0x80); // trainer frame type?
-    for (int channel=0; channel < BT_CHANNELS; channel+=2, cur+=3) {
-        uint16_t channelValue1 = chan_vals[channel];
-        uint16_t channelValue2 = chan_vals[channel+1];
-
-        pushByte(channelValue1 & 0x00ff);
-        pushByte(((channelValue1 & 0x0f00) >> 4) + ((channelValue2 & 0x00f0) >> 4));
-        pushByte(((channelValue2 & 0x000f) << 4) + ((channelValue2 & 0x0f00) >> 8));
-    }
-
-    buffer[bufferIndex++] = crc;
-    buffer[bufferIndex++] = START_STOP; // end byte
-
-    // Copy data to array
-    memcpy(addr,buffer,bufferIndex);
-
-    return bufferIndex;
-}
\ No newline at end of file
@@ -23,21 +23,29 @@
 #include <bluetooth/uuid.h>
 #include <bluetooth/gatt.h>
 #include <sys/byteorder.h>
+#include <stdlib.h>
 
 #include "log.h"
 #include "io.h"
 #include "nano33ble.h"
 #include "trackersettings.h"
-#include "opentxbt.h"
+#include "paracodec.h"
 #include "btpararmt.h"
 
 static uint16_t chan_vals[BT_CHANNELS];
+static ParaDecoder paradecoder;
+static_assert(BT_CHANNELS == PARA_CHANNELS, "Trainer frame holds 8 channels");
 uint16_t chanoverrides=0xFFFF; // Default to all enabled
 
 static void start_scan(void);
+static bool connectCached();
+static void subscribeCached(struct bt_conn *conn);
+static void loadCache();
+static void storeCache();
 volatile bool isscanning=false;
 static char _address[18] = "00:00:00:00:00:00";
 static struct bt_conn *pararmtconn = NULL;
+static btphy rmtphy; // PHY policy of the connection to the head
 
 struct bt_le_scan_param scnparams = {
     .type = BT_LE_SCAN_TYPE_ACTIVE,
@@ -53,13 +61,38 @@ static struct bt_gatt_subscribe_params subscribeaff1; // Override Data
 
 static bool contoheadboard = false;
 uint32_t buttonhandle =0;
-static const struct bt_gatt_attr *buttonattr=NULL;
 
 struct bt_le_conn_param *rmtconparms = BT_LE_CONN_PARAM(BT_MIN_CONN_INTER_MASTER, BT_MAX_CONN_INTER_MASTER, 0, BT_CONN_LOST_TIME); // Faster Connection Interval
 
 // Characteristic UUID
 static struct bt_uuid_16 uuid = BT_UUID_INIT_16(0);
 
+// Last head connected to and it's attribute handles. Reconnects go straight
+// to it and subscribe without a scan or discovery. Saved in the settings
+static struct {
+    bool valid;
+    bool inuse; // This connection skipped discovery
+    bt_addr_le_t addr;
+    uint16_t fff6, fff6ccc;
+    uint16_t aff1, aff1ccc;
+    uint16_t aff2;
+} btcache;
+
+static int64_t disconnecttime = 0;
+static volatile uint16_t reconnecttime = 0; // (ms) Disconnect to channel data
+static volatile uint32_t cachedsubtime = 0; // (ms) Subscribed with cached handles, no data yet
+
+// Cached handles are wrong, the head's firmware may have changed.
+// Forget them and start over with a full discovery
+static void dropCache(struct bt_conn *conn)
+{
+    LOGW("Cached handles invalid, rediscovering");
+    cachedsubtime = 0;
+    btcache.valid = false;
+    btcache.inuse = false;
+    storeCache();
+    bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+}
 
 // Read Override Parameters
 
@@ -68,6 +101,15 @@ uint8_t read_overrides(struct bt_conn *conn, uint8_t err,
 				    const void *data, uint16_t length)
 {
     char buf[10];
+
+    if(err && btcache.inuse) {
+        dropCache(conn);
+        return BT_GATT_ITER_STOP;
+    }
+
+    if(!data)
+        return BT_GATT_ITER_STOP;
+
     LOGI("Read Override Data (%s)", bytesToHex((uint8_t*)data, 2, buf));
     if(length == 2) {
         // Store Overrides
@@ -92,17 +134,22 @@ static uint8_t notify_func(struct bt_conn *conn,
 		return BT_GATT_ITER_CONTINUE;
 	}
 
-    // Simulate sending byte by byte like opentx uses, stores in global
-    for(int i=0;i<length;i++) {
-        processTrainerByte(((uint8_t *)data)[i]);
-    }
+    // Cached handles are good
+    cachedsubtime = 0;
 
-    // Store all channels
-    for(int i=0 ; i < BT_CHANNELS; i++) {
-        // Only set the data on channels that are allowed to be overriden
-            chan_vals[i]  = BtChannelsIn[i];
+    // First data since a disconnect
+    if(disconnecttime) {
+        reconnecttime = MIN(millis64() - disconnecttime, UINT16_MAX);
+        disconnecttime = 0;
+        LOGI("Reconnected in %dms", reconnecttime);
     }
 
+    // Can't see retransmits on this side, only counted
+    BTPhyPacket(rmtphy, false);
+
+    // Whole notification at once, channels only change on a complete frame
+    paradecoder.decode((const uint8_t *)data, length, chan_vals);
+
 	return BT_GATT_ITER_CONTINUE;
 }
 
@@ -192,6 +239,16 @@ static uint8_t discover_func(struct bt_conn *conn,
             LOGE("Subscribe failed (err %d)", err);
 		} else {
 			LOGI("Subscribed to Frsky Data");
+
+            // Enough to reconnect to a radio, head boards add the rest below
+            bt_addr_le_copy(&btcache.addr, bt_conn_get_dst(conn));
+            btcache.fff6 = subscribefff6.value_handle;
+            btcache.fff6ccc = subscribefff6.ccc_handle;
+            btcache.aff1 = 0;
+            btcache.aff1ccc = 0;
+            btcache.aff2 = 0;
+            btcache.valid = true;
+            storeCache();
 		}
 
 //-----------------------------------------------------------------------------------
@@ -236,6 +293,9 @@ static uint8_t discover_func(struct bt_conn *conn,
             LOGE("Subscribe to overrides failed (err %d)", err);
 		} else {
 			LOGI("Subscribed to Overrides");
+            btcache.aff1 = subscribeaff1.value_handle;
+            btcache.aff1ccc = subscribeaff1.ccc_handle;
+            storeCache();
 		}
 
 //-----------------------------------------------------------------------------------
@@ -254,7 +314,8 @@ static uint8_t discover_func(struct bt_conn *conn,
         LOGI("Found headboard connection. Enabling button indication forwarding");
         contoheadboard = true;
         buttonhandle = attr->handle;
-        buttonattr = attr;
+        btcache.aff2 = buttonhandle;
+        storeCache();
 
 
         LOGI("Reading Overrides in Timeout");
@@ -392,12 +453,6 @@ static void start_scan(void)
 	LOGI("Scanning successfully started");
 }
 
-static struct bt_conn_le_phy_param phy_params = {
-  .options = BT_CONN_LE_PHY_OPT_CODED_S8,
-  .pref_tx_phy = BT_GAP_LE_PHY_CODED,
-  .pref_rx_phy = BT_GAP_LE_PHY_CODED,
-};
-
 static void rmtconnected(struct bt_conn *conn, uint8_t err)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
@@ -427,7 +482,17 @@ static void rmtconnected(struct bt_conn *conn, uint8_t err)
     LOGI("PHY Connection Rx:%d Tx:%d", info.le.phy->rx_phy, info.le.phy->tx_phy);
     LOGI("BT Connection Params Int:%d Lat:%d Timeout:%d", 
         info.le.interval, info.le.latency, info.le.timeout);
-    LOGI("Requesting coded PHY - %s", bt_conn_le_phy_update(pararmtconn, &phy_params) ? "FAILED" : "Success");
+
+    // Start on 2M, the PHY policy moves to coded if needed
+    BTPhyConnected(rmtphy, pararmtconn);
+    paradecoder.reset();
+
+    // Same head as last time, use the handles found then
+    btcache.inuse = btcache.valid && bt_addr_le_cmp(bt_conn_get_dst(conn), &btcache.addr) == 0;
+    if(btcache.inuse) {
+        subscribeCached(conn);
+        return;
+    }
 
     // Start Discovery
 	if (conn == pararmtconn) {
@@ -456,11 +521,17 @@ static void rmtdisconnected(struct bt_conn *conn, uint8_t reason)
 
 	bt_conn_unref(pararmtconn);
 	pararmtconn = NULL;
+    BTPhyDisconnected(rmtphy);
 
-	start_scan();
     bleconnected = false;
     contoheadboard = false;
-    buttonattr = NULL;
+    buttonhandle = 0;
+    btcache.inuse = false;
+    cachedsubtime = 0;
+    disconnecttime = millis64();
+
+    if(!connectCached())
+	    start_scan();
 }
 
 static struct bt_conn_cb rmtconn_callbacks = {
@@ -493,7 +564,12 @@ void BTRmtStart()
         bt_addr_le_to_str(&addrarry[0],_address,sizeof(_address));
     }
 
-	start_scan();
+    // Try the last head first, scan if it's not there
+    loadCache();
+    btcache.inuse = false;
+    disconnecttime = 0;
+    if(!connectCached())
+	    start_scan();
 }
 
 // Close All Connections, Foreach Callback
@@ -511,6 +587,7 @@ void BTRmtStop()
 
     // Close all Connections, Callback to above func
     bt_conn_foreach(BT_CONN_TYPE_ALL, closeConnection, NULL);
+    BTPhyDisconnected(rmtphy);
 
     // Reset all BT channels to center
     for(int i = 0; i <BT_CHANNELS; i++)
@@ -539,10 +616,144 @@ const char * BTRmtGetAddress()
     return _address;
 }
 
+// (ms) Last time from a disconnect to channel data flowing again
+uint16_t BTRmtGetReconnectTime()
+{
+    return reconnecttime;
+}
+
+/* Cache saved as "XX:XX:XX:XX:XX:XX,type,fff6,fff6ccc,aff1,aff1ccc,aff2"
+ * Empty if there isn't one
+ */
+
+static void loadCache()
+{
+    btcache.valid = false;
+
+    const char *str = trkset.btCache();
+    if(strlen(str) < 18 || str[17] != ',')
+        return;
+
+    char addrstr[18];
+    memcpy(addrstr, str, 17);
+    addrstr[17] = 0;
+    if(bt_addr_from_str(addrstr, &btcache.addr.a))
+        return;
+
+    uint16_t vals[6];
+    const char *p = str + 18;
+    for(int i=0; i < 6; i++) {
+        char *end;
+        vals[i] = strtoul(p, &end, 10);
+        if(end == p)
+            return;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    btcache.addr.type = vals[0];
+    btcache.fff6 = vals[1];
+    btcache.fff6ccc = vals[2];
+    btcache.aff1 = vals[3];
+    btcache.aff1ccc = vals[4];
+    btcache.aff2 = vals[5];
+    btcache.valid = btcache.fff6 != 0 && btcache.fff6ccc != 0;
+}
+
+static void storeCache()
+{
+    if(!btcache.valid) {
+        trkset.setBTCache("");
+        return;
+    }
+
+    char addrstr[BT_ADDR_STR_LEN];
+    char str[TrackerSettings::BT_CACHE_LEN];
+    bt_addr_to_str(&btcache.addr.a, addrstr, sizeof(addrstr));
+    snprintf(str, sizeof(str), "%s,%u,%u,%u,%u,%u,%u", addrstr, btcache.addr.type,
+             btcache.fff6, btcache.fff6ccc, btcache.aff1, btcache.aff1ccc, btcache.aff2);
+    trkset.setBTCache(str);
+}
+
+/* Connects straight to the cached head. The controller only looks for
+ * that address, no advertising data has to be parsed. Gives up after
+ * BT_RECONNECT_TIMEOUT, the connected callback then starts a scan.
+ */
+
+static bool connectCached()
+{
+    if(!btcache.valid || btscanonly || pararmtconn)
+        return false;
+
+    // Paired to another device since
+    char addrstr[BT_ADDR_STR_LEN];
+    bt_addr_to_str(&btcache.addr.a, addrstr, sizeof(addrstr));
+    if(strlen(trkset.pairedBTAddress()) > 0 &&
+       strncmp(addrstr, trkset.pairedBTAddress(), 17) != 0)
+        return false;
+
+    struct bt_conn_le_create_param btconparm = {
+        .options = (BT_CONN_LE_OPT_NONE),
+        .interval = (0x0060),
+        .window = (0x0060),
+        .interval_coded = 0,
+        .window_coded = 0,
+        .timeout = BT_RECONNECT_TIMEOUT / 10, };
+
+    int err = bt_conn_le_create(&btcache.addr, &btconparm, rmtconparms, &pararmtconn);
+    if(err) {
+        LOGW("Unable to reconnect to %s (err %d)", addrstr, err);
+        return false;
+    }
+
+    LOGI("Reconnecting to %s", addrstr);
+    return true;
+}
+
+/* Subscribe using the cached handles. Reading the overrides checks they are
+ * right, without an override characteristic there's nothing to read. So if
+ * no channel data arrives within BT_CACHE_DATA_TIMEOUT, BTRmtExecute drops
+ * the cache as well
+ */
+static void subscribeCached(struct bt_conn *conn)
+{
+    LOGI("Using cached handles");
+
+    subscribefff6.notify = notify_func;
+    subscribefff6.value = BT_GATT_CCC_NOTIFY;
+    subscribefff6.value_handle = btcache.fff6;
+    subscribefff6.ccc_handle = btcache.fff6ccc;
+    int err = bt_gatt_subscribe(conn, &subscribefff6);
+    if (err && err != -EALREADY) {
+        LOGE("Subscribe failed (err %d)", err);
+        dropCache(conn);
+        return;
+    }
+    cachedsubtime = millis() | 1;
+
+    if(btcache.aff1 && btcache.aff1ccc) {
+        subscribeaff1.notify = over_notify_func;
+        subscribeaff1.value = BT_GATT_CCC_NOTIFY;
+        subscribeaff1.value_handle = btcache.aff1;
+        subscribeaff1.ccc_handle = btcache.aff1ccc;
+        err = bt_gatt_subscribe(conn, &subscribeaff1);
+        if (err && err != -EALREADY)
+            LOGE("Subscribe to overrides failed (err %d)", err);
+
+        rparm.handle_count = 1;
+        rparm.single.handle = btcache.aff1;
+        rparm.single.offset = 0;
+        bt_gatt_read(conn, &rparm);
+    }
+
+    if(btcache.aff2) {
+        contoheadboard = true;
+        buttonhandle = btcache.aff2;
+    }
+}
+
 int8_t BTRmtGetRSSI()
 {
-    // *** Implement
-    return -1;
+    return BTPhyRSSI();
 }
 
 
@@ -554,7 +765,7 @@ void btwrite_cb(bt_conn *conn, uint8_t err, bt_gatt_write_params *params){}
 
 void BTRmtSendButtonPress(bool longpress)
 {
-    if(!buttonattr)
+    if(!contoheadboard || buttonhandle == 0)
         return;
 
     if(longpress) {
@@ -581,7 +792,11 @@ void BTRmtSendButtonPress(bool longpress)
 
 void BTRmtExecute()
 {
-    // All Async, Nothing Here
+    // Subscribed with the cached handles but the head isn't sending
+    uint32_t subtime = cachedsubtime;
+    struct bt_conn *conn = pararmtconn;
+    if(subtime && conn && millis() - subtime > BT_CACHE_DATA_TIMEOUT)
+        dropCache(conn);
 }
 
 
@@ -10,52 +10,151 @@
 #include <device.h>
 #include <usb/usb_device.h>
 #include <usb/class/usb_hid.h>
+#include <string.h>
 #include "io.h"
+#include "defines.h"
+#include "trackersettings.h"
 
 static const struct device *hdev;
 
 #define JOYSTICK_BUTTONS
 #define JOYSTICK_BUTTON_HIGH 1750
 #define JOYSTICK_BUTTON_LOW 1250
+#define JOYSTICK_AXIS_MAX 1023
+#define JOYSTICK_CHANNELS 16
 
-struct {
+struct __packed joyreport {
 #ifdef JOYSTICK_BUTTONS
-    uint8_t but[2];
+    uint32_t but; // Two per channel, bit 2n is channel n high, 2n+1 low
 #endif
-    uint16_t channels[8];
-} report;
+    uint16_t channels[JOYSTICK_CHANNELS];
+};
+
+/* Reports go out as they change rather than on a schedule
+ *
+ *  The calc thread builds a report every cycle but only queues it if an axis
+ *  moved more than JOYSTICK_DEADBAND from what the host last got, or a button
+ *  changed. One report is in the endpoint at a time, when the host has taken
+ *  it int_in_ready sends whatever is newest. A change while the endpoint is
+ *  busy is never lost, it just goes out a poll later.
+ */
+
+static struct joyreport report;   // Newest, calc thread only
+static struct joyreport sent;     // Last one handed to the endpoint
+static struct joyreport txreport; // Being sent
+static volatile bool joypending=true; // report differs from sent
+static volatile bool joybusy=false;
+static volatile uint32_t joybusytime=0; // (ms)
+static volatile uint32_t joyreports=0;  // Completed since the last rate update
+static uint32_t joyratetime=0; // (ms)
+
+static bool joystickChanged(const struct joyreport &a, const struct joyreport &b);
+
+static void joystickSubmit()
+{
+    unsigned int key = irq_lock();
+    if(joybusy || !joypending) {
+        irq_unlock(key);
+        return;
+    }
+    txreport = report;
+    joypending = false;
+    joybusy = true;
+    joybusytime = millis();
+    irq_unlock(key);
+
+    // Not configured, suspended or the endpoint still has a report, it's
+    // tried again next cycle
+    if(hid_int_ep_write(hdev, (uint8_t*)&txreport, sizeof(txreport), NULL) != 0) {
+        joybusy = false;
+        joypending = true;
+        return;
+    }
+
+    // Only now does the host have it, a change meanwhile is compared to it
+    key = irq_lock();
+    sent = txreport;
+    joypending = joystickChanged(report, sent);
+    irq_unlock(key);
+}
+
+/* The host has taken the last report
+ *
+ *  Also called late for a report given up on after JOYSTICK_BUSY_TIMEOUT, if
+ *  the host takes it after all. That can't clear joybusy for a newer one, the
+ *  driver refuses a write while the endpoint still holds a report, so the
+ *  report in the endpoint is always the one that was taken
+ */
+static void joystickInReady(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+    joyreports++;
+    joybusy = false;
+    joystickSubmit();
+}
+
+static bool joystickChanged(const struct joyreport &a, const struct joyreport &b)
+{
+#ifdef JOYSTICK_BUTTONS
+    if(a.but != b.but)
+        return true;
+#endif
+    for(int i=0; i < JOYSTICK_CHANNELS; i++) {
+        int diff = (int)a.channels[i] - (int)b.channels[i];
+        if(diff > JOYSTICK_DEADBAND || diff < -JOYSTICK_DEADBAND)
+            return true;
+    }
+    return false;
+}
 
 void set_JoystickChannels(uint16_t chans[16])
 {
-    memcpy(report.channels, chans, sizeof(report.channels));
+    if(hdev == NULL)
+        return;
 
+    unsigned int key = irq_lock();
 #ifdef JOYSTICK_BUTTONS
-    report.but[0] = 0;
-    report.but[1] = 0;
+    report.but = 0;
 #endif
 
-    for(int i=0; i < 8 ; i++) {
-        if(report.channels[i] == 0) // If disabled, center it
-            report.channels[i] = 1500;
+    for(int i=0; i < JOYSTICK_CHANNELS ; i++) {
+        uint16_t ch = chans[i];
+        if(ch == 0) // If disabled, center it
+            ch = TrackerSettings::PPM_CENTER;
 
 #ifdef JOYSTICK_BUTTONS
-        if(report.channels[i] >= JOYSTICK_BUTTON_HIGH) {
-                report.but[0] |= 1<<(i * 2);
-                report.but[1] |= 1<<((i - 4) * 2);
-        }
-
-        if(report.channels[i] <= JOYSTICK_BUTTON_LOW) {
-                report.but[0] |= 1<<((i * 2) + 1);
-                report.but[1] |= 1<<(((i - 4) * 2) + 1);
-        }
+        if(ch >= JOYSTICK_BUTTON_HIGH)
+            report.but |= 1UL << (i * 2);
+        if(ch <= JOYSTICK_BUTTON_LOW)
+            report.but |= 1UL << (i * 2 + 1);
 #endif
 
-        report.channels[i] -= 988; // Shift from center so it's 0-1024
+        // Shift from center so it's 0-1023
+        int axis = (int)ch - 988;
+        report.channels[i] = MAX(MIN(axis, JOYSTICK_AXIS_MAX), 0);
     }
 
-    hid_int_ep_write(hdev, (uint8_t*)&report, sizeof(report), NULL);
+    if(joystickChanged(report, sent))
+        joypending = true;
+    irq_unlock(key);
+
+    // A report stuck in the endpoint from an unplug or a bus reset
+    if(joybusy && millis() - joybusytime > JOYSTICK_BUSY_TIMEOUT)
+        joybusy = false;
+
+    joystickSubmit();
+
+    // Reports the host actually took, per second
+    uint32_t now = millis();
+    if(now - joyratetime >= 1000) {
+        trkset.setHIDRate((uint64_t)joyreports * 1000 / (now - joyratetime));
+        joyreports = 0;
+        joyratetime = now;
+    }
 }
 
+// Channels 1-8 are Generic Desktop axes, 9-16 Simulation Controls. Windows
+// DirectInput shows at most 8 axes, only 1-8 reliably appear there
 static const uint8_t hid_report_desc[] = {
     0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
     0x09, 0x05,                    //     USAGE (Game Pad)
@@ -64,13 +163,16 @@ static const uint8_t hid_report_desc[] = {
 #ifdef JOYSTICK_BUTTONS
     0x05, 0x09,                    //         USAGE_PAGE (Button)
     0x19, 0x01,                    //         USAGE_MINIMUM (Button 1)
-    0x29, 0x10,                    //         USAGE_MAXIMUM (Button 8)
+    0x29, 0x20,                    //         USAGE_MAXIMUM (Button 32)
     0x15, 0x00,                    //         LOGICAL_MINIMUM (0)
     0x25, 0x01,                    //         LOGICAL_MAXIMUM (1)
-    0x95, 0x10,                    //         REPORT_COUNT (8)
+    0x95, 0x20,                    //         REPORT_COUNT (32)
     0x75, 0x01,                    //         REPORT_SIZE (1)
     0x81, 0x02,                    //         INPUT (Data,Var,Abs)
 #endif
+    0x16, 0x00, 0x00,              //         LOGICAL_MINIMUM (0)
+    0x26, 0xFF, 0x03,              //         LOGICAL_MAXIMUM (1023)
+    0x75, 0x10,                    //         REPORT_SIZE (16)
     0x05, 0x01,                    //         USAGE_PAGE (Generic Desktop)
     0x09, 0x30,                    //         USAGE (X)
     0x09, 0x31,                    //         USAGE (Y)
@@ -79,16 +181,26 @@ static const uint8_t hid_report_desc[] = {
     0x09, 0x34,                    //         USAGE (Ry)
     0x09, 0x35,                    //         USAGE (Rz)
     0x09, 0x36,                    //         USAGE (Slider)
-    0x09, 0x36,                    //         USAGE (Slider)
-    0x16, 0x00, 0x00,              //         LOGICAL_MINIMUM (0)
-    0x26, 0xFF, 0x03,              //         LOGICAL_MAXIMUM (1024)
-    0x75, 0x10,                    //         REPORT_SIZE (16)
+    0x09, 0x37,                    //         USAGE (Dial)
+    0x95, 0x08,                    //         REPORT_COUNT (8)
+    0x81, 0x02,                    //         INPUT (Data,Var,Abs)
+    0x05, 0x02,                    //         USAGE_PAGE (Simulation Controls)
+    0x09, 0xb0,                    //         USAGE (Aileron)
+    0x09, 0xb8,                    //         USAGE (Elevator)
+    0x09, 0xba,                    //         USAGE (Rudder)
+    0x09, 0xbb,                    //         USAGE (Throttle)
+    0x09, 0xc4,                    //         USAGE (Accelerator)
+    0x09, 0xc5,                    //         USAGE (Brake)
+    0x09, 0xc6,                    //         USAGE (Clutch)
+    0x09, 0xc8,                    //         USAGE (Steering)
     0x95, 0x08,                    //         REPORT_COUNT (8)
     0x81, 0x02,                    //         INPUT (Data,Var,Abs)
     0xc0,                          //       END_COLLECTION
     0xc0                           //     END_COLLECTION
 };
 
+static struct hid_ops hidops;
+
 void joystick_init(void)
 {
 #ifndef CONFIG_USB_DEVICE_HID
@@ -100,8 +212,9 @@ void joystick_init(void)
 		return;
 	}
 
+	hidops.int_in_ready = joystickInReady;
 	usb_hid_register_device(hdev, hid_report_desc, sizeof(hid_report_desc),
-				NULL);
+				&hidops);
 
     usb_hid_init(hdev);
 
@@ -33,13 +33,14 @@
 #include "log.h"
 #include "soc_flash.h"
 #include "trackersettings.h"
+#include "telemetry.h"
 
 // Wait for serial connection before starting..
 //#define WAITFOR_DTR
 
 void serialrx_Process();
 char* getJSONBuffer();
-void parseData(DynamicJsonDocument &json);
+void parseData(DynamicJsonDocument &json, transportt from);
 uint16_t escapeCRC(uint16_t crc);
 int buffersFilled();
 
@@ -55,10 +56,13 @@ K_MUTEX_DEFINE(ring_tx_mutex);
 K_MUTEX_DEFINE(ring_rx_mutex);
 
 // JSON Data
-char jsonbuffer[JSON_BUF_SIZE];
-char *jsonbufptr = jsonbuffer;
+static jsonframer usbframer;
+static jsonframer bleframer;
 DynamicJsonDocument json(JSON_BUF_SIZE);
 
+// Transport the GUI last sent a command on, live data goes there
+static volatile transportt uitransport = TRANSPORT_USB;
+
 // Mutex to protect Sense & Data Writes
 K_MUTEX_DEFINE(data_mutex);
 
@@ -144,10 +148,43 @@ void serial_init()
 }
 
 
+// Measured USB throughput, sizes the live data so it never overflows the TX ring
+static float linkrate = DATA_LINK_RATE_DEF; // (bytes/s)
+static uint32_t linksent = 0;               // Bytes sent this window
+static bool linksaturated = false;          // Host didn't take all that was offered this window
+static int64_t linkwindow = 0;
+static float databytes = 0;                 // Bytes live data can send now
+
+// (bytes/s) Throughput of the link the GUI is on
+static float uiLinkRate()
+{
+  return uitransport == TRANSPORT_BLE ? DATA_BLE_RATE : linkrate;
+}
+
+// Called once a second, update the throughput estimate and data budget
+static void linkRateUpdate(int64_t curtime)
+{
+  if(curtime - linkwindow < 1000)
+    return;
+
+  float measured = (float)linksent * 1000.0f / (curtime - linkwindow);
+  if(linksaturated)
+    linkrate = (linkrate + measured) / 2.0f; // Host is the limit, this is the real rate
+  else
+    linkrate = MAX(linkrate, measured) * 1.1f; // Wasn't limited, allow a little more
+  linkrate = MAX(MIN(linkrate, DATA_LINK_RATE_MAX), DATA_LINK_RATE_MIN);
+
+  linksent = 0;
+  linksaturated = false;
+  linkwindow = curtime;
+
+  trkset.setDataBudget(uiLinkRate() * DATA_LINK_BUDGET);
+}
+
 void serial_Thread()
 {
-  uint8_t buffer[64];
-  static uint32_t datacounter=0;
+  static uint32_t tlmseq=0;
+  static TelemetryFrame tlmframe;
 
   while(1) {
     rt_sleep_ms(SERIAL_PERIOD);
@@ -168,8 +205,10 @@ void serial_Thread()
     if (dtr && !new_dtr) {
       ring_buf_reset(&ringbuf_tx);
       uart_tx_abort(dev);
-      uiResponsive = k_uptime_get() - 1;
-      trkset.stopAllData();
+      if(uitransport == TRANSPORT_USB) {
+        uiResponsive = k_uptime_get() - 1;
+        trkset.stopAllData();
+      }
     }
 
     // gaining new connection
@@ -186,16 +225,23 @@ void serial_Thread()
       }*/
     }
 
-    // Port is now open or still open, send data
+    // Port is now open or still open, send as much as the host will take.
+    // Anything it doesn't stays in the ring for next time
     if ((new_dtr || dtr ) && uiconnected) {
-      int rb_len = ring_buf_get(&ringbuf_tx, buffer, sizeof(buffer));
-      if(rb_len) {
-        int send_len = uart_fifo_fill(dev, buffer, rb_len);
-        if (send_len < rb_len) {
-          LOG_ERR("USB CDC Ring Buffer Full, Dropped data");
+      uint8_t *txdata;
+      uint32_t claimed;
+      while((claimed = ring_buf_get_claim(&ringbuf_tx, &txdata, TX_RNGBUF_SIZE)) > 0) {
+        int send_len = uart_fifo_fill(dev, txdata, claimed);
+        send_len = MAX(send_len, 0);
+        ring_buf_get_finish(&ringbuf_tx, send_len);
+        linksent += send_len;
+        if ((uint32_t)send_len < claimed) {
+          linksaturated = true;
+          break;
         }
       }
     }
+    int txspace = ring_buf_space_get(&ringbuf_tx);
     k_mutex_unlock(&ring_tx_mutex);
     dtr = new_dtr;
 
@@ -204,63 +250,115 @@ void serial_Thread()
     digitalWrite(LEDG,HIGH);
 
     // Data output
-    if(datacounter++ >= DATA_PERIOD) {
-        datacounter = 0;
-        // Is the UI Still responsive?
-        int64_t curtime = k_uptime_get();
-
-        // TODO we can probably remove or utilize this test alongside dtr transitions
-        if(uiResponsive > curtime) {
-          uiconnected = true;
-
-          // If sense thread is writing, wait until complete
-          k_mutex_lock(&data_mutex, K_FOREVER);
-          json.clear();
-          trkset.setJSONData(json);
-          if(json.size()) {
-            json["Cmd"] = "Data";
-            serialWriteJSON(json);
-          }
-          k_mutex_unlock(&data_mutex);
-
-        } else {
-            uiconnected = false;
+    // Is the UI Still responsive?
+    int64_t curtime = k_uptime_get();
+
+    // TODO we can probably remove or utilize this test alongside dtr transitions
+    if(uiResponsive > curtime) {
+      uiconnected = true;
+      linkRateUpdate(curtime);
+
+      // Over BLE the notify ring is what fills up
+      if(uitransport == TRANSPORT_BLE)
+        txspace = BTJSONSpace();
+
+      // Bytes live data can use this period, a share of the link and never more than the TX ring has free
+      float budget = uiLinkRate() * DATA_LINK_BUDGET;
+      databytes = MIN(databytes + budget * SERIAL_PERIOD / 1000.0f, budget * DATA_LINK_BURST);
+      int maxbytes = MIN((int)databytes, txspace - DATA_TX_RESERVE);
+      maxbytes = MIN(maxbytes, TX_RNGBUF_SIZE - DATA_TX_RESERVE) - DATA_FRAME_OVERHEAD;
+
+      if(maxbytes > 0) {
+        // Newest frame from the calculate thread, skipped ones aren't needed here
+        bool newframe = telemetry.readLatest(tlmframe, tlmseq) >= 0;
+
+        // Protects the settings + json from a BLE config write
+        k_mutex_lock(&data_mutex, K_FOREVER);
+        if(newframe)
+          trkset.setTelemetry(tlmframe);
+        trkset.setBLEAddress(BTGetAddress());
+        trkset.setBLENotifyStats(BTGetNotifyLatency(), BTGetNotifyQueue());
+        uint16_t phypkt[BT_PHY_STAT_CNT], phylate[BT_PHY_STAT_CNT];
+        BTGetPhyStats(phypkt, phylate);
+        trkset.setBLEPhyStats(BTGetPhy(), BTGetRSSI(), phypkt, phylate);
+        trkset.setBLEReconnectTime(BTGetReconnectTime());
+        uint16_t peerrate[BT_MAX_PEERS], peerlat[BT_MAX_PEERS];
+        uint8_t peers = BTGetPeerStats(peerrate, peerlat);
+        trkset.setBLEPeerStats(peers, peerrate, peerlat);
+        json.clear();
+        trkset.setJSONData(json, maxbytes);
+        if(json.size()) {
+          json["Cmd"] = "Data";
+          int sent = serialWriteJSON(json, uitransport);
+          if(sent == 0) // Didn't fit, the deltas would be against a frame the GUI never got
+            trkset.dataResync();
+          databytes -= sent;
         }
+        k_mutex_unlock(&data_mutex);
+      }
+
+    } else {
+      uiconnected = false;
+      databytes = 0;
     }
   }
 }
 
 void serialrx_Process()
 {
-  char sc=0;
+  char buffer[64];
+  int len;
 
-  // Get byte by byte data from the serial receive ring buffer
+  // Get the data from the serial receive ring buffer
   k_mutex_lock(&ring_rx_mutex, K_FOREVER);
-  while(ring_buf_get(&ringbuf_rx,(uint8_t*)&sc,1))
-  {
+  while((len = ring_buf_get(&ringbuf_rx, (uint8_t*)buffer, sizeof(buffer))) > 0)
+    JSON_Receive(usbframer, buffer, len, TRANSPORT_USB);
+  k_mutex_unlock(&ring_rx_mutex);
+
+  // Writes queued by the BT stack
+  while((len = BTJSONRead(buffer, sizeof(buffer))) > 0)
+    JSON_Receive(bleframer, buffer, len, TRANSPORT_BLE);
+}
+
+// Same framing on every transport, only complete frames are processed
+void JSON_Receive(jsonframer &frm, const char *data, int len, transportt from)
+{
+  for(int i=0; i < len; i++) {
+    char sc = data[i];
     if(sc == 0x02) {  // Start Of Text Character, clear buffer
-      jsonbufptr = jsonbuffer; // Reset Buffer
+      frm.ptr = frm.buffer;
+      frm.started = true;
 
     } else if (sc == 0x03) { // End of Text Characher, parse JSON data
-      *jsonbufptr = 0; // Null terminate
-      JSON_Process(jsonbuffer);
-      jsonbufptr = jsonbuffer; // Reset Buffer
-    } else {
+      if(frm.started) {
+        *frm.ptr = 0; // Null terminate
+        JSON_Process(frm.buffer, from);
+      }
+      frm.started = false;
+
+    } else if (frm.started) {
       // Check how much free data is in the buffer
-      if(jsonbufptr >= jsonbuffer + sizeof(jsonbuffer) - 3) {
+      if(frm.ptr >= frm.buffer + sizeof(frm.buffer) - 3) {
         LOGE("Error JSON data too long, overflow");
-        jsonbufptr = jsonbuffer; // Reset Buffer
+        frm.started = false;
 
       // Add data to buffer
       } else {
-          *(jsonbufptr++) = sc;
+        *(frm.ptr++) = sc;
       }
     }
   }
-  k_mutex_unlock(&ring_rx_mutex);
 }
 
-void JSON_Process(char *jsonbuf)
+// Raw write to a transport, returns bytes queued
+static int transportWrite(transportt to, const char *data, int len)
+{
+  if(to == TRANSPORT_BLE)
+    return BTJSONWrite(data, len);
+  return serialWrite(data, len);
+}
+
+void JSON_Process(char *jsonbuf, transportt from)
 {
   // CRC Check Data
   int len = strlen(jsonbuf);
@@ -268,11 +366,11 @@ void JSON_Process(char *jsonbuf)
     k_mutex_lock(&ring_tx_mutex, K_FOREVER);
     uint16_t calccrc = escapeCRC(uCRC16Lib::calculate(jsonbuf,len-sizeof(uint16_t)));
     if(calccrc != *(uint16_t*)(jsonbuf+len-sizeof(uint16_t))) {
-      serialWrite("\x15\r\n"); // Not-Acknowledged
+      transportWrite(from, "\x15\r\n", 3); // Not-Acknowledged
       k_mutex_unlock(&ring_tx_mutex);
       return;
     } else {
-      serialWrite("\x06\r\n"); // Acknowledged
+      transportWrite(from, "\x06\r\n", 3); // Acknowledged
     }
     // Remove CRC from end of buffer
     jsonbuf[len-sizeof(uint16_t)] = 0;
@@ -294,15 +392,15 @@ void JSON_Process(char *jsonbuf)
           LOGE("DeserializeJson() Failed - Other");
     } else {
       // Parse The JSON Data in dataparser.cpp
-      parseData(json);
+      parseData(json, from);
     }
     k_mutex_unlock(&data_mutex);
     k_mutex_unlock(&ring_tx_mutex);
   }
 }
 
-// New JSON data received from the PC
-void parseData(DynamicJsonDocument &json)
+// New JSON data received from the PC, replies go back to where it came from
+void parseData(DynamicJsonDocument &json, transportt from)
 {
   JsonVariant v = json["Cmd"];
   if(v.isNull()) {
@@ -313,6 +411,12 @@ void parseData(DynamicJsonDocument &json)
   // For strcmp;
   const char *command = v;
 
+  // GUI moved to another transport, start the live data over
+  if(uitransport != from) {
+    trkset.stopAllData();
+    uitransport = from;
+  }
+
   // Reset Center
   if(strcmp(command,"RstCnt") == 0) {
     // TODO we should also log when the button on the device issues a Reset Center
@@ -349,7 +453,7 @@ void parseData(DynamicJsonDocument &json)
     json.clear();
     trkset.setJSONSettings(json);
     json["Cmd"] = "Set";
-    serialWriteJSON(json);
+    serialWriteJSON(json, from);
 
   // Im Here Received, Means the GUI is running
   } else if (strcmp(command, "IH") == 0) {
@@ -360,7 +464,7 @@ void parseData(DynamicJsonDocument &json)
     json.clear();
     trkset.setJSONDataList(json);
     json["Cmd"] = "DataList";
-    serialWriteJSON(json);
+    serialWriteJSON(json, from);
 
   // Stop All Data Items
   } else if (strcmp(command, "D--") == 0) {
@@ -372,10 +476,21 @@ void parseData(DynamicJsonDocument &json)
     LOGI("Data Added/Remove");
     // using C++11 syntax (preferred):
     JsonObject root = json.as<JsonObject>();
+    // Either true/false for the default rate, the rate in hz (0 to stop)
+    // or {"hz":rate,"db":deadband}
     for (JsonPair kv : root) {
       if(kv.key() == "Cmd")
         continue;
-      trkset.setDataItemSend(kv.key().c_str(),kv.value().as<bool>());
+      JsonVariant v = kv.value();
+      if(v.is<bool>()) {
+        trkset.setDataItemSend(kv.key().c_str(), v.as<bool>());
+      } else if(v.is<JsonObject>()) {
+        float rate = v["hz"] | 0.0f;
+        float deadband = v["db"] | 0.0f;
+        trkset.setDataItemSend(kv.key().c_str(), true, MAX(rate, 0), deadband);
+      } else {
+        trkset.setDataItemSend(kv.key().c_str(), v.as<float>() > 0, MAX(v.as<float>(), 0));
+      }
     }
 
   // Firmware Reqest
@@ -385,7 +500,7 @@ void parseData(DynamicJsonDocument &json)
     fwjson["Vers"] = FW_VERSION;
     fwjson["Hard"] = FW_BOARD;
     fwjson["Git"] = STRINGIFY(FW_GIT_REV);
-    serialWriteJSON(fwjson);
+    serialWriteJSON(fwjson, from);
 
   // Unknown Command
   } else {
@@ -418,14 +533,14 @@ uint16_t escapeCRC(uint16_t crc)
   return (uint16_t)crclow | ((uint16_t)crchigh << 8);
 }
 
-// Base write function.
+// Base write function. Returns bytes queued, 0 if dropped
 
-void serialWrite(const char *data, int len)
+int serialWrite(const char *data, int len)
 {
   k_mutex_lock(&ring_tx_mutex, K_FOREVER);
   if(ring_buf_space_get(&ringbuf_tx) < (uint32_t)len) { // Not enough room, drop it.
     k_mutex_unlock(&ring_tx_mutex);
-    return;
+    return 0;
   }
   int rb_len = ring_buf_put(&ringbuf_tx,(uint8_t *) data, len);
   k_mutex_unlock(&ring_tx_mutex);
@@ -433,12 +548,13 @@ void serialWrite(const char *data, int len)
     // TODO: deal with this case
     __NOP();
   }
+  return rb_len;
 }
 
-void serialWrite(const char *data)
+int serialWrite(const char *data)
 {
   // Append Output to the serial output buffer
-  serialWrite(data, strlen(data));
+  return serialWrite(data, strlen(data));
 }
 
 int serialWriteF(const char *format, ...)
@@ -452,8 +568,14 @@ int serialWriteF(const char *format, ...)
   return len;
 }
 
+int serialWriteJSON(DynamicJsonDocument &json)
+{
+  return serialWriteJSON(json, TRANSPORT_USB);
+}
+
 // FIX Me to Not use as Much Stack.
-void serialWriteJSON(DynamicJsonDocument &json)
+// Returns bytes queued, 0 if it didn't fit
+int serialWriteJSON(DynamicJsonDocument &json, transportt to)
 {
   char data[TX_RNGBUF_SIZE];
 
@@ -463,7 +585,7 @@ void serialWriteJSON(DynamicJsonDocument &json)
 
   if(br + 7 > TX_RNGBUF_SIZE) {
     k_mutex_unlock(&ring_tx_mutex);
-    return;
+    return 0;
   }
 
   data[0] = 0x02;
@@ -473,6 +595,7 @@ void serialWriteJSON(DynamicJsonDocument &json)
   data[br+4] = '\r';
   data[br+5] = '\n';
 
-  serialWrite(data, br+6);
+  int len = transportWrite(to, data, br+6);
   k_mutex_unlock(&ring_tx_mutex);
+  return len;
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "ble.h"
+#include "snapshotring.h"
+
+// Frames kept, a reader slower than this many calculate periods will skip frames
+#define TELEMETRY_RING_SIZE 8
+
+/* Snapshot of everything the calculate thread produces in a cycle
+ *  Published once per cycle without blocking. USB, Bluetooth, etc. read it at
+ *  their own rate. Plain data only, it is memcpy'd in and out of the ring.
+ */
+
+struct TelemetryFrame {
+    uint32_t time; // (us) When the frame was built
+
+    // Raw & offset sensor data
+    float raccx, raccy, raccz;
+    float rgyrx, rgyry, rgyrz;
+    float rmagx, rmagy, rmagz;
+    float accx, accy, accz;
+    float gyrx, gyry, gyrz;
+    float magx, magy, magz;
+
+    // Orientation
+    float tilt, roll, pan;
+    float tiltoff, rolloff, panoff;
+    float quat[4];
+
+    // Channels
+    uint16_t tiltout, rollout, panout;
+    uint16_t ppmch[16];
+    uint16_t sbusch[16];
+    uint16_t btch[BT_CHANNELS];
+    uint16_t chout[16];
+
+    bool trpenabled;
+    bool gyroCal;
+    bool btcon;
+
+    uint16_t fusioncyc; // CPU cycles of the fusion update, saturates
+    bool magdist;       // Mag field disturbed, heading from the gyro only
+};
+
+extern snapshotring<TelemetryFrame, TELEMETRY_RING_SIZE> telemetry;
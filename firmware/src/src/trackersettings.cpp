@@ -25,6 +25,7 @@
 #include "sense.h"
 #include "base64.h"
 #include "SBUS/sbus.h"
+#include "telemetry.h"
 
 #include "trackersettings.h"
 
@@ -57,6 +58,17 @@ TrackerSettings::TrackerSettings()
     // Low Pass Filter
     lppan = DEF_LP_PAN;
     lptiltroll = DEF_LP_TLTRLL;
+    lpmode = DEF_LP_MODE;
+    lpmincut = DEF_LP_MINCUT;
+    lpslope = DEF_LP_SLOPE;
+    predict = DEF_PREDICT;
+    fusion = DEF_FUSION;
+    imuodr = DEF_IMU_ODR;
+    gyrobw = DEF_GYRO_BW;
+    gyrofs = DEF_GYRO_FS;
+    accfs = DEF_ACC_FS;
+    magodr = DEF_MAG_ODR;
+    fusiondiv = DEF_FUSION_DIV;
 
     // Sensor Offsets
     magxoff=0; magyoff=0; magzoff=0;
@@ -79,8 +91,32 @@ TrackerSettings::TrackerSettings()
     #undef DA
 
     // Default data outputs, Pan,Tilt,Roll outputs and Inputs for Graph and Output bars
-    senddatavars = 0;
-    senddataarray = 0;
+    senddata = 0;
+    datascale = 1.0f;
+    datastart = 0;
+    for(int i=0; i < DATA_ITEM_CNT; i++) {
+        datareqrate[i] = 0;
+        datanext[i] = 0;
+        datalast[i] = 0;
+        datadeadband[i] = 0;
+    }
+    for(int i=0; i < DATA_VAR_CNT; i++)
+        datalastval[i] = 0;
+    for(int i=0; i < DATA_ARRAY_CNT; i++)
+        datafull[i] = 0;
+
+    // Estimated JSON size of each item, "name":value,
+    int id=0;
+    #define DV(DT, NAME, DIV, ROUND)\
+        datasize[id++] = sizeof(#NAME) + 3 + (ROUND == -1 ? 5 : 9);
+        DATA_VARS
+    #undef DV
+
+    // "6nameTYP":"base64",
+    #define DA(DT, NAME, SIZE, DIV)\
+        datasize[id++] = sizeof(#NAME) + 4 + 5 + ((sizeof(DT) * SIZE + 2) / 3) * 4;
+        DATA_ARRAYS
+    #undef DA
 
     // PPM Defaults
     ppmoutpin = DEF_PPM_OUT;
@@ -105,6 +141,9 @@ TrackerSettings::TrackerSettings()
     sbininv = DEF_SBUS_IN_INV;
     sboutinv = DEF_SBUS_OUT_INV;
     sbrate = DEF_SBUS_RATE;
+    sbhwtimed = DEF_SBUS_HW_TIMED;
+
+    setversion = 1; // Anything built from settings starts at 0, forces a first build
 
     // Analog defaults
     an4ch = DEF_ALG_A4_CH;
@@ -130,11 +169,14 @@ TrackerSettings::TrackerSettings()
 
     // Bluetooth defaults
     btmode = 0;
+    btonchange = false;
     btcon = false;
     btpairedaddress[0] = 0;
+    btcache[0] = 0;
 
     // Serial Defaults
-    sermode = 0;
+    sermode = SERMODE_SBUS;
+    mavgimdev = DEF_MAV_GIMBAL_DEVICE;
 
     // Features defaults
     rstonwave = false;
@@ -338,6 +380,72 @@ void TrackerSettings::setLPPan(int value)
     lppan = value;
 }
 
+void TrackerSettings::setLPMode(int value)
+{
+    if(value == LP_MODE_FIXED || value == LP_MODE_ADAPTIVE)
+        lpmode = value;
+}
+
+void TrackerSettings::setLPMinCutoff(float value)
+{
+    if(value >= MIN_LP_MINCUT && value <= MAX_LP_MINCUT)
+        lpmincut = value;
+}
+
+void TrackerSettings::setLPSlope(float value)
+{
+    if(value >= 0 && value <= MAX_LP_SLOPE)
+        lpslope = value;
+}
+
+void TrackerSettings::setPredictTime(int ms)
+{
+    if(ms >= 0 && ms <= MAX_PREDICT)
+        predict = ms;
+}
+
+void TrackerSettings::setFusionEngine(int value)
+{
+    if(value >= FUSION_MADGWICK && value <= FUSION_ESKF)
+        fusion = value;
+}
+
+void TrackerSettings::setIMUODR(int hz)
+{
+    if(hz == 119 || hz == 238 || hz == 476)
+        imuodr = hz;
+}
+
+void TrackerSettings::setGyroBW(int value)
+{
+    if(value >= 0 && value <= 3)
+        gyrobw = value;
+}
+
+void TrackerSettings::setGyroFS(int dps)
+{
+    if(dps == 245 || dps == 500 || dps == 2000)
+        gyrofs = dps;
+}
+
+void TrackerSettings::setAccFS(int g)
+{
+    if(g == 2 || g == 4 || g == 8 || g == 16)
+        accfs = g;
+}
+
+void TrackerSettings::setMagODR(int hz)
+{
+    if(hz == 20 || hz == 40 || hz == 80)
+        magodr = hz;
+}
+
+void TrackerSettings::setFusionDivider(int value)
+{
+    if(value >= 1 && value <= MAX_FUSION_DIV)
+        fusiondiv = value;
+}
+
 char TrackerSettings::servoReverse() const
 {
     return servoreverse;
@@ -528,19 +636,19 @@ void TrackerSettings::setAuxFunc2Ch(int channel)
 
 void TrackerSettings::setAuxFunc0(int funct)
 {
-    if((funct >= AUX_GYRX && funct <= BT_RSSI) || funct == -1)
+    if((funct >= AUX_GYRX && funct <= CRSF_LQ) || funct == -1)
         aux0func = funct;
 }
 
 void TrackerSettings::setAuxFunc1(int funct)
 {
-    if((funct >= AUX_GYRX && funct <= BT_RSSI) || funct == -1)
+    if((funct >= AUX_GYRX && funct <= CRSF_LQ) || funct == -1)
         aux1func = funct;
 }
 
 void TrackerSettings::setAuxFunc2(int funct)
 {
-    if((funct >= AUX_GYRX && funct <= BT_RSSI) || funct == -1)
+    if((funct >= AUX_GYRX && funct <= CRSF_LQ) || funct == -1)
         aux2func = funct;
 }
 
@@ -646,6 +754,16 @@ void TrackerSettings::setPairedBTAddress(const char *ha)
     strncpy(btpairedaddress, ha, sizeof(btpairedaddress));
 }
 
+// Remote's last head + handles, only used by the BT code. Set from the BT
+// thread, locked so a settings read or flash save never sees half of it
+void TrackerSettings::setBTCache(const char *cache)
+{
+    k_mutex_lock(&data_mutex, K_FOREVER);
+    strncpy(btcache, cache, sizeof(btcache) - 1);
+    btcache[sizeof(btcache) - 1] = 0;
+    k_mutex_unlock(&data_mutex);
+}
+
 const char * TrackerSettings::pairedBTAddress()
 {
     return btpairedaddress;
@@ -677,6 +795,37 @@ void TrackerSettings::setBLEAddress(const char *addr)
     strcpy(btaddr, addr);
 }
 
+void TrackerSettings::setBLENotifyStats(uint16_t latency, uint8_t queue)
+{
+    btlatency = latency;
+    btqueue = queue;
+}
+
+void TrackerSettings::setBLEReconnectTime(uint16_t ms)
+{
+    btreconn = ms;
+}
+
+void TrackerSettings::setHIDRate(uint16_t hz)
+{
+    hidrate = hz;
+}
+
+void TrackerSettings::setBLEPeerStats(uint8_t count, uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS])
+{
+    btpeers = count;
+    memcpy(btpeerrate, rate, sizeof(btpeerrate));
+    memcpy(btpeerlat, latency, sizeof(btpeerlat));
+}
+
+void TrackerSettings::setBLEPhyStats(uint8_t phy, int8_t rssi, uint16_t packets[3], uint16_t late[3])
+{
+    btphy = phy;
+    btrssi = rssi;
+    memcpy(btphypkt, packets, sizeof(btphypkt));
+    memcpy(btphylate, late, sizeof(btphylate));
+}
+
 void TrackerSettings::setDiscoveredBTHead(const char *addr)
 {
     strcpy(btrmt, addr);
@@ -768,6 +917,30 @@ void TrackerSettings::setQuaternion(float q[4])
     memcpy(quat, q,sizeof(float)*4);
 }
 
+// Copies a frame from the calculate thread into the data items
+void TrackerSettings::setTelemetry(const TelemetryFrame &f)
+{
+    setRawAccel(f.raccx, f.raccy, f.raccz);
+    setRawGyro(f.rgyrx, f.rgyry, f.rgyrz);
+    setRawMag(f.rmagx, f.rmagy, f.rmagz);
+    setOffAccel(f.accx, f.accy, f.accz);
+    setOffGyro(f.gyrx, f.gyry, f.gyrz);
+    setOffMag(f.magx, f.magy, f.magz);
+    setRawOrient(f.tilt, f.roll, f.pan);
+    setOffOrient(f.tiltoff, f.rolloff, f.panoff);
+    setPPMOut(f.tiltout, f.rollout, f.panout);
+    memcpy(ppmch, f.ppmch, sizeof(ppmch));
+    memcpy(sbusch, f.sbusch, sizeof(sbusch));
+    memcpy(btch, f.btch, sizeof(btch));
+    memcpy(chout, f.chout, sizeof(chout));
+    memcpy(quat, f.quat, sizeof(quat));
+    trpenabled = f.trpenabled;
+    gyroCal = f.gyroCal;
+    btcon = f.btcon;
+    fusioncyc = f.fusioncyc;
+    magdist = f.magdist;
+}
+
 //--------------------------------------------------------------------------------------
 // Send and receive the data from PC
 // Takes the JSON and loads the settings into the local class
@@ -807,10 +980,25 @@ void TrackerSettings::loadJSONSettings(DynamicJsonDocument &json)
 // Misc Gains
     v = json["lppan"];              if(!v.isNull()) setLPPan(v);
     v = json["lptiltroll"];         if(!v.isNull()) setLPTiltRoll(v);
+    v = json["lpmode"];             if(!v.isNull()) setLPMode(v);
+    v = json["lpmincut"];           if(!v.isNull()) setLPMinCutoff(v);
+    v = json["lpslope"];            if(!v.isNull()) setLPSlope(v);
+    v = json["predict"];            if(!v.isNull()) setPredictTime(v);
+    v = json["fusion"];             if(!v.isNull()) setFusionEngine(v);
+
+// IMU
+    v = json["imuodr"];             if(!v.isNull()) setIMUODR(v);
+    v = json["gyrobw"];             if(!v.isNull()) setGyroBW(v);
+    v = json["gyrofs"];             if(!v.isNull()) setGyroFS(v);
+    v = json["accfs"];              if(!v.isNull()) setAccFS(v);
+    v = json["magodr"];             if(!v.isNull()) setMagODR(v);
+    v = json["fusiondiv"];          if(!v.isNull()) setFusionDivider(v);
 
 // Bluetooth
     v = json["btmode"]; if(!v.isNull()) setBlueToothMode(v);
     v = json["btpair"]; if(!v.isNull()) setPairedBTAddress(v);
+    v = json["btonchange"]; if(!v.isNull()) setBTNotifyOnChange(v);
+    v = json["btcache"]; if(!v.isNull()) setBTCache(v);
 
 // Orientation
    v = json["rotx"]; if(!v.isNull()) setOrientation(v,roty,rotz);
@@ -868,10 +1056,15 @@ void TrackerSettings::loadJSONSettings(DynamicJsonDocument &json)
     v = json["pwm2"]; if(!v.isNull()) setPWMCh(2,v);
     v = json["pwm3"]; if(!v.isNull()) setPWMCh(3,v);
 
+// Serial Mode
+    v = json["sermode"]; if(!v.isNull()) setSerialMode(v);
+    v = json["mavgimdev"]; if(!v.isNull()) setMAVGimbalDevice(v);
+
 // SBUS Settings
     v = json["sbininv"]; if(!v.isNull()) setInvertedSBUSIn(v);
     v = json["sboutinv"]; if(!v.isNull()) setInvertedSBUSOut(v);
     v = json["sbrate"]; if(!v.isNull()) setSBUSRate(v);
+    v = json["sbhwtimed"]; if(!v.isNull()) setSBUSHWTimed(v);
 
 // Analog Settings
     v = json["an4ch"]; if(!v.isNull()) setAnalog4Ch(v);
@@ -942,6 +1135,9 @@ void TrackerSettings::loadJSONSettings(DynamicJsonDocument &json)
     {
         setAccOffset(v,v1,v2);
     }
+
+    // Let the calculate thread know to rebuild anything derived from the settings
+    setversion++;
 }
 
 void TrackerSettings::setJSONSettings(DynamicJsonDocument &json)
@@ -974,6 +1170,19 @@ void TrackerSettings::setJSONSettings(DynamicJsonDocument &json)
 // Gains
     json["lppan"] = lppan;
     json["lptiltroll"] = lptiltroll;
+    json["lpmode"] = lpmode;
+    json["lpmincut"] = lpmincut;
+    json["lpslope"] = lpslope;
+    json["predict"] = predict;
+    json["fusion"] = fusion;
+
+// IMU
+    json["imuodr"] = imuodr;
+    json["gyrobw"] = gyrobw;
+    json["gyrofs"] = gyrofs;
+    json["accfs"] = accfs;
+    json["magodr"] = magodr;
+    json["fusiondiv"] = fusiondiv;
 
 // Pins
     json["ppminpin"] = ppminpin;
@@ -1002,11 +1211,13 @@ void TrackerSettings::setJSONSettings(DynamicJsonDocument &json)
 
 // Serial Mode
     json["sermode"] = sermode;
+    json["mavgimdev"] = mavgimdev;
 
 // SBUS Settings
     json["sbininv"] = sbininv;
     json["sboutinv"] = sboutinv;
     json["sbrate"] = sbrate;
+    json["sbhwtimed"] = sbhwtimed;
 
 // Analog Settings
     json["an4ch"] = an4ch;
@@ -1033,6 +1244,8 @@ void TrackerSettings::setJSONSettings(DynamicJsonDocument &json)
 // Bluetooth Settings
     json["btmode"] = btmode;
     json["btpair"] = btpairedaddress;
+    json["btonchange"] = btonchange;
+    json["btcache"] = btcache;
 
 // Proximity Setting
     json["rstonwave"] = rstonwave;
@@ -1107,35 +1320,66 @@ void TrackerSettings::loadFromEEPROM()
     k_mutex_unlock(&data_mutex);
 }
 
-/* Sets if a data item should be included while in data to GUI
- */
-
-void TrackerSettings::setDataItemSend(const char *var, bool enabled)
-{
-    int id=0;
-
-    // Macro Expansion for Data Variables + Arrays
-    #define DV(DT, NAME, DIV, ROUND)\
-    if(strcmp(var,#NAME)==0)\
-    {\
-        enabled==true?senddatavars|=1<<id:senddatavars&=~(1<<id);\
-        return;\
-    }\
-    id++;
+// Names and update divisors of the data items, variables then arrays
+static const char * const dataItemNames[] = {
+    #define DV(DT, NAME, DIV, ROUND) #NAME,
         DATA_VARS
     #undef DV
+    #define DA(DT, NAME, SIZE, DIV) #NAME,
+        DATA_ARRAYS
+    #undef DA
+};
 
-    id=0;
-
-    #define DA(DT, NAME, SIZE, DIV)\
-    if(strcmp(var,#NAME)==0)\
-    {\
-        enabled==true?senddataarray|=1<<id:senddataarray&=~(1<<id);\
-        return;\
-    }\
-    id++;
+static const int16_t dataItemDivs[] = {
+    #define DV(DT, NAME, DIV, ROUND) DIV,
+        DATA_VARS
+    #undef DV
+    #define DA(DT, NAME, SIZE, DIV) DIV,
         DATA_ARRAYS
     #undef DA
+};
+
+/* Sets if a data item should be included while in data to GUI
+ *   rate (hz) of zero uses the default rate from the items divisor
+ *   deadband is how much the item, or an element of an array, must change
+ *   before it's sent again
+ */
+
+void TrackerSettings::setDataItemSend(const char *var, bool enabled, uint16_t rate, float deadband)
+{
+    for(int id=0; id < DATA_ITEM_CNT; id++) {
+        if(strcmp(var,dataItemNames[id]) != 0)
+            continue;
+
+        if(enabled) {
+            // Newly added, send it in full right away
+            if(!(senddata & (1ULL << id))) {
+                datanext[id] = k_uptime_get_32();
+                datalast[id] = 0;
+                if(id >= DATA_VAR_CNT)
+                    datafull[id - DATA_VAR_CNT] = 0;
+            }
+            senddata |= 1ULL << id;
+            datareqrate[id] = MIN(rate, DATA_MAX_RATE);
+            datadeadband[id] = MAX(deadband, 0.0f);
+        } else {
+            senddata &= ~(1ULL << id);
+            datareqrate[id] = 0;
+        }
+        return;
+    }
+}
+
+/* The last data frame didn't make it out, send everything in full again
+ * so the GUI isn't left with stale values or deltas against the wrong base
+ */
+
+void TrackerSettings::dataResync()
+{
+    for(int i=0; i < DATA_ITEM_CNT; i++)
+        datalast[i] = 0;
+    for(int i=0; i < DATA_ARRAY_CNT; i++)
+        datafull[i] = 0;
 }
 
 /* Stops all Data Items from Sending
@@ -1143,8 +1387,10 @@ void TrackerSettings::setDataItemSend(const char *var, bool enabled)
 
 void TrackerSettings::stopAllData()
 {
-    senddatavars = 0;
-    senddataarray = 0;
+    senddata = 0;
+    datascale = 1.0f;
+    for(int i=0; i < DATA_ITEM_CNT; i++)
+        datareqrate[i] = 0;
 }
 
 /* Returns a list of all the Data Variables available in json
@@ -1166,68 +1412,207 @@ void TrackerSettings::setJSONDataList(DynamicJsonDocument &json)
     #undef DA
 }
 
-// Used to transmit raw data back to the GUI
-void TrackerSettings::setJSONData(DynamicJsonDocument &json)
+/* Period between sending a data item, not including any slow down when over budget
+ *   Either the rate the GUI asked for, or the update divisor * DATA_BASE_PERIOD
+ *   For negative divisors it's how often to check it for a change
+ */
+
+uint32_t TrackerSettings::dataPeriod(int id)
 {
-    static int counter=0;
-    // Macro Expansion for Data Variables + Arrays
+    if(datareqrate[id] > 0)
+        return 1000 / datareqrate[id];
+    if(dataItemDivs[id] < 0)
+        return DATA_BASE_PERIOD;
+    return dataItemDivs[id] * DATA_BASE_PERIOD;
+}
 
-    // Sends only requested data items
-    // Updates only as often as specified, 1 = every cycle
-    // Three Decimals is most precision of any data item req as of now.
-    // For most items ends up less bytes than base64 encoding everything
-    int id=0;
-    int itemcount=0;
+/* Sets the bytes/sec live data may use
+ *   If the items requested will need more than that, all of their periods are
+ *   stretched by the same amount so every item keeps it's share of the link.
+ */
+
+void TrackerSettings::setDataBudget(float bytespersec)
+{
+    float load=0;
+    float framerate=0;
+    for(int id=0; id < DATA_ITEM_CNT; id++) {
+        if(!(senddata & (1ULL << id)))
+            continue;
+        float rate = 1000.0f / dataPeriod(id);
+        load += datasize[id] * rate;
+        framerate += rate;
+    }
+
+    // Each frame sent also has the command + framing
+    load += DATA_FRAME_OVERHEAD * MIN(framerate, 1000.0f / SERIAL_PERIOD);
+
+    if(load > bytespersec && bytespersec > 0)
+        datascale = load / bytespersec;
+    else
+        datascale = 1.0f;
+}
+
+/* How often an unchanged item is sent anyway
+ *   Negative divisors only send on change, or every abs(DIV) * DATA_BASE_PERIOD if less than -1
+ */
+
+uint32_t TrackerSettings::dataKeyPeriod(int id)
+{
+    if(dataItemDivs[id] == -1)
+        return UINT32_MAX;
+    if(dataItemDivs[id] < 0)
+        return -dataItemDivs[id] * DATA_BASE_PERIOD;
+    return DATA_KEYFRAME_PERIOD;
+}
+
+// Bitmask of the array elements that moved more than the deadband, returns count
+template<typename T>
+static int arrayDelta(const T *cur, const T *last, int size, float deadband, uint32_t &mask)
+{
+    int changed=0;
+    mask = 0;
+    for(int i=0; i < size && i < 32; i++) {
+        if(fabsf((float)cur[i] - (float)last[i]) > deadband) {
+            mask |= 1UL << i;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// Strings are all or nothing
+static int arrayDelta(const char *cur, const char *last, int size, float deadband, uint32_t &mask)
+{
+    mask = 0;
+    return memcmp(cur, last, size) != 0 ? size : 0;
+}
+
+/* Adds a single data item to the json
+ *   Three Decimals is most precision of any data item req as of now.
+ *   For most items ends up less bytes than base64 encoding everything
+ *
+ *   Arrays are base64 encoded, suffixed with the 3 character data type
+ *   If full, the variable name is prepended by 6 and the whole array sent
+ *   Otherwise prepended by 7, a 32bit mask of the changed elements
+ *   followed by only those elements. If most changed, the full array is sent.
+ */
+
+void TrackerSettings::setJSONDataItem(DynamicJsonDocument &json, int id, bool full)
+{
+    int i=0;
     #define DV(DT, NAME, DIV, ROUND)\
-    if(senddatavars & 1<<id && counter % DIV == 0) {\
+    if(id == i++) {\
         if(ROUND == -1)\
             json[#NAME] = NAME;\
         else\
             json[#NAME] = roundf(((float)NAME * ROUND)) / ROUND;\
-        itemcount++;\
-    }\
-    id++;
+        datalastval[id] = ROUND == -1 ? (float)NAME : roundf(((float)NAME * ROUND)) / ROUND;\
+        return;\
+    }
         DATA_VARS
     #undef DV
 
-    // Send only requested data arrays, arrays are base64 encoded
-    // Variable names prepended by 6 so GUI knows to decode them
-    // Suffixed with the 3 character data type
-    // Length can be determined with above info
-
-    // If DIVisor less than zero only send on change.
-    // If less than -1 update on cycle count or change
-
-    id=0;
     char b64array[500];
-    bool sendit=false;
-
+    uint8_t delta[sizeof(uint32_t) + 64];
+    uint32_t mask;
     #define DA(DT, NAME, SIZE, DIV)\
-    sendit=false;\
-    if(senddataarray & 1<<id) {\
-        if(DIV < 0) { \
-            if(memcmp(last ## NAME, NAME, sizeof(NAME)) != 0)\
-                sendit = true;\
-            else if(DIV != -1 && counter % abs(DIV) == 0)\
-                sendit = true;\
-        } else { \
-            if(counter % DIV == 0)\
-                sendit = true;\
-        }\
-        if(sendit) {\
+    if(id == i++) {\
+        int changed = arrayDelta(NAME, last ## NAME, SIZE, datadeadband[id], mask);\
+        if(full || mask == 0 || changed > SIZE / 2 || sizeof(NAME) > sizeof(delta) - sizeof(mask)) {\
             encode_base64((unsigned char*)NAME, sizeof(DT)*SIZE,(unsigned char*)b64array);\
             json["6" #NAME #DT] = b64array;\
             memcpy(last ## NAME, NAME, sizeof(NAME));\
+            datafull[id - DATA_VAR_CNT] = k_uptime_get_32();\
+        } else {\
+            memcpy(delta, &mask, sizeof(mask));\
+            int len = sizeof(mask);\
+            for(int e=0; e < SIZE; e++) {\
+                if(mask & (1UL << e)) {\
+                    memcpy(delta + len, &NAME[e], sizeof(DT));\
+                    len += sizeof(DT);\
+                    last ## NAME[e] = NAME[e];\
+                }\
+            }\
+            encode_base64(delta, len, (unsigned char*)b64array);\
+            json["7" #NAME #DT] = b64array;\
         }\
-    }\
-    id++;
+        return;\
+    }
         DATA_ARRAYS
     #undef DA
+}
 
-    // Used for reduced data divisor
-    counter++;
-    if(counter > 500) {
-        counter = 0;
+// Has the item moved more than it's deadband since it was last sent
+bool TrackerSettings::dataItemChanged(int id)
+{
+    int i=0;
+    #define DV(DT, NAME, DIV, ROUND)\
+    if(id == i++) {\
+        float v = ROUND == -1 ? (float)NAME : roundf(((float)NAME * ROUND)) / ROUND;\
+        return fabsf(v - datalastval[id]) > datadeadband[id];\
     }
+        DATA_VARS
+    #undef DV
+
+    uint32_t mask;
+    #define DA(DT, NAME, SIZE, DIV)\
+    if(id == i++)\
+        return arrayDelta(NAME, last ## NAME, SIZE, datadeadband[id], mask) > 0;
+        DATA_ARRAYS
+    #undef DA
+    return true;
 }
 
+/* Used to transmit raw data back to the GUI
+ *   Adds the items which are due, up to maxbytes. Items that don't fit stay
+ *   due and are packed first on the next call. Returns the estimated size.
+ *
+ *   Items which haven't moved more than their deadband are skipped, only
+ *   being resent every dataKeyPeriod() so the GUI knows they are still live.
+ */
+
+int TrackerSettings::setJSONData(DynamicJsonDocument &json, int maxbytes)
+{
+    uint32_t now = k_uptime_get_32();
+    int bytes=0;
+    bool deferred=false;
+
+    for(int n=0, id=datastart; n < DATA_ITEM_CNT; n++, id = (id + 1) % DATA_ITEM_CNT) {
+        if(!(senddata & (1ULL << id)) || (int32_t)(now - datanext[id]) < 0)
+            continue;
+
+        uint32_t period = dataPeriod(id) * datascale;
+
+        // Unchanged, check again next period
+        bool keyframe = datalast[id] == 0 || now - datalast[id] >= dataKeyPeriod(id);
+        if(!keyframe && !dataItemChanged(id)) {
+            datanext[id] = now + period;
+            continue;
+        }
+
+        // Out of room, leave it due
+        if(bytes + datasize[id] > maxbytes) {
+            if(!deferred) {
+                datastart = id;
+                deferred = true;
+            }
+            continue;
+        }
+
+        // Arrays also go out in full at least every keyframe period
+        bool full = keyframe;
+        if(id >= DATA_VAR_CNT)
+            full = datafull[id - DATA_VAR_CNT] == 0 || now - datafull[id - DATA_VAR_CNT] >= dataKeyPeriod(id);
+
+        setJSONDataItem(json, id, full);
+        bytes += datasize[id];
+        datalast[id] = now;
+
+        // Keep the phase, unless it's fallen behind. Don't burst to catch up
+        datanext[id] += period;
+        if((int32_t)(now - datanext[id]) >= 0)
+            datanext[id] = now + period;
+    }
+
+    return bytes;
+}
@@ -8,6 +8,8 @@
 #include "btpararmt.h"
 #include "serial.h"
 
+struct TelemetryFrame;
+
 // Variables to be sent back to GUI if enabled
 // Datatype, Name, UpdateDivisor, RoundTo
 #define DATA_VARS\
@@ -43,7 +45,16 @@
     DV(bool,btcon,       10,-1)\
     DV(bool,isSense,     10,-1)\
     DV(bool,trpenabled,  10,-1)\
-    DV(uint8_t, cpuuse,  1,-1)
+    DV(uint8_t, cpuuse,  1,-1)\
+    DV(uint16_t,fusioncyc,5,-1)\
+    DV(bool,magdist,     5,-1)\
+    DV(uint16_t,btlatency,10,-1)\
+    DV(uint8_t, btqueue, 10,-1)\
+    DV(uint8_t, btphy,   10,-1)\
+    DV(int8_t,  btrssi,  10,-1)\
+    DV(uint16_t,btreconn,10,-1)\
+    DV(uint8_t, btpeers, 10,-1)\
+    DV(uint16_t,hidrate, 10,-1)
 
 // To shorten names, as these are sent to the GUI for decoding
 #define u8  uint8_t
@@ -63,7 +74,11 @@
     DA(u16, sbusch, 16, 1)\
     DA(flt, quat,4, 1)\
     DA(chr, btaddr,18, 20)\
-    DA(chr, btrmt,18, -100)
+    DA(chr, btrmt,18, -100)\
+    DA(u16, btphypkt, 3, 10)\
+    DA(u16, btphylate, 3, 10)\
+    DA(u16, btpeerrate, BT_MAX_PEERS, 10)\
+    DA(u16, btpeerlat, BT_MAX_PEERS, 10)
 
 // Global Config Values
 class TrackerSettings
@@ -77,7 +92,15 @@ public:
         AUX_ACCELY, // 4
         AUX_ACCELZ, // 5
         AUX_ACCELZO, // 6
-        BT_RSSI}; // 7
+        BT_RSSI, // 7
+        CRSF_RSSI, // 8
+        CRSF_LQ}; // 9
+
+    // What the auxiliary serial port is used for
+    enum {SERMODE_SBUS,
+        SERMODE_CRSF,
+        SERMODE_MAVLINK,
+        SERMODE_CNT};
 
     static constexpr int MIN_PWM=988;
     static constexpr int MAX_PWM=2012;
@@ -122,6 +145,27 @@ public:
     static constexpr int DEF_ALERT_CH = -1;
     static constexpr int DEF_LP_PAN = 90;
     static constexpr int DEF_LP_TLTRLL = 90;
+    static constexpr int LP_MODE_FIXED = 0;      // Exponential average, lppan/lptiltroll
+    static constexpr int LP_MODE_ADAPTIVE = 1;   // One Euro filter, cutoff raised with the gyro rate
+    static constexpr int DEF_LP_MODE = LP_MODE_FIXED;
+    static constexpr float DEF_LP_MINCUT = 0.5;  // (hz) Cutoff when still
+    static constexpr float MIN_LP_MINCUT = 0.05;
+    static constexpr float MAX_LP_MINCUT = 20;
+    static constexpr float DEF_LP_SLOPE = 0.2;  // (hz per deg/s) Cutoff added with head speed
+    static constexpr float MAX_LP_SLOPE = 1;
+    static constexpr int DEF_PREDICT = 0;        // (ms) Output look ahead, 0 = off
+    static constexpr int MAX_PREDICT = 100;
+    static constexpr int FUSION_MADGWICK = 0;
+    static constexpr int FUSION_MAHONY = 1;
+    static constexpr int FUSION_ESKF = 2;         // Error state Kalman filter, estimates gyro bias
+    static constexpr int DEF_FUSION = FUSION_MADGWICK;
+    static constexpr int DEF_IMU_ODR = 119;      // (hz) Gyro & accel rate, 119, 238 or 476
+    static constexpr int DEF_GYRO_BW = 0;        // Gyro low pass 0-3, cutoff depends on the rate
+    static constexpr int DEF_GYRO_FS = 2000;     // (deg/s) 245, 500 or 2000
+    static constexpr int DEF_ACC_FS = 4;         // (g) 2, 4, 8 or 16
+    static constexpr int DEF_MAG_ODR = 80;       // (hz) 20, 40 or 80
+    static constexpr int DEF_FUSION_DIV = 1;     // IMU samples averaged into each fusion update
+    static constexpr int MAX_FUSION_DIV = 8;
     static constexpr int DEF_PWM_A0_CH = -1;
     static constexpr int DEF_PWM_A1_CH = -1;
     static constexpr int DEF_PWM_A2_CH = -1;
@@ -129,6 +173,8 @@ public:
     static constexpr bool DEF_SBUS_IN_INV = true;
     static constexpr bool DEF_SBUS_OUT_INV = true;
     static constexpr int DEF_SBUS_RATE = 60;
+    static constexpr bool DEF_SBUS_HW_TIMED = false;
+    static constexpr bool DEF_MAV_GIMBAL_DEVICE = false; // Send to the gimbal manager
     static constexpr float SBUS_ACTIVE_TIME = 0.1; // 10Hz
     static constexpr int DEF_ALG_A4_CH = -1;
     static constexpr int DEF_ALG_A5_CH = -1;
@@ -141,6 +187,16 @@ public:
     static constexpr int DEF_AUX_CH2 = -1;
     static constexpr int DEF_AUX_FUNC = 0;
     static constexpr int MAX_DATA_VARS = 40;
+    static constexpr int BT_CACHE_LEN = 64;
+
+    // Count of the live data items, data variables first then the arrays
+    #define DV(DT, NAME, DIV, ROUND) +1
+    static constexpr int DATA_VAR_CNT = 0 DATA_VARS;
+    #undef DV
+    #define DA(DT, NAME, SIZE, DIV) +1
+    static constexpr int DATA_ARRAY_CNT = 0 DATA_ARRAYS;
+    #undef DA
+    static constexpr int DATA_ITEM_CNT = DATA_VAR_CNT + DATA_ARRAY_CNT;
     static constexpr int DEF_SERIAL_MODE = 0;
 
     TrackerSettings();
@@ -187,6 +243,32 @@ public:
     int lpTiltRoll() const;
     void setLPTiltRoll(int value);
 
+    int lpMode() const {return lpmode;}
+    void setLPMode(int value);
+    float lpMinCutoff() const {return lpmincut;}
+    void setLPMinCutoff(float value);
+    float lpSlope() const {return lpslope;}
+    void setLPSlope(float value);
+
+    int predictTime() const {return predict;}
+    void setPredictTime(int ms);
+
+    int fusionEngine() const {return fusion;}
+    void setFusionEngine(int value);
+
+    int imuODR() const {return imuodr;}
+    void setIMUODR(int hz);
+    int gyroBW() const {return gyrobw;}
+    void setGyroBW(int value);
+    int gyroFS() const {return gyrofs;}
+    void setGyroFS(int dps);
+    int accFS() const {return accfs;}
+    void setAccFS(int g);
+    int magODR() const {return magodr;}
+    void setMagODR(int hz);
+    int fusionDivider() const {return fusiondiv;}
+    void setFusionDivider(int value);
+
     char servoReverse() const;
     void setServoreverse(char value);
     void setRollReversed(bool value);
@@ -258,8 +340,12 @@ public:
     void setBlueToothMode(int mode);
     bool isBlueToothConnected() {return btcon;}
     void setBlueToothConnected(bool con) {btcon = con;}
+    bool btNotifyOnChange() const {return btonchange;}
+    void setBTNotifyOnChange(bool value) {btonchange = value;}
 
     void setPairedBTAddress(const char *ha);
+    const char *btCache() const {return btcache;}
+    void setBTCache(const char *cache);
     const char* pairedBTAddress();
 
     void setOrientation(int rx, int ry, int rz);
@@ -280,6 +366,14 @@ public:
     void setSBUSRate(uint8_t rate) { if(rate>=30 && rate<=150) sbrate = rate; }
     uint8_t SBUSRate() { return sbrate ;}
 
+// Serial Mode
+    void setSerialMode(int mode) { if(mode >= 0 && mode < SERMODE_CNT) sermode = mode; }
+    int serialMode() { return sermode; }
+    void setSBUSHWTimed(bool v) {sbhwtimed = v;}
+    bool SBUSHWTimed() {return sbhwtimed;}
+    void setMAVGimbalDevice(bool v) {mavgimdev = v;}
+    bool MAVGimbalDevice() {return mavgimdev;}
+
 // Analogs
     void setAnalog4Ch(int channel);
     void setAnalog4Gain(float gain) {an4gain=gain;}
@@ -322,6 +416,7 @@ public:
 
     void loadJSONSettings(DynamicJsonDocument &json);
     void setJSONSettings(DynamicJsonDocument &json);
+    uint32_t settingsVersion() const {return setversion;} // Changes each time settings are loaded
 
     void saveToEEPROM();
     void loadFromEEPROM();
@@ -336,8 +431,14 @@ public:
     void setOffMag(float x, float y, float z);
     void setOffOrient(float t, float r, float p);
     void setPPMOut(uint16_t t, uint16_t r, uint16_t p);
-    void setJSONData(DynamicJsonDocument &json);
+    int setJSONData(DynamicJsonDocument &json, int maxbytes);
+    void setDataBudget(float bytespersec);
     void setBLEAddress(const char *addr);
+    void setBLENotifyStats(uint16_t latency, uint8_t queue);
+    void setBLEReconnectTime(uint16_t ms);
+    void setHIDRate(uint16_t hz);
+    void setBLEPeerStats(uint8_t count, uint16_t rate[BT_MAX_PEERS], uint16_t latency[BT_MAX_PEERS]);
+    void setBLEPhyStats(uint8_t phy, int8_t rssi, uint16_t packets[3], uint16_t late[3]);
     void setDiscoveredBTHead(const char* addr);
     void setBLEValues(uint16_t vals[BT_CHANNELS]);
     void setSenseboard(bool sense);
@@ -345,7 +446,9 @@ public:
     void setPPMInValues(uint16_t vals[16]);
     void setChannelOutValues(uint16_t vals[16]);
     void setQuaternion(float q[4]);
-    void setDataItemSend(const char *var, bool enabled);
+    void setTelemetry(const TelemetryFrame &frame);
+    void setDataItemSend(const char *var, bool enabled, uint16_t rate=0, float deadband=0);
+    void dataResync();
     void setGyroCalibrated(bool gc) {gyroCal = gc;}
     void stopAllData();
     void setJSONDataList(DynamicJsonDocument &json);
@@ -369,13 +472,20 @@ private:
 
     int servoreverse;
     int lppan,lptiltroll;
+    int lpmode;
+    float lpmincut,lpslope;
+    int predict;
+    int fusion;
+    int imuodr,gyrobw,gyrofs,accfs,magodr,fusiondiv;
     int buttonpin,ppmoutpin,ppminpin;
     bool butlngps;
     bool rstontlt;
     bool ppmoutinvert;
     bool ppmininvert;
     int btmode;
+    bool btonchange;
     int sermode;
+    bool mavgimdev;
 
     bool rstonwave;
     bool freshProgram;
@@ -394,13 +504,33 @@ private:
     bool sboutinv;
     bool sbininv;
     uint8_t sbrate;
+    bool sbhwtimed;
+
+    volatile uint32_t setversion;
 
     // Bit map of data to send to GUI, max 64 items
-    uint64_t senddatavars;
-    uint32_t senddataarray;
+    uint64_t senddata;
+    static_assert(DATA_ITEM_CNT <= 64, "Too many data items for the send bitmap");
+
+    // Live data scheduling, indexed the same as the bitmap
+    uint16_t datareqrate[DATA_ITEM_CNT]; // (hz) Requested rate, 0 = default from the divisor
+    uint32_t datanext[DATA_ITEM_CNT];    // (ms) Uptime the item is next due
+    uint32_t datalast[DATA_ITEM_CNT];    // (ms) Uptime the item was last sent
+    uint16_t datasize[DATA_ITEM_CNT];    // (bytes) Estimated size once in the JSON
+    float datadeadband[DATA_ITEM_CNT];   // Change needed before an item is resent, 0 = any change
+    float datalastval[DATA_VAR_CNT];     // Last value sent of the data variables
+    uint32_t datafull[DATA_ARRAY_CNT];   // (ms) Uptime the array was last sent in full
+    float datascale;  // Period multiplier, > 1 when the requested items don't fit the link
+    int datastart;    // Item to start packing from, so deferred items go first next time
+
+    uint32_t dataPeriod(int id);
+    uint32_t dataKeyPeriod(int id);
+    void setJSONDataItem(DynamicJsonDocument &json, int id, bool full);
+    bool dataItemChanged(int id);
 
     // BT Address for remote mode to pair with
     char btpairedaddress[17];
+    char btcache[BT_CACHE_LEN];
 
     // Define Data Variables from X Macro
     #define DV(DT, NAME, DIV, ROUND) DT NAME;
@@ -0,0 +1,93 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Tracker side of the MAVLink loopback, run by mavlink_loopback.py. Opens a
+// pseudo-terminal, prints the name of its slave side for the flight
+// controller to open, waits for a byte on stdin then writes what the
+// MAVLink output mode sends. A heartbeat every LOOPBACK_HB_EVERY frames and
+// a tilt sweep going out as both gimbal messages. A broken frame is written
+// half way through, the reader has to find the next good one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include "mavlinkcodec.h"
+#include "orientation.h"
+
+#define LOOPBACK_ATTITUDES 100
+#define LOOPBACK_HB_EVERY 10
+
+static int pty;
+
+static void send(const uint8_t *frame, int len)
+{
+    if(write(pty, frame, len) != len) {
+        perror("write");
+        exit(1);
+    }
+}
+
+int main()
+{
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if(pty < 0 || grantpt(pty) != 0 || unlockpt(pty) != 0) {
+        perror("pty");
+        return 1;
+    }
+    printf("%s\n", ptsname(pty));
+    fflush(stdout);
+
+    char go;
+    if(read(STDIN_FILENO, &go, 1) != 1)
+        return 1;
+
+    uint8_t frame[64];
+    MavlinkHeader hdr = {0, 255, 25};
+    const float nanrate[3] = {NAN, NAN, NAN};
+    const uint32_t flags = GIMBAL_FLAGS_ROLL_LOCK | GIMBAL_FLAGS_PITCH_LOCK;
+    for(int i=0; i < LOOPBACK_ATTITUDES; i++) {
+        if(i % LOOPBACK_HB_EVERY == 0) {
+            send(frame, mavlinkEncodeHeartbeat(frame, hdr, MAV_TYPE_GCS,
+                                               MAV_AUTOPILOT_INVALID, MAV_STATE_ACTIVE));
+            hdr.seq++;
+        }
+
+        // Tilt -50 to +49 degrees, pitch on the other side
+        float q[4];
+        anglesToQuat(i - 50, 0, 0, q);
+        int len;
+        if(i & 1)
+            len = mavlinkEncodeGimbalManagerSetAttitude(frame, hdr, 1, MAV_COMP_ID_AUTOPILOT1, 0,
+                                                        flags, q, nanrate);
+        else
+            len = mavlinkEncodeGimbalDeviceSetAttitude(frame, hdr, 1, MAV_COMP_ID_GIMBAL,
+                                                       flags, q, nanrate);
+        send(frame, len);
+        hdr.seq++;
+
+        if(i == LOOPBACK_ATTITUDES / 2) {
+            const uint8_t broken[] = {MAVLINK_STX, 3, 0, 0};
+            send(broken, sizeof(broken));
+        }
+    }
+
+    // The reader sees the port close once it has everything
+    sleep(1);
+    return 0;
+}
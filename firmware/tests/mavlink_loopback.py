@@ -0,0 +1,118 @@
+# Flight controller side of the MAVLink loopback. Runs mavlink_loopback,
+# reads what it sends from the slave side of its pseudo-terminal and decodes
+# it without any of the firmware's code. Every frame has to arrive with a
+# good crc and in sequence, the right fields and a tilt that comes back out
+# as the pitch of the quaternion.
+#
+#   python3 mavlink_loopback.py <path to mavlink_loopback>
+
+import math
+import os
+import select
+import struct
+import subprocess
+import sys
+import tty
+
+ATTITUDES = 100
+HB_EVERY = 10
+
+# msgid: (crc extra, payload length)
+MESSAGES = {0: (50, 9), 282: (123, 35), 284: (99, 32)}
+
+
+def crc_x25(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def read_all(fd):
+    data = b""
+    while True:
+        ready, _, _ = select.select([fd], [], [], 2.0)
+        if not ready:
+            break
+        try:
+            chunk = os.read(fd, 4096)
+        except OSError:  # EIO once the master side closes
+            break
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def pitch_of(w, x, y, z):
+    return math.degrees(math.asin(max(-1.0, min(1.0, 2 * (w * y - z * x)))))
+
+
+def main():
+    tx = subprocess.Popen([sys.argv[1]], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    fd = os.open(tx.stdout.readline().decode().strip(), os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    tx.stdin.write(b"g")
+    tx.stdin.flush()
+    data = read_all(fd)
+    os.close(fd)
+    tx.wait()
+
+    counts = {0: 0, 282: 0, 284: 0}
+    seqs = []
+    errors = []
+    skipped = 0
+    i = 0
+    while i + 12 <= len(data):
+        if data[i] != 0xFD:
+            i += 1
+            continue
+        length = data[i + 1]
+        msgid = data[i + 7] | data[i + 8] << 8 | data[i + 9] << 16
+        if msgid not in MESSAGES or i + 12 + length > len(data):
+            i += 1
+            skipped += 1
+            continue
+        extra, full = MESSAGES[msgid]
+        frame = data[i:i + 12 + length]
+        if crc_x25(frame[1:10 + length] + bytes([extra])) != struct.unpack("<H", frame[-2:])[0]:
+            i += 1
+            skipped += 1
+            continue
+
+        payload = frame[10:10 + length] + bytes(full - length)
+        if msgid == 0:
+            if payload[4] != 6 or payload[5] != 8 or payload[8] != 3:
+                errors.append("heartbeat %s" % payload.hex())
+        else:
+            if msgid == 282:
+                flags, w, x, y, z, rx, ry, rz, tsys, tcomp, dev = struct.unpack("<I7fBBB", payload)
+                good = tcomp == 1 and dev == 0
+            else:
+                w, x, y, z, rx, ry, rz, flags, tsys, tcomp = struct.unpack("<7fHBB", payload)
+                good = tcomp == 154
+            n = counts[282] + counts[284]
+            good = good and flags == 12 and tsys == 1 and math.isnan(rx)
+            good = good and abs(w * w + x * x + y * y + z * z - 1) < 1e-5
+            good = good and abs(x) < 1e-6 and abs(z) < 1e-6
+            good = good and abs(pitch_of(w, x, y, z) - (n - 50)) < 0.01
+            if not good:
+                errors.append("attitude %d %s" % (n, payload.hex()))
+
+        counts[msgid] += 1
+        seqs.append(frame[4])
+        i += len(frame)
+
+    print("Frames %s, bytes skipped %d, errors %d" % (counts, skipped, len(errors)))
+    for e in errors:
+        print(e)
+    ok = (counts[0] == ATTITUDES // HB_EVERY and counts[282] == ATTITUDES // 2 and
+          counts[284] == ATTITUDES // 2 and not errors and skipped > 0 and
+          seqs == [s & 0xFF for s in range(len(seqs))])
+    print("OK" if ok else "FAILED")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,31 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// The two settings joystick.cpp uses
+
+#include <stdint.h>
+
+class TrackerSettings {
+public:
+    static constexpr int PPM_CENTER = 1500;
+    void setHIDRate(uint16_t hz) {hidrate = hz;}
+    uint16_t hidrate = 0;
+};
+
+extern TrackerSettings trkset;
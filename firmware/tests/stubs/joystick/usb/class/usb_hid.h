@@ -0,0 +1,36 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// The HID class calls joystick.cpp makes, test_joystick.cpp plays the host
+
+#include <stdint.h>
+#include <stddef.h>
+#include "device.h"
+
+typedef void (*hid_int_ready_callback)(const struct device *dev);
+
+struct hid_ops {
+    hid_int_ready_callback int_in_ready;
+};
+
+int hid_int_ep_write(const struct device *dev, const uint8_t *data, uint32_t data_len,
+                     uint32_t *bytes_ret);
+void usb_hid_register_device(const struct device *dev, const uint8_t *desc, size_t size,
+                             const struct hid_ops *ops);
+int usb_hid_init(const struct device *dev);
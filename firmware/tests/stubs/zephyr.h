@@ -0,0 +1,53 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Just enough of Zephyr's kernel timing for the RTOS_ZEPHYR macros in
+// defines.h, so fusion code can be built into the host tests, and the few
+// kernel helpers joystick.cpp uses. The cycle counter runs at 1MHz from the
+// host's steady clock.
+
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+
+static inline uint32_t k_cycle_get_32()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline uint32_t k_cyc_to_us_floor32(uint32_t cyc) {return cyc;}
+static inline uint64_t k_cyc_to_us_floor64(uint64_t cyc) {return cyc;}
+static inline uint32_t k_cyc_to_ms_floor32(uint32_t cyc) {return cyc / 1000;}
+static inline int64_t k_uptime_get() {return k_cycle_get_32() / 1000;}
+static inline int32_t k_msleep(int32_t ms) {std::this_thread::sleep_for(std::chrono::milliseconds(ms)); return 0;}
+static inline int32_t k_usleep(int32_t us) {std::this_thread::sleep_for(std::chrono::microseconds(us)); return 0;}
+
+// Single threaded on the host, so locking out interrupts is a no-op
+static inline unsigned int irq_lock() {return 0;}
+static inline void irq_unlock(unsigned int key) {(void)key;}
+
+#define ARG_UNUSED(x) (void)(x)
+#define __packed __attribute__((__packed__))
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
@@ -0,0 +1,175 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Channel packing against the hand written SBUS code it replaced. Every
+// 11 bit value in every channel position packs to the same bytes and
+// unpacks back, other widths round trip and the integer PPM scaling
+// matches the old float math for every value. Then the time per frame of
+// pack, unpack and scale for each.
+
+#include <string.h>
+#include <stdlib.h>
+#include "testutil.h"
+#include "chanpack.h"
+
+#define CHANNELS 16
+#define FRAME_BYTES 22
+#define RANDOM_FRAMES 100000
+#define BENCH_FRAMES 2000000
+
+// The SBUS packing before chanpack
+static void oldPack(uint8_t *buf_, const uint16_t *ch_)
+{
+    buf_[0] =  static_cast<uint8_t>((ch_[0]  & 0x07FF));
+    buf_[1] =  static_cast<uint8_t>((ch_[0]  & 0x07FF) >> 8  | (ch_[1]  & 0x07FF) << 3);
+    buf_[2] =  static_cast<uint8_t>((ch_[1]  & 0x07FF) >> 5  | (ch_[2]  & 0x07FF) << 6);
+    buf_[3] =  static_cast<uint8_t>((ch_[2]  & 0x07FF) >> 2);
+    buf_[4] =  static_cast<uint8_t>((ch_[2]  & 0x07FF) >> 10 | (ch_[3]  & 0x07FF) << 1);
+    buf_[5] =  static_cast<uint8_t>((ch_[3]  & 0x07FF) >> 7  | (ch_[4]  & 0x07FF) << 4);
+    buf_[6] =  static_cast<uint8_t>((ch_[4]  & 0x07FF) >> 4  | (ch_[5]  & 0x07FF) << 7);
+    buf_[7] =  static_cast<uint8_t>((ch_[5]  & 0x07FF) >> 1);
+    buf_[8] =  static_cast<uint8_t>((ch_[5]  & 0x07FF) >> 9  | (ch_[6]  & 0x07FF) << 2);
+    buf_[9] =  static_cast<uint8_t>((ch_[6]  & 0x07FF) >> 6  | (ch_[7]  & 0x07FF) << 5);
+    buf_[10] = static_cast<uint8_t>((ch_[7]  & 0x07FF) >> 3);
+    buf_[11] = static_cast<uint8_t>((ch_[8]  & 0x07FF));
+    buf_[12] = static_cast<uint8_t>((ch_[8]  & 0x07FF) >> 8  | (ch_[9]  & 0x07FF) << 3);
+    buf_[13] = static_cast<uint8_t>((ch_[9]  & 0x07FF) >> 5  | (ch_[10] & 0x07FF) << 6);
+    buf_[14] = static_cast<uint8_t>((ch_[10] & 0x07FF) >> 2);
+    buf_[15] = static_cast<uint8_t>((ch_[10] & 0x07FF) >> 10 | (ch_[11] & 0x07FF) << 1);
+    buf_[16] = static_cast<uint8_t>((ch_[11] & 0x07FF) >> 7  | (ch_[12] & 0x07FF) << 4);
+    buf_[17] = static_cast<uint8_t>((ch_[12] & 0x07FF) >> 4  | (ch_[13] & 0x07FF) << 7);
+    buf_[18] = static_cast<uint8_t>((ch_[13] & 0x07FF) >> 1);
+    buf_[19] = static_cast<uint8_t>((ch_[13] & 0x07FF) >> 9  | (ch_[14] & 0x07FF) << 2);
+    buf_[20] = static_cast<uint8_t>((ch_[14] & 0x07FF) >> 6  | (ch_[15] & 0x07FF) << 5);
+    buf_[21] = static_cast<uint8_t>((ch_[15] & 0x07FF) >> 3);
+}
+
+static void oldUnpack(const uint8_t *buf_, uint16_t *ch_)
+{
+    ch_[0]  = static_cast<int16_t>(buf_[0]       | ((buf_[1]  << 8) & 0x07FF));
+    ch_[1]  = static_cast<int16_t>(buf_[1]  >> 3 | ((buf_[2]  << 5) & 0x07FF));
+    ch_[2]  = static_cast<int16_t>(buf_[2]  >> 6 | ((buf_[3]  << 2)  | ((buf_[4] << 10) & 0x07FF)));
+    ch_[3]  = static_cast<int16_t>(buf_[4]  >> 1 | ((buf_[5]  << 7) & 0x07FF));
+    ch_[4]  = static_cast<int16_t>(buf_[5]  >> 4 | ((buf_[6]  << 4) & 0x07FF));
+    ch_[5]  = static_cast<int16_t>(buf_[6]  >> 7 | ((buf_[7]  << 1)  | ((buf_[8] << 9) & 0x07FF)));
+    ch_[6]  = static_cast<int16_t>(buf_[8]  >> 2 | ((buf_[9]  << 6) & 0x07FF));
+    ch_[7]  = static_cast<int16_t>(buf_[9]  >> 5 | ((buf_[10] << 3) & 0x07FF));
+    ch_[8]  = static_cast<int16_t>(buf_[11]      | ((buf_[12] << 8) & 0x07FF));
+    ch_[9]  = static_cast<int16_t>(buf_[12] >> 3 | ((buf_[13] << 5) & 0x07FF));
+    ch_[10] = static_cast<int16_t>(buf_[13] >> 6 | ((buf_[14] << 2)  | ((buf_[15] << 10) & 0x07FF)));
+    ch_[11] = static_cast<int16_t>(buf_[15] >> 1 | ((buf_[16] << 7) & 0x07FF));
+    ch_[12] = static_cast<int16_t>(buf_[16] >> 4 | ((buf_[17] << 4) & 0x07FF));
+    ch_[13] = static_cast<int16_t>(buf_[17] >> 7 | ((buf_[18] << 1)  | ((buf_[19] << 9) & 0x07FF)));
+    ch_[14] = static_cast<int16_t>(buf_[19] >> 2 | ((buf_[20] << 6) & 0x07FF));
+    ch_[15] = static_cast<int16_t>(buf_[20] >> 5 | ((buf_[21] << 3) & 0x07FF));
+}
+
+// Round trips random channels of Bits each
+template<int NCh, int Bits> static long roundTrip()
+{
+    long fails = 0;
+    uint16_t ch[NCh], out[NCh];
+    uint8_t buf[chanpack::packedSize<NCh, Bits>()];
+    for(int f=0; f < RANDOM_FRAMES; f++) {
+        for(int i=0; i < NCh; i++)
+            ch[i] = rand() & ((1 << Bits) - 1);
+        chanpack::pack<NCh, Bits>(buf, ch);
+        chanpack::unpack<NCh, Bits>(buf, out);
+        fails += memcmp(ch, out, sizeof(ch)) != 0;
+    }
+    return fails;
+}
+
+static_assert(chanpack::packedSize<CHANNELS, 11>() == FRAME_BYTES, "SBUS/CRSF channel data");
+static_assert(chanpack::toPPM(chanpack::CH_CENTER) == chanpack::PPM_CENTER, "Center");
+static_assert(chanpack::fromPPM(chanpack::PPM_CENTER) == chanpack::CH_CENTER, "Center");
+
+int main()
+{
+    srand(1);
+
+    // Every value in every position, the rest random
+    long packfails = 0, unpackfails = 0;
+    for(int c=0; c < CHANNELS; c++) {
+        for(int v=0; v <= chanpack::CH_MAX; v++) {
+            uint16_t ch[CHANNELS];
+            for(int i=0; i < CHANNELS; i++)
+                ch[i] = i == c ? v : rand() & chanpack::CH_MAX;
+
+            uint8_t oldbuf[FRAME_BYTES], newbuf[FRAME_BYTES];
+            oldPack(oldbuf, ch);
+            chanpack::pack<CHANNELS, 11>(newbuf, ch);
+            packfails += memcmp(oldbuf, newbuf, sizeof(oldbuf)) != 0;
+
+            uint16_t oldch[CHANNELS], newch[CHANNELS];
+            oldUnpack(oldbuf, oldch);
+            chanpack::unpack<CHANNELS, 11>(oldbuf, newch);
+            unpackfails += memcmp(oldch, newch, sizeof(oldch)) != 0 || memcmp(ch, newch, sizeof(ch)) != 0;
+        }
+    }
+    printf("16x11 every value: pack differs %ld, unpack differs %ld\n", packfails, unpackfails);
+    CHECK(packfails == 0);
+    CHECK(unpackfails == 0);
+
+    long fails12 = roundTrip<8, 12>();
+    long fails9 = roundTrip<5, 9>();
+    long fails16 = roundTrip<3, 16>();
+    printf("Round trip failures 8x12 %ld, 5x9 %ld, 3x16 %ld\n", fails12, fails9, fails16);
+    CHECK(fails12 == 0);
+    CHECK(fails9 == 0);
+    CHECK(fails16 == 0);
+
+    // Same results as the float scaling that was used before
+    long ppmfails = 0;
+    for(int v=0; v <= chanpack::CH_MAX; v++) {
+        uint16_t f = (((float)v - 992) / 1.6f) + 1500;
+        ppmfails += f != chanpack::toPPM(v);
+    }
+    for(int us=chanpack::PPM_AT_ZERO; us <= chanpack::toPPM(chanpack::CH_MAX); us++) {
+        uint16_t f = (static_cast<float>(us) - 1500) * 1.6f + 992;
+        ppmfails += f != chanpack::fromPPM(us);
+    }
+    printf("PPM scaling differs from float %ld\n", ppmfails);
+    CHECK(ppmfails == 0);
+    CHECK(chanpack::fromPPM(0) == 0);
+    CHECK(chanpack::fromPPM(3000) == chanpack::CH_MAX);
+
+    uint16_t ch[CHANNELS];
+    for(int i=0; i < CHANNELS; i++)
+        ch[i] = rand() & chanpack::CH_MAX;
+    uint8_t buf[FRAME_BYTES];
+    uint32_t sink = 0;
+    double oldtime = benchNs(BENCH_FRAMES, [&](long f) {
+        ch[f & 15] = f & chanpack::CH_MAX;
+        oldPack(buf, ch);
+        uint16_t out[CHANNELS];
+        oldUnpack(buf, out);
+        for(int i=0; i < CHANNELS; i++)
+            sink += (uint16_t)((((float)out[i] - 992) / 1.6f) + 1500);
+    });
+    double newtime = benchNs(BENCH_FRAMES, [&](long f) {
+        ch[f & 15] = f & chanpack::CH_MAX;
+        chanpack::pack<CHANNELS, 11>(buf, ch);
+        uint16_t out[CHANNELS];
+        chanpack::unpack<CHANNELS, 11>(buf, out);
+        for(int i=0; i < CHANNELS; i++)
+            sink += chanpack::toPPM(out[i]);
+    });
+    printf("Pack, unpack and scale a frame: chanpack %.1fns, old %.1fns (%u)\n", newtime, oldtime, sink);
+
+    return TEST_RESULT();
+}
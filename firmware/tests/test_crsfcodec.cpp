@@ -0,0 +1,169 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// CRSF frames, the CRC8 check value, the crc table against a bit by bit
+// CRC8 and a known centered channels frame, then random channels through
+// the encoder and decoder with junk between the frames. Corrupt frames must
+// be dropped and the decoder must find the next good one. Then the time per
+// byte of the decoder and per frame of the encoder.
+
+#include <string.h>
+#include <stdlib.h>
+#include "testutil.h"
+#include "crsfcodec.h"
+
+#define FRAMES 200000
+#define BENCH_FRAMES 1000
+#define BENCH_PASSES 2000
+
+// All 16 channels at 992, the crc from an independent bit by bit CRC8
+static const uint8_t centered[CRSF_RC_FRAME] = {
+    0xC8, 0x18, 0x16, 0xE0, 0x03, 0x1F, 0xF8, 0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F,
+    0x7C, 0xE0, 0x03, 0x1F, 0xF8, 0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F, 0x7C, 0xAD
+};
+
+// Feeds a whole buffer, returns the last frame type found and how many
+static uint8_t feedAll(CrsfDecoder &dec, const uint8_t *data, int len, int *count = nullptr)
+{
+    uint8_t type = 0;
+    for(int i=0; i < len; i++) {
+        uint8_t t = dec.feed(data[i]);
+        if(t) {
+            type = t;
+            if(count)
+                (*count)++;
+        }
+    }
+    return type;
+}
+
+static uint8_t stream[BENCH_FRAMES * CRSF_RC_FRAME];
+
+int main()
+{
+    srand(1);
+
+    // CRC-8/DVB-S2 check value
+    CHECK(crsfCrc8((const uint8_t *)"123456789", 9) == 0xBC);
+
+    // Every table entry is the bit by bit crc of its byte
+    int badentries = 0;
+    for(int i=0; i < 256; i++) {
+        uint8_t crc = i;
+        for(int b=0; b < 8; b++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+        badentries += CRSF_CRC8_TABLE[i] != crc;
+    }
+    CHECK(badentries == 0);
+
+    uint16_t ch[CRSF_CHANNELS], out[CRSF_CHANNELS];
+    uint8_t frame[CRSF_RC_FRAME];
+    for(int i=0; i < CRSF_CHANNELS; i++)
+        ch[i] = chanpack::CH_CENTER;
+    CHECK(crsfEncodeChannels(frame, ch) == CRSF_RC_FRAME);
+    CHECK(memcmp(frame, centered, sizeof(centered)) == 0);
+
+    // Random channels, junk without any address bytes in front of each
+    CrsfDecoder dec;
+    long fails = 0;
+    for(int f=0; f < FRAMES; f++) {
+        for(int i=0; i < CRSF_CHANNELS; i++)
+            ch[i] = rand() & chanpack::CH_MAX;
+        crsfEncodeChannels(frame, ch);
+
+        int junk = rand() % 5;
+        for(int j=0; j < junk; j++)
+            dec.feed(rand() & 0x7F);
+
+        int found = 0;
+        uint8_t type = 0;
+        for(int i=0; i < CRSF_RC_FRAME; i++) {
+            type = dec.feed(frame[i]);
+            found += type != 0;
+            if(type && i != CRSF_RC_FRAME - 1)
+                break;
+        }
+        if(found != 1 || type != CRSF_FRAMETYPE_RC_CHANNELS_PACKED ||
+           dec.payloadLength() != CRSF_RC_PAYLOAD) {
+            fails++;
+            continue;
+        }
+        chanpack::unpack<CRSF_CHANNELS, 11>(dec.payload(), out);
+        fails += memcmp(out, ch, sizeof(ch)) != 0;
+    }
+    printf("%d random frames, %ld failed\n", FRAMES, fails);
+    CHECK(fails == 0);
+
+    // Every single bit flip after the address is dropped, the next good
+    // frame still decodes
+    long flipfails = 0;
+    crsfEncodeChannels(frame, ch);
+    for(int bit=8; bit < CRSF_RC_FRAME * 8; bit++) {
+        uint8_t bad[CRSF_RC_FRAME * 4];
+        for(int i=0; i < 4; i++)
+            memcpy(bad + CRSF_RC_FRAME * i, frame, CRSF_RC_FRAME);
+        bad[bit / 8] ^= 1 << (bit % 8);
+        dec.reset();
+        int count = 0;
+        feedAll(dec, bad, CRSF_RC_FRAME, &count);
+        flipfails += count != 0;
+
+        // A longer length can swallow the next two frames, the last is found
+        count = 0;
+        feedAll(dec, bad + CRSF_RC_FRAME, CRSF_RC_FRAME * 3, &count);
+        chanpack::unpack<CRSF_CHANNELS, 11>(dec.payload(), out);
+        flipfails += count < 1 || memcmp(out, ch, sizeof(ch)) != 0;
+    }
+    printf("Bit flips, accepted or not recovered from %ld\n", flipfails);
+    CHECK(flipfails == 0);
+
+    // A length byte that can't be right starts the search again from it
+    dec.reset();
+    dec.feed(CRSF_ADDR_FC);
+    CHECK(feedAll(dec, frame, CRSF_RC_FRAME) == CRSF_FRAMETYPE_RC_CHANNELS_PACKED);
+
+    // Link statistics from the module
+    uint8_t ls[CRSF_LINK_STATS_PAYLOAD + 4] = {CRSF_ADDR_RADIO, CRSF_LINK_STATS_PAYLOAD + 2,
+                                               CRSF_FRAMETYPE_LINK_STATISTICS,
+                                               60, 62, 100, (uint8_t)-5, 1, 4, 3, 70, 98, 8};
+    ls[sizeof(ls) - 1] = crsfCrc8(ls + 2, CRSF_LINK_STATS_PAYLOAD + 1);
+    dec.reset();
+    CHECK(feedAll(dec, ls, sizeof(ls)) == CRSF_FRAMETYPE_LINK_STATISTICS);
+    CrsfLinkStats stats = {};
+    CHECK(crsfParseLinkStats(dec.payload(), dec.payloadLength(), stats));
+    CHECK(stats.uplinkRssi1 == 60 && stats.uplinkLq == 100 && stats.uplinkSnr == -5);
+    CHECK(stats.downlinkRssi == 70 && stats.downlinkLq == 98 && stats.downlinkSnr == 8);
+    CHECK(!crsfParseLinkStats(dec.payload(), CRSF_LINK_STATS_PAYLOAD - 1, stats));
+
+    for(int f=0; f < BENCH_FRAMES; f++) {
+        for(int i=0; i < CRSF_CHANNELS; i++)
+            ch[i] = rand() & chanpack::CH_MAX;
+        crsfEncodeChannels(stream + f * CRSF_RC_FRAME, ch);
+    }
+    int found = 0;
+    double dectime = benchNs(BENCH_PASSES, [&](long) {
+        feedAll(dec, stream, sizeof(stream), &found);
+    });
+    double enctime = benchNs(BENCH_FRAMES * 100, [&](long f) {
+        ch[f & 15] = f & chanpack::CH_MAX;
+        crsfEncodeChannels(frame, ch);
+        found += frame[CRSF_RC_FRAME - 1] & 1;
+    });
+    printf("Decode %.2fns/byte, encode %.1fns/frame (%d)\n", dectime / sizeof(stream), enctime, found);
+
+    return TEST_RESULT();
+}
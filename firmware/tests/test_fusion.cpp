@@ -0,0 +1,174 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Fusion engines on simulated sensors
+//
+// A 2 minute 3 axis motion at 100Hz, started 30deg off in heading, with
+// noise on every sensor and a 0.7deg/s gyro bias. Each engine reports how
+// long it takes to get within 1deg, the rms and max error once settled and
+// the time per 9 axis update. No IMU logs are recorded, so the motion is
+// generated here.
+
+#include <string.h>
+#include "testutil.h"
+#include "MadgwickAHRS/MadgwickAHRS.h"
+#include "MahonyAHRS/MahonyAHRS.h"
+#include "ESKF/ESKF.h"
+
+#define DT 0.01f
+#define STEPS 12000
+#define GYRO_BIAS 0.012f // rad/s, about 0.7deg/s
+#define BENCH_UPDATES 200000
+
+static void qmul(const float a[4], const float b[4], float o[4])
+{
+    o[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+    o[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+    o[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+    o[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+}
+
+// Earth frame vector as the sensor sees it at orientation q
+static void toSensor(const float q[4], const float e[3], float s[3])
+{
+    float qc[4] = {q[0], -q[1], -q[2], -q[3]};
+    float v[4] = {0, e[0], e[1], e[2]}, t[4], r[4];
+    qmul(qc, v, t);
+    qmul(t, q, r);
+    s[0] = r[1]; s[1] = r[2]; s[2] = r[3];
+}
+
+// Angle between two orientations, deg
+static float qangle(const float a[4], const float b[4])
+{
+    float d = fabsf(a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]);
+    return 2 * acosf(fminf(d, 1)) * RAD_TO_DEG;
+}
+
+static const float gravity[3] = {0, 0, 1};
+static const float field[3] = {0.5f, 0, -0.866f};
+
+// Gets at the protected initial orientation
+struct InitialQuat : public ESKF {
+    static void get(const float a[3], const float m[3], float q[4])
+    {
+        initialQuat(a[0], a[1], a[2], m[0], m[1], m[2], q);
+    }
+};
+
+struct Result {
+    float settle; // s
+    double rms;   // deg
+    float max;    // deg
+    double ns;    // per update
+};
+
+static Result run(FusionEngine *e, float startgain)
+{
+    float qt[4] = {1, 0, 0, 0};
+    float qs[4] = {cosf(0.26f), 0, 0, sinf(0.26f)};
+    float bias[3] = {GYRO_BIAS, -GYRO_BIAS * 0.8f, GYRO_BIAS * 0.5f};
+    float a[3], m[3];
+    toSensor(qs, gravity, a);
+    toSensor(qs, field, m);
+    e->begin(a[0], a[1], a[2], m[0], m[1], m[2]);
+    e->startConvergence(startgain, MADG_BETA_DECAY);
+
+    Result r = {-1, 0, 0, 0};
+    int n = 0;
+    for(int i=0; i < STEPS; i++) {
+        float t = i * DT;
+        float w[3] = {0.8f * sinf(t * 1.3f), 0.5f * sinf(t * 0.7f + 1), 1.2f * sinf(t * 0.9f + 2)};
+        if(t < 2)
+            w[0] = w[1] = w[2] = 0;
+
+        // Move the truth on by w
+        float ang = sqrtf(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]) * DT;
+        float dq[4] = {1, 0, 0, 0};
+        if(ang > 0) {
+            float s = sinf(ang / 2) / ang * DT;
+            dq[0] = cosf(ang / 2);
+            dq[1] = w[0] * s; dq[2] = w[1] * s; dq[3] = w[2] * s;
+        }
+        float qn[4];
+        qmul(qt, dq, qn);
+        memcpy(qt, qn, sizeof(qt));
+
+        toSensor(qt, gravity, a);
+        toSensor(qt, field, m);
+        e->update(w[0] + bias[0] + noise(0.01f), w[1] + bias[1] + noise(0.01f), w[2] + bias[2] + noise(0.01f),
+                  a[0] + noise(0.02f), a[1] + noise(0.02f), a[2] + noise(0.02f),
+                  m[0] + noise(0.02f), m[1] + noise(0.02f), m[2] + noise(0.02f), DT);
+
+        float err = qangle(e->getQuat(), qt);
+        if(r.settle < 0 && err < 1)
+            r.settle = t;
+        if(t > 10) {
+            r.rms += err * err;
+            r.max = fmaxf(r.max, err);
+            n++;
+        }
+    }
+    r.rms = sqrt(r.rms / n);
+
+    r.ns = benchNs(BENCH_UPDATES, [&](long) {
+        e->update(0.01f, 0.02f, -0.01f, 0.01f, 0.02f, 0.99f, 0.5f, 0.01f, -0.86f, DT);
+    });
+    return r;
+}
+
+int main()
+{
+    // Initial orientation straight from accel + mag, random orientations
+    float maxerr = 0;
+    for(int i=0; i < 1000; i++) {
+        float q[4] = {noise(1), noise(1), noise(1), noise(1)};
+        float n = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+        for(int j=0; j < 4; j++)
+            q[j] /= n;
+        float a[3], m[3], qi[4];
+        toSensor(q, gravity, a);
+        toSensor(q, field, m);
+        InitialQuat::get(a, m, qi);
+        maxerr = fmaxf(maxerr, qangle(qi, q));
+    }
+    printf("Initial orientation max error %.4fdeg\n", maxerr);
+    CHECK(maxerr < 0.1f); // About the resolution of acos in floats near 1
+
+    Madgwick madgwick;
+    Mahony mahony;
+    ESKF eskf;
+    struct {
+        FusionEngine *engine;
+        float startgain;
+        double maxrms; // deg
+    } engines[] = {
+        {&madgwick, MADG_BETA_START, 5},
+        {&mahony, MAHONY_KP_START, 2},
+        {&eskf, ESKF_ATT_START, 0.5},
+    };
+
+    for(auto &e : engines) {
+        Result r = run(e.engine, e.startgain);
+        printf("%-8s settled %.2fs, %.3fdeg rms, %.3fdeg max, %.0fns/update\n",
+               e.engine->name(), r.settle, r.rms, r.max, r.ns);
+        CHECK(r.settle >= 0);
+        CHECK(r.rms < e.maxrms);
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,218 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The USB joystick against a stubbed HID class, this file plays the host.
+// Constant input sends one report, moving input one per deadband change,
+// buttons and axes decode from the report, the descriptor describes exactly
+// the report, and a report the host never takes is given up after the
+// timeout, also when the host takes it late. Then a write the stack refuses
+// is retried on the next cycle.
+
+#include <string.h>
+#include <zephyr.h>
+#include "testutil.h"
+#include "defines.h"
+#include "trackersettings.h"
+#include "device.h"
+#include "usb/class/usb_hid.h"
+#include "joystick.h"
+
+#define REPORT_LEN 36 // 32 button bits and 16 16 bit axes
+
+TrackerSettings trkset;
+
+// The HID class side, what the host sees
+static const struct device hiddev = {"HID_0"};
+static const uint8_t *hiddesc;
+static size_t hiddesclen;
+static const struct hid_ops *hidops;
+static uint8_t epdata[64];  // Report sitting in the endpoint
+static uint32_t eplen;
+static bool epfull;
+static int writes;
+static int writeerror;      // Returned by the next writes, 0 accepts them
+
+const struct device *device_get_binding(const char *name)
+{
+    return strcmp(name, hiddev.name) == 0 ? &hiddev : NULL;
+}
+
+int hid_int_ep_write(const struct device *dev, const uint8_t *data, uint32_t data_len,
+                     uint32_t *bytes_ret)
+{
+    if(dev != &hiddev || data_len > sizeof(epdata) || epfull)
+        return -1;
+    if(writeerror)
+        return writeerror;
+    memcpy(epdata, data, data_len);
+    eplen = data_len;
+    epfull = true;
+    writes++;
+    if(bytes_ret)
+        *bytes_ret = data_len;
+    return 0;
+}
+
+void usb_hid_register_device(const struct device *dev, const uint8_t *desc, size_t size,
+                             const struct hid_ops *ops)
+{
+    (void)dev;
+    hiddesc = desc;
+    hiddesclen = size;
+    hidops = ops;
+}
+
+int usb_hid_init(const struct device *dev) {(void)dev; return 0;}
+
+// The host polls the endpoint, takes the report if there is one
+static int received;
+static uint8_t lastreport[64];
+
+static void hostPoll()
+{
+    if(!epfull)
+        return;
+    memcpy(lastreport, epdata, eplen);
+    epfull = false;
+    received++;
+    hidops->int_in_ready(&hiddev);
+}
+
+static uint32_t reportButtons() {return lastreport[0] | lastreport[1] << 8 | lastreport[2] << 16 | (uint32_t)lastreport[3] << 24;}
+static int reportAxis(int i) {return lastreport[4 + i * 2] | lastreport[5 + i * 2] << 8;}
+
+// Input bits of the one report in a descriptor, short items only
+static int descriptorInputBits(const uint8_t *desc, size_t len)
+{
+    int bits = 0, size = 0, count = 0;
+    for(size_t i=0; i < len;) {
+        uint8_t prefix = desc[i];
+        int datalen = prefix & 3 ? 1 << ((prefix & 3) - 1) : 0;
+        uint32_t data = 0;
+        for(int j=0; j < datalen; j++)
+            data |= (uint32_t)desc[i + 1 + j] << (j * 8);
+        switch(prefix & 0xFC) {
+        case 0x74: size = data; break;  // REPORT_SIZE
+        case 0x94: count = data; break; // REPORT_COUNT
+        case 0x80: bits += size * count; break; // INPUT
+        case 0x84: return -1;           // REPORT_ID, there's only one report
+        }
+        i += 1 + datalen;
+    }
+    return bits;
+}
+
+int main()
+{
+    uint16_t chans[16];
+    for(int i=0; i < 16; i++)
+        chans[i] = 1500;
+
+    // Nothing happens before init
+    set_JoystickChannels(chans);
+    CHECK(writes == 0);
+
+    joystick_init();
+    CHECK(hidops != NULL && hidops->int_in_ready != NULL);
+    CHECK(descriptorInputBits(hiddesc, hiddesclen) == REPORT_LEN * 8);
+
+    // Constant input, only the first report goes out
+    for(int i=0; i < 1000; i++) {
+        set_JoystickChannels(chans);
+        hostPoll();
+    }
+    CHECK(received == 1 && writes == 1 && eplen == REPORT_LEN);
+    CHECK(reportButtons() == 0);
+    for(int i=0; i < 16; i++)
+        CHECK(reportAxis(i) == 512);
+
+    // A step of one is inside the deadband, the axis has to move past it from
+    // what was last sent. With the host polling every cycle that's a report
+    // every JOYSTICK_DEADBAND + 1 steps
+    received = 0;
+    for(int i=0; i < 300; i++) {
+        chans[3]++;
+        set_JoystickChannels(chans);
+        hostPoll();
+    }
+    CHECK(received == 300 / (JOYSTICK_DEADBAND + 1));
+    CHECK(reportAxis(3) == 512 + 300);
+
+    // Buttons and axes, including clamping and a disabled channel centered
+    const uint16_t in[16] = {2000, 1000, 1500, 0, 3000, 900, 1750, 1250,
+                             1751, 1249, 988, 2011, 1200, 1800, 1500, 1500};
+    memcpy(chans, in, sizeof(chans));
+    set_JoystickChannels(chans);
+    hostPoll();
+    uint32_t but = 0;
+    for(int i=0; i < 16; i++) {
+        uint16_t ch = in[i] ? in[i] : 1500;
+        if(ch >= 1750) but |= 1UL << (i * 2);
+        if(ch <= 1250) but |= 1UL << (i * 2 + 1);
+        CHECK(reportAxis(i) == MAX(MIN((int)ch - 988, 1023), 0));
+    }
+    CHECK(reportButtons() == but);
+    CHECK(reportButtons() == 0x06699909);
+
+    // The host stops polling. Changes wait behind the report in the endpoint
+    // until it's given up on, then the newest goes out
+    int before = writes;
+    chans[0] = 1100;
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 1 && epfull);
+    chans[0] = 1200;
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 1);
+    k_msleep(JOYSTICK_BUSY_TIMEOUT + 20);
+    epfull = false; // Dropped by a bus reset
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 2);
+    hostPoll();
+    CHECK(reportAxis(0) == 1200 - 988);
+
+    // Given up on but the host takes it late. The endpoint refuses the newer
+    // report until then, after it the newest goes out
+    before = writes;
+    chans[2] = 1100;
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 1);
+    chans[2] = 1300;
+    k_msleep(JOYSTICK_BUSY_TIMEOUT + 20);
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 1);
+    hostPoll();
+    CHECK(reportAxis(2) == 1100 - 988);
+    CHECK(writes == before + 2);
+    hostPoll();
+    CHECK(reportAxis(2) == 1300 - 988);
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 2);
+
+    // A refused write is retried on the next cycle, not lost
+    before = writes;
+    writeerror = -11;
+    chans[1] = 1600;
+    set_JoystickChannels(chans);
+    CHECK(writes == before);
+    writeerror = 0;
+    set_JoystickChannels(chans);
+    CHECK(writes == before + 1);
+    hostPoll();
+    CHECK(reportAxis(1) == 1600 - 988);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The Madgwick 9 axis update against the original x-io code it was
+// reworked from, then the time per update of each. The exact square root
+// replaces the fast approximation, so they drift apart slightly.
+
+#include "testutil.h"
+#include "MadgwickAHRS/MadgwickAHRS.h"
+#include "madgwickref.h"
+
+#define STEPS 20000
+#define DT 0.01f
+
+static float in[STEPS][9];
+
+static float angleDiff(float a, float b)
+{
+    float d = fabsf(a - b);
+    return d > 180 ? 360 - d : d;
+}
+
+int main()
+{
+    for(int i=0; i < STEPS; i++) {
+        float t = i * DT;
+        float *v = in[i];
+        v[0] = sinf(t) + noise(0.02f);
+        v[1] = cosf(t * 0.7f) + noise(0.02f);
+        v[2] = 0.5f * sinf(t * 0.3f) + noise(0.02f);
+        v[3] = 0.1f * sinf(t) + noise(0.02f);
+        v[4] = 0.1f * cosf(t) + noise(0.02f);
+        v[5] = 0.98f + noise(0.02f);
+        v[6] = 0.4f + noise(0.05f);
+        v[7] = 0.1f * sinf(t) + noise(0.05f);
+        v[8] = -0.8f + noise(0.05f);
+    }
+
+    Madgwick madg;
+    madg.begin(0.1f, 0.05f, 0.99f, 0.4f, 0.1f, -0.8f);
+    MadgwickRef ref;
+    memcpy(&ref.q0, madg.getQuat(), sizeof(float) * 4);
+
+    float maxq = 0, maxangle = 0;
+    for(int i=0; i < STEPS; i++) {
+        const float *v = in[i];
+        madg.update(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], DT);
+        ref.update(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], DT);
+
+        const float *q = madg.getQuat();
+        const float *r = &ref.q0;
+        for(int k=0; k < 4; k++)
+            maxq = fmaxf(maxq, fabsf(q[k] - r[k]));
+
+        // Same conversion as Madgwick::computeAngles()
+        float rroll = atan2f(r[0]*r[1] + r[2]*r[3], 0.5f - r[1]*r[1] - r[2]*r[2]) * 57.29578f;
+        float rpitch = asinf(-2.0f * (r[1]*r[3] - r[0]*r[2])) * 57.29578f;
+        float ryaw = atan2f(r[1]*r[2] + r[0]*r[3], 0.5f - r[2]*r[2] - r[3]*r[3]) * 57.29578f;
+        // All three angles swing for tiny quaternion changes near +/-90 pitch
+        if(fabsf(rpitch) < 80) {
+            maxangle = fmaxf(maxangle, angleDiff(madg.getRoll(), rroll));
+            maxangle = fmaxf(maxangle, angleDiff(madg.getPitch(), rpitch));
+            maxangle = fmaxf(maxangle, angleDiff(madg.getYaw(), ryaw));
+        }
+    }
+    printf("Over %d steps: max quaternion difference %.2e, max angle difference %.4fdeg\n",
+           STEPS, maxq, maxangle);
+    CHECK(maxq < 1e-3f);
+    CHECK(maxangle < 0.1f);
+
+    double madgtime = benchNs(STEPS * 20, [&](long i) {
+        const float *v = in[i % STEPS];
+        madg.update(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], DT);
+    });
+    double reftime = benchNs(STEPS * 20, [&](long i) {
+        const float *v = in[i % STEPS];
+        ref.update(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], DT);
+    });
+    printf("9 axis update: %.1fns, original %.1fns (%g)\n", madgtime, reftime, madg.getQuat()[0] + ref.q0);
+
+    return TEST_RESULT();
+}
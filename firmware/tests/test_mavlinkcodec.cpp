@@ -0,0 +1,221 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// MAVLink 2 frames, the X.25 check value and each message's crc extra
+// worked out again from its definition. Then every encoder's frame is read
+// back by a separate decoder, header, crc and fields, including the
+// trailing zeros being cut off. Then the time per frame of the encoder.
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "testutil.h"
+#include "mavlinkcodec.h"
+
+#define FRAMES 100000
+#define BENCH_FRAMES 2000000
+
+// A field of a message definition, in wire order
+struct FieldDef {
+    const char *type;
+    const char *name;
+    uint8_t array; // 0 if not an array
+};
+
+// Crc extra the way the MAVLink generator makes it, "NAME " then "type name "
+// of every field that isn't an extension, with the array lengths
+static uint8_t crcExtra(const char *msgname, const FieldDef *fields, int count)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s ", msgname);
+    uint16_t crc = mavlinkCrc((const uint8_t *)buf, strlen(buf));
+    for(int i=0; i < count; i++) {
+        snprintf(buf, sizeof(buf), "%s %s ", fields[i].type, fields[i].name);
+        crc = mavlinkCrc((const uint8_t *)buf, strlen(buf), crc);
+        if(fields[i].array)
+            crc = mavlinkCrcAccumulate(fields[i].array, crc);
+    }
+    return (crc & 0xFF) ^ (crc >> 8);
+}
+
+static const FieldDef heartbeat[] = {
+    {"uint32_t", "custom_mode", 0}, {"uint8_t", "type", 0}, {"uint8_t", "autopilot", 0},
+    {"uint8_t", "base_mode", 0}, {"uint8_t", "system_status", 0}, {"uint8_t", "mavlink_version", 0}
+};
+
+static const FieldDef managerSetAttitude[] = {
+    {"uint32_t", "flags", 0}, {"float", "q", 4}, {"float", "angular_velocity_x", 0},
+    {"float", "angular_velocity_y", 0}, {"float", "angular_velocity_z", 0},
+    {"uint8_t", "target_system", 0}, {"uint8_t", "target_component", 0},
+    {"uint8_t", "gimbal_device_id", 0}
+};
+
+static const FieldDef deviceSetAttitude[] = {
+    {"float", "q", 4}, {"float", "angular_velocity_x", 0}, {"float", "angular_velocity_y", 0},
+    {"float", "angular_velocity_z", 0}, {"uint16_t", "flags", 0},
+    {"uint8_t", "target_system", 0}, {"uint8_t", "target_component", 0}
+};
+
+#define COUNT(a) (int)(sizeof(a) / sizeof(a[0]))
+
+// What a receiver gets out of one frame, the payload zero filled back out
+struct Decoded {
+    uint8_t seq, sysid, compid;
+    uint32_t msgid;
+    int wirelen;
+    uint8_t payload[255];
+};
+
+// Checks the frame is whole and its crc is right for a msg, false if not
+static bool decode(const uint8_t *frame, int len, const MavlinkMsg &msg, Decoded &d)
+{
+    if(len < mavlinkFrameLen(1) || frame[0] != MAVLINK_STX || frame[2] != 0 || frame[3] != 0)
+        return false;
+    d.wirelen = frame[1];
+    if(len != mavlinkFrameLen(d.wirelen) || d.wirelen > msg.length)
+        return false;
+    d.seq = frame[4];
+    d.sysid = frame[5];
+    d.compid = frame[6];
+    d.msgid = frame[7] | frame[8] << 8 | (uint32_t)frame[9] << 16;
+    if(d.msgid != msg.id)
+        return false;
+
+    // Bit by bit X.25, not the byte at a time form the encoder uses
+    uint16_t crc = 0xFFFF;
+    for(int i=1; i < len - MAVLINK_CHECKSUM_LEN + 1; i++) {
+        uint8_t b = i < len - MAVLINK_CHECKSUM_LEN ? frame[i] : msg.crcExtra;
+        crc ^= b;
+        for(int j=0; j < 8; j++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+    if((frame[len - 2] | frame[len - 1] << 8) != crc)
+        return false;
+
+    memset(d.payload, 0, sizeof(d.payload));
+    memcpy(d.payload, frame + MAVLINK_HEADER_LEN, d.wirelen);
+    return true;
+}
+
+static uint32_t getU32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint16_t getU16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static float getF32(const uint8_t *p)
+{
+    uint32_t u = getU32(p);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Same bits, so NaN matches NaN
+static bool sameFloat(float a, float b) { return memcmp(&a, &b, sizeof(a)) == 0; }
+
+static uint8_t frame[mavlinkFrameLen(255)];
+
+int main()
+{
+    srand(1);
+
+    // CRC-16/MCRF4XX check value
+    CHECK(mavlinkCrc((const uint8_t *)"123456789", 9) == 0x6F91);
+
+    CHECK(crcExtra("HEARTBEAT", heartbeat, COUNT(heartbeat)) == 50);
+    CHECK(crcExtra("GIMBAL_MANAGER_SET_ATTITUDE", managerSetAttitude, COUNT(managerSetAttitude)) == 123);
+    CHECK(crcExtra("GIMBAL_DEVICE_SET_ATTITUDE", deviceSetAttitude, COUNT(deviceSetAttitude)) == 99);
+    CHECK(MAVLINK_MSG_HEARTBEAT.crcExtra == 50);
+    CHECK(MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE.crcExtra == 123);
+    CHECK(MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE.crcExtra == 99);
+
+    // Heartbeat, the version byte is last so nothing is cut off
+    Decoded d;
+    MavlinkHeader hdr = {7, 255, 25};
+    int len = mavlinkEncodeHeartbeat(frame, hdr, MAV_TYPE_GCS, MAV_AUTOPILOT_INVALID, MAV_STATE_ACTIVE);
+    CHECK(len == mavlinkFrameLen(MAVLINK_MSG_HEARTBEAT.length));
+    CHECK(decode(frame, len, MAVLINK_MSG_HEARTBEAT, d));
+    CHECK(d.seq == 7 && d.sysid == 255 && d.compid == 25 && d.msgid == 0);
+    CHECK(getU32(d.payload) == 0 && d.payload[4] == MAV_TYPE_GCS && d.payload[5] == MAV_AUTOPILOT_INVALID);
+    CHECK(d.payload[6] == 0 && d.payload[7] == MAV_STATE_ACTIVE && d.payload[8] == 3);
+
+    // A gimbal device id of 0 is the last byte, it's cut off
+    const float level[4] = {1, 0, 0, 0};
+    const float nanrate[3] = {NAN, NAN, NAN};
+    len = mavlinkEncodeGimbalManagerSetAttitude(frame, hdr, 1, MAV_COMP_ID_AUTOPILOT1, 0,
+                                                GIMBAL_FLAGS_ROLL_LOCK | GIMBAL_FLAGS_PITCH_LOCK,
+                                                level, nanrate);
+    CHECK(frame[1] == MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE.length - 1);
+    CHECK(decode(frame, len, MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE, d));
+    CHECK(d.msgid == 282 && getU32(d.payload) == 12);
+
+    // Only one payload byte is left of an all zero payload
+    uint8_t zeros[mavlinkFrameLen(4)];
+    len = MavlinkBuilder(zeros).u32(0).finish(MAVLINK_MSG_HEARTBEAT, 0, 1, 1);
+    CHECK(len == mavlinkFrameLen(1) && zeros[1] == 1);
+
+    // Random attitudes through both gimbal messages
+    long fails = 0;
+    for(int f=0; f < FRAMES; f++) {
+        float q[4], rate[3];
+        for(int i=0; i < 4; i++)
+            q[i] = noise(1);
+        for(int i=0; i < 3; i++)
+            rate[i] = rand() % 4 == 0 ? NAN : noise(10);
+        hdr.seq = f;
+        uint32_t mflags = rand() & 0x1F;
+        uint8_t tsys = rand(), tcomp = rand(), dev = rand() % 2 ? 0 : rand();
+
+        len = mavlinkEncodeGimbalManagerSetAttitude(frame, hdr, tsys, tcomp, dev, mflags, q, rate);
+        bool ok = decode(frame, len, MAVLINK_MSG_GIMBAL_MANAGER_SET_ATTITUDE, d) &&
+                  d.seq == (uint8_t)f && getU32(d.payload) == mflags &&
+                  d.payload[32] == tsys && d.payload[33] == tcomp && d.payload[34] == dev &&
+                  (d.wirelen == 35 || d.payload[d.wirelen - 1] != 0);
+        for(int i=0; i < 4; i++)
+            ok = ok && sameFloat(getF32(d.payload + 4 + i * 4), q[i]);
+        for(int i=0; i < 3; i++)
+            ok = ok && sameFloat(getF32(d.payload + 20 + i * 4), rate[i]);
+        fails += !ok;
+
+        uint16_t dflags = mflags;
+        len = mavlinkEncodeGimbalDeviceSetAttitude(frame, hdr, tsys, tcomp, dflags, q, rate);
+        ok = decode(frame, len, MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE, d) &&
+             getU16(d.payload + 28) == dflags && d.payload[30] == tsys && d.payload[31] == tcomp &&
+             (d.wirelen == 32 || d.payload[d.wirelen - 1] != 0);
+        for(int i=0; i < 4; i++)
+            ok = ok && sameFloat(getF32(d.payload + i * 4), q[i]);
+        for(int i=0; i < 3; i++)
+            ok = ok && sameFloat(getF32(d.payload + 16 + i * 4), rate[i]);
+        fails += !ok;
+
+        // Any flipped bit is caught by the crc or the header checks
+        int bit = rand() % (len * 8);
+        frame[bit / 8] ^= 1 << (bit % 8);
+        fails += decode(frame, len, MAVLINK_MSG_GIMBAL_DEVICE_SET_ATTITUDE, d);
+    }
+    printf("%d random attitudes through both messages, %ld failed\n", FRAMES, fails);
+    CHECK(fails == 0);
+
+    float q[4] = {1, 0, 0, 0};
+    uint32_t sink = 0;
+    double enctime = benchNs(BENCH_FRAMES, [&](long f) {
+        q[f & 3] = f * 1e-6f;
+        hdr.seq = f;
+        sink += mavlinkEncodeGimbalManagerSetAttitude(frame, hdr, 1, 1, 0, 12, q, nanrate);
+        sink += frame[sink % 40];
+    });
+    printf("Encode GIMBAL_MANAGER_SET_ATTITUDE %.1fns/frame (%u)\n", enctime, sink);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// OneEuroBank against the SF1eFilter it replaces, 4 channels of noisy sines
+// with the analog input tuning from sense.cpp, then the time per 4 channel
+// update of each
+
+#include <math.h>
+#include "testutil.h"
+#include "oneeurobank.h"
+#include "SF1eFilter.h"
+
+#define CHANNELS 4
+#define SAMPLES 1000
+#define BENCH_UPDATES 2000000
+
+static float data[SAMPLES][CHANNELS];
+
+int main()
+{
+    for(int t=0; t < SAMPLES; t++)
+        for(int i=0; i < CHANNELS; i++)
+            data[t][i] = sinf(t * 0.01f * (i + 1)) * 3 + noise(0.05f);
+
+    OneEuroBank<CHANNELS> bank;
+    bank.init(150, 0.02, 6, 1);
+    SF1eFilter *sf[CHANNELS];
+    for(int i=0; i < CHANNELS; i++) {
+        sf[i] = SF1eFilterCreate(150, 0.02, 6, 1);
+        SF1eFilterInit(sf[i]);
+    }
+
+    // Same output as SF1eFilter, all channels at once and one at a time
+    OneEuroBank<CHANNELS> single;
+    single.init(150, 0.02, 6, 1);
+    float out[CHANNELS];
+    double maxerr = 0;
+    for(int t=0; t < SAMPLES; t++) {
+        bank.update(data[t], out);
+        for(int i=0; i < CHANNELS; i++) {
+            float ref = SF1eFilterDo(sf[i], data[t][i]);
+            maxerr = fmax(maxerr, fabs(ref - out[i]));
+            CHECK(single.update(i, data[t][i]) == out[i]);
+        }
+    }
+    printf("Max difference from SF1eFilter %g\n", maxerr);
+    CHECK(maxerr < 1e-4);
+
+    // A reset channel starts again on it's next sample
+    bank.reset(2);
+    float step[CHANNELS] = {0, 0, 100, 0};
+    bank.update(step, out);
+    CHECK(out[2] == 100);
+
+    float acc = 0;
+    double banktime = benchNs(BENCH_UPDATES, [&](long t) {
+        bank.update(data[t % SAMPLES], out);
+        acc += out[0];
+    });
+    double sftime = benchNs(BENCH_UPDATES, [&](long t) {
+        for(int i=0; i < CHANNELS; i++)
+            out[i] = SF1eFilterDo(sf[i], data[t % SAMPLES][i]);
+        acc += out[0];
+    });
+    printf("4 channel update: OneEuroBank %.1fns, SF1eFilter %.1fns (%g)\n", banktime, sftime, acc);
+
+    for(int i=0; i < CHANNELS; i++)
+        SF1eFilterDestroy(sf[i]);
+    return TEST_RESULT();
+}
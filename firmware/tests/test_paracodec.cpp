@@ -0,0 +1,225 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// PARA byte stuffing, round trips random and 7E/7D heavy channels through
+// the encoder and decoder with the frames split at random. Also decodes
+// OpenTX's frames, which don't stuff the crc, and checks OpenTX's decoder
+// reads ours whenever it reads it's own. It drops a frame with a 0A in it,
+// the buffer is shared with the AT command replies. Then the time per byte
+// of the decoder against OpenTX's.
+
+#include <string.h>
+#include <stdlib.h>
+#include "testutil.h"
+#include "paracodec.h"
+
+#define FRAMES 1000000
+#define BENCH_FRAMES 1000
+#define BENCH_PASSES 2000
+
+// OpenTX's encoder, the crc is not stuffed
+static int otxEncode(uint8_t *out, const uint16_t ch[PARA_CHANNELS])
+{
+    uint8_t *p = out;
+    uint8_t crc = 0;
+    auto push = [&p, &crc](uint8_t byte) {
+        crc ^= byte;
+        if(byte == PARA_START_STOP || byte == PARA_BYTE_STUFF) {
+            *p++ = PARA_BYTE_STUFF;
+            byte ^= PARA_STUFF_MASK;
+        }
+        *p++ = byte;
+    };
+
+    *p++ = PARA_START_STOP;
+    push(PARA_TRAINER_FRAME);
+    for(int i=0; i < PARA_CHANNELS; i+=2) {
+        push(ch[i] & 0xFF);
+        push(((ch[i] & 0xF00) >> 4) | ((ch[i+1] & 0xF0) >> 4));
+        push(((ch[i+1] & 0x0F) << 4) | ((ch[i+1] & 0xF00) >> 8));
+    }
+    *p++ = crc;
+    *p++ = PARA_START_STOP;
+    return p - out;
+}
+
+// OpenTX's byte at a time decoder
+class OtxDecoder {
+public:
+    bool got = false;
+    uint16_t ch[PARA_CHANNELS];
+
+    void push(uint8_t data)
+    {
+        switch(state) {
+        case START:
+            if(data == PARA_START_STOP) {
+                index = 0;
+                state = IN_FRAME;
+            } else {
+                append(data);
+            }
+            break;
+        case IN_FRAME:
+        case DATA:
+            if(data == PARA_BYTE_STUFF && state == DATA) {
+                state = XOR;
+            } else if(data == PARA_START_STOP) {
+                index = 0;
+                state = DATA;
+            } else {
+                append(data);
+            }
+            break;
+        case XOR:
+            append(data ^ PARA_STUFF_MASK);
+            state = DATA;
+            break;
+        }
+
+        if(index >= PARA_PACKET_SIZE) {
+            uint8_t crc = 0;
+            for(int i=0; i < PARA_PACKET_SIZE - 1; i++)
+                crc ^= buffer[i];
+            if(crc == buffer[PARA_PACKET_SIZE - 1] && buffer[0] == PARA_TRAINER_FRAME) {
+                got = true;
+                for(int c=0, i=1; c < PARA_CHANNELS; c+=2, i+=3) {
+                    ch[c] = buffer[i] + ((buffer[i+1] & 0xF0) << 4);
+                    ch[c+1] = ((buffer[i+1] & 0x0F) << 4) + ((buffer[i+2] & 0xF0) >> 4) +
+                              ((buffer[i+2] & 0x0F) << 8);
+                }
+            }
+            state = START;
+        }
+    }
+
+private:
+    enum { START, IN_FRAME, XOR, DATA } state = START;
+    uint8_t buffer[32];
+    int index = 0;
+
+    void append(uint8_t data)
+    {
+        if(index < (int)sizeof(buffer)) {
+            buffer[index++] = data;
+            if(data == '\n')
+                index = 0;
+        }
+    }
+};
+
+static uint8_t frameCrc(const uint16_t ch[PARA_CHANNELS])
+{
+    uint8_t enc[PARA_MAX_FRAME];
+    int len = otxEncode(enc, ch);
+    return enc[len - 2];
+}
+
+static uint8_t stream[BENCH_FRAMES * PARA_MAX_FRAME];
+
+int main()
+{
+    srand(1);
+    ParaDecoder dec;
+    bool crcseen[256] = {false};
+    long fails = 0, otxfails = 0, otxmismatch = 0;
+    int maxlen = 0;
+
+    // OpenTX's decoder only unstuffs after it has seen two 7E's, it's fed
+    // the whole stream so the end of one frame starts the next
+    OtxDecoder otxdec, otxref;
+
+    for(long f=0; f < FRAMES; f++) {
+        // Every third frame only uses values made of 7E and 7D nibbles
+        uint16_t ch[PARA_CHANNELS];
+        for(int i=0; i < PARA_CHANNELS; i++)
+            ch[i] = f % 3 == 0 ? (rand() % 2 ? 0x7E7 : 0xD7D) : rand() & 0xFFF;
+        crcseen[frameCrc(ch)] = true;
+
+        uint8_t ours[PARA_MAX_FRAME], otx[PARA_MAX_FRAME];
+        int ourlen = paraEncode(ours, ch);
+        int otxlen = otxEncode(otx, ch);
+        if(ourlen > maxlen)
+            maxlen = ourlen;
+
+        for(int k=0; k < 2; k++) {
+            const uint8_t *frame = k ? otx : ours;
+            int len = k ? otxlen : ourlen;
+            int split = rand() % (len + 1);
+            uint16_t out[PARA_CHANNELS] = {0};
+            bool ok = dec.decode(frame, split, out);
+            ok |= dec.decode(frame + split, len - split, out);
+            if(!ok || memcmp(out, ch, sizeof(ch)))
+                fails++;
+        }
+
+        otxdec.got = otxref.got = false;
+        for(int i=0; i < ourlen; i++)
+            otxdec.push(ours[i]);
+        for(int i=0; i < otxlen; i++)
+            otxref.push(otx[i]);
+        bool otxok = otxdec.got && !memcmp(otxdec.ch, ch, sizeof(ch));
+        bool refok = otxref.got && !memcmp(otxref.ch, ch, sizeof(ch));
+        otxfails += !otxok;
+        otxmismatch += refok && !otxok;
+    }
+
+    int crcs = 0;
+    for(int i=0; i < 256; i++)
+        crcs += crcseen[i];
+    printf("%d frames, %d crc values, longest %d bytes\n", FRAMES, crcs, maxlen);
+    printf("Decode failures %ld, OpenTX drops %ld, missed where it read it's own %ld\n",
+           fails, otxfails, otxmismatch);
+    CHECK(crcs == 256);
+    CHECK(maxlen <= PARA_MAX_FRAME);
+    CHECK(fails == 0);
+    CHECK(otxmismatch == 0);
+
+    // Resyncs on a frame after garbage
+    uint16_t ch[PARA_CHANNELS] = {1, 2, 3, 4, 5, 6, 7, 8}, out[PARA_CHANNELS];
+    uint8_t buf[10 + PARA_MAX_FRAME];
+    memset(buf, PARA_BYTE_STUFF, 10);
+    buf[3] = PARA_START_STOP;
+    int len = paraEncode(buf + 10, ch);
+    dec.reset();
+    CHECK(dec.decode(buf, len + 10, out) && !memcmp(out, ch, sizeof(ch)));
+
+    // A bad crc is dropped
+    buf[10 + len - 2] ^= 1;
+    dec.reset();
+    CHECK(!dec.decode(buf + 10, len, out));
+
+    int streamlen = 0;
+    for(int f=0; f < BENCH_FRAMES; f++) {
+        for(int i=0; i < PARA_CHANNELS; i++)
+            ch[i] = rand() & 0xFFF;
+        streamlen += paraEncode(stream + streamlen, ch);
+    }
+    long found = 0;
+    double ourtime = benchNs(BENCH_PASSES, [&](long) {
+        found += dec.decode(stream, streamlen, out);
+    });
+    double otxtime = benchNs(BENCH_PASSES, [&](long) {
+        for(int i=0; i < streamlen; i++)
+            otxdec.push(stream[i]);
+        found += otxdec.got;
+    });
+    printf("Decode per byte: ParaDecoder %.2fns, OpenTX %.2fns (%ld)\n",
+           ourtime / streamlen, otxtime / streamlen, found);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Output prediction replay. A 0.7Hz +/-40deg pan with noisy gyro is sent
+// through 30ms of output latency, the rms error against where the head
+// really is is compared with and without a 30ms prediction. Also the
+// MAVLink quaternion of each output angle on its own and a round trip
+// through the front-right-down Euler angles
+
+#include <math.h>
+#include "testutil.h"
+#include "defines.h"
+#include "orientation.h"
+
+#define RATE 166.0f
+#define LATENCY 5 // Cycles, 30ms
+#define SAMPLES 3000
+
+// Roll, pitch and yaw of a front-right-down quaternion, z-y-x order
+static void eulerFRD(const float q[4], float &r, float &p, float &y)
+{
+    r = atan2f(2 * (q[0]*q[1] + q[2]*q[3]), 1 - 2 * (q[1]*q[1] + q[2]*q[2])) * RAD_TO_DEG;
+    p = asinf(2 * (q[0]*q[2] - q[3]*q[1])) * RAD_TO_DEG;
+    y = atan2f(2 * (q[0]*q[3] + q[1]*q[2]), 1 - 2 * (q[2]*q[2] + q[3]*q[3])) * RAD_TO_DEG;
+}
+
+static float panOf(const float q[4])
+{
+    float t, r, p;
+    quatToAngles(q, t, r, p);
+    return p;
+}
+
+int main()
+{
+    const float dt = 1.0f / RATE;
+    const float w = 2 * M_PI * 0.7f;
+
+    // Still or under the deadzone, nothing moves
+    float q[4] = {1, 0, 0, 0}, out[4];
+    predictOrientation(q, 0, 0, PREDICT_DEADZONE * 0.9f, 0.1f, out);
+    CHECK(out[0] == 1 && out[3] == 0);
+    predictOrientation(q, 0, 0, 200, 0, out);
+    CHECK(out[0] == 1 && out[3] == 0);
+
+    // Step is limited to PREDICT_MAX_ANGLE
+    predictOrientation(q, 0, 0, 1000, 1, out);
+    CHECK_NEAR(panOf(out), PREDICT_MAX_ANGLE, 1e-3);
+
+    // Gyro z of the sensor frame moves pan
+    predictOrientation(q, 0, 0, 100 + PREDICT_DEADZONE, 0.05f, out);
+    CHECK_NEAR(panOf(out), 5, 1e-3);
+
+    // Tilt is pitch about y, roll about x, pan is yaw about z but clockwise
+    float s15 = sinf(15 * DEG_TO_RAD), c15 = cosf(15 * DEG_TO_RAD);
+    anglesToQuat(30, 0, 0, out);
+    CHECK_NEAR(out[0], c15, 1e-6); CHECK_NEAR(out[1], 0, 1e-6);
+    CHECK_NEAR(out[2], s15, 1e-6); CHECK_NEAR(out[3], 0, 1e-6);
+    anglesToQuat(0, 30, 0, out);
+    CHECK_NEAR(out[0], c15, 1e-6); CHECK_NEAR(out[1], s15, 1e-6);
+    CHECK_NEAR(out[2], 0, 1e-6); CHECK_NEAR(out[3], 0, 1e-6);
+    anglesToQuat(0, 0, 30, out);
+    CHECK_NEAR(out[0], c15, 1e-6); CHECK_NEAR(out[1], 0, 1e-6);
+    CHECK_NEAR(out[2], 0, 1e-6); CHECK_NEAR(out[3], -s15, 1e-6);
+
+    float maxerr = 0;
+    for(int i=0; i < 10000; i++) {
+        float t = noise(80), r = noise(170), p = noise(170);
+        float er, ep, ey;
+        anglesToQuat(t, r, p, out);
+        eulerFRD(out, er, ep, ey);
+        maxerr = fmaxf(maxerr, fmaxf(fabsf(er - r), fmaxf(fabsf(ep - t), fabsf(ey + p))));
+    }
+    printf("Tilt, roll and pan through the MAVLink quaternion, max error %.5fdeg\n", maxerr);
+    CHECK(maxerr < 0.01f);
+
+    static float seen[SAMPLES];
+    double plainerr=0, prederr=0;
+    int n=0;
+    for(int i=0; i < SAMPLES; i++) {
+        float t = i * dt;
+        float yaw = 40 * sinf(w * t);
+        float gz = 40 * w * cosf(w * t) + noise(1);
+
+        float qt[4] = {cosf(yaw * DEG_TO_RAD / 2), 0, 0, sinf(yaw * DEG_TO_RAD / 2)};
+        predictOrientation(qt, 0, 0, gz, LATENCY * dt, out);
+        seen[i] = panOf(out);
+
+        // What's output now was calculated LATENCY cycles ago
+        if(i >= LATENCY) {
+            float plain = 40 * sinf(w * (t - LATENCY * dt));
+            plainerr += (plain - yaw) * (plain - yaw);
+            prederr += (seen[i - LATENCY] - yaw) * (seen[i - LATENCY] - yaw);
+            n++;
+        }
+    }
+    plainerr = sqrt(plainerr / n);
+    prederr = sqrt(prederr / n);
+    printf("RMS error with 30ms latency: %.3fdeg without prediction, %.3fdeg with 30ms prediction\n",
+           plainerr, prederr);
+    CHECK(prederr < plainerr / 4);
+
+    return TEST_RESULT();
+}
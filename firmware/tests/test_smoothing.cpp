@@ -0,0 +1,99 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Output smoothing replay, the fixed exponential average against the
+// adaptive One Euro mode, run the same way as calculate_Thread does.
+//
+// 6s still with 0.2deg of noise, then a 300deg/s turn for 0.5s. Jitter is
+// the rms output while still, lag the mean delay behind the true angle
+// during the turn.
+
+#include <math.h>
+#include "testutil.h"
+#include "oneeurobank.h"
+#include "filters.h"
+
+#define RATE 166.0f
+#define TURN_START 6.0f
+#define TURN_END 6.5f
+#define TURN_SPEED 300.0f // deg/s
+
+struct Result {
+    double jitter; // deg rms
+    double lag;    // ms
+};
+
+// beta > 0 runs the fixed filter, else adaptive with mincut/slope
+static Result replay(float beta, float mincut, float slope)
+{
+    const float dt = 1.0f / RATE;
+    OneEuroBank<1> adaptive;
+    adaptive.init(RATE, mincut, slope, 1);
+    float last = 0;
+    double jitter=0, lag=0;
+    int njitter=0, nlag=0;
+
+    for(int t=0; t < 3000; t++) {
+        float time = t * dt;
+        float truth = 0, gyr = 0;
+        if(time >= TURN_START && time < TURN_END) {
+            truth = (time - TURN_START) * TURN_SPEED;
+            gyr = TURN_SPEED;
+        } else if(time >= TURN_END) {
+            truth = (TURN_END - TURN_START) * TURN_SPEED;
+        }
+        gyr += noise(1);
+
+        float out = truth + noise(0.2f);
+        if(beta > 0)
+            filter_expAverage(&out, beta, &last);
+        else
+            adaptive.update(&out, &gyr, &out, dt);
+
+        if(time > 2 && time < TURN_START) {
+            jitter += out * out;
+            njitter++;
+        }
+        // Skip the start of the turn, the filters are catching up
+        if(time > TURN_START + 0.1f && time < TURN_END) {
+            lag += (truth - out) / TURN_SPEED;
+            nlag++;
+        }
+    }
+    Result r = {sqrt(jitter / njitter), lag / nlag * 1000};
+    return r;
+}
+
+int main()
+{
+    Result fixed90 = replay(0.9f, 0, 0);
+    Result fixed50 = replay(0.5f, 0, 0);
+    Result adapt = replay(0, 0.5f, 0.2f); // DEF_LP_MINCUT, DEF_LP_SLOPE
+
+    printf("Fixed, lptiltroll 90: %.3fdeg rms jitter, %.1fms lag\n", fixed90.jitter, fixed90.lag);
+    printf("Fixed, lptiltroll 50: %.3fdeg rms jitter, %.1fms lag\n", fixed50.jitter, fixed50.lag);
+    printf("Adaptive, defaults:   %.3fdeg rms jitter, %.1fms lag\n", adapt.jitter, adapt.lag);
+
+    // Adaptive should be steadier than either fixed setting, and trail the
+    // turn less than the heavier fixed one
+    CHECK(adapt.jitter < fixed90.jitter);
+    CHECK(adapt.jitter < fixed50.jitter);
+    CHECK(adapt.lag < fixed50.lag);
+    CHECK(adapt.lag < 5);
+
+    return TEST_RESULT();
+}
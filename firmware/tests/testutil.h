@@ -0,0 +1,60 @@
+/*
+ * This file is part of the Head Tracker distribution (https://github.com/dlktdr/headtracker)
+ * Copyright (c) 2022 Cliff Blackburn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+// Minimal checks for the host tests, a failed check is counted and printed
+// and the test exits with TEST_RESULT()
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } } while(0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+    double _a = (a), _b = (b); \
+    if(!(_a - _b <= (tol) && _b - _a <= (tol))) { \
+        printf("%s:%d: %s = %g, expected %g +/- %g\n", __FILE__, __LINE__, #a, _a, _b, (double)(tol)); \
+        test_failures++; \
+    } } while(0)
+
+#define TEST_RESULT() (printf("%s\n", test_failures ? "FAILED" : "OK"), test_failures ? 1 : 0)
+
+// Time per call of f in ns, averaged over count calls
+template<typename F> double benchNs(long count, F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(long i=0; i < count; i++)
+        f(i);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / count;
+}
+
+// Uniform noise in +/- amp, same sequence on every run
+static inline float noise(float amp)
+{
+    static uint32_t seed = 1;
+    seed = seed * 1664525u + 1013904223u;
+    return ((seed >> 8) / 16777216.0f - 0.5f) * 2.0f * amp;
+}
@@ -90,6 +90,7 @@ void BoardNano33BLE::saveToRAM()
     d2s.remove("axissign");
     d2s.remove("Hard");
     d2s.remove("Vers");
+    d2s.remove("btcache"); // Kept by the board, an old copy would undo it
     // If no changes, return
     if(d2s.count() == 0)
         return;
@@ -199,11 +200,24 @@ void BoardNano33BLE::changeDataItems()
 {
     QMap<QString,bool> toChange = trkset->getDataItemsDiff();
 
+    // Enabled items with a requested rate send the rate in hz instead of true,
+    // with a deadband too they are sent as {"hz":rate,"db":deadband}
     QVariantMap di;
     QMapIterator<QString, bool> i(toChange);
     while (i.hasNext()) {
         i.next();
-        di[i.key()] = i.value();
+        int rate = trkset->dataItemRate(i.key());
+        float deadband = trkset->dataItemDeadband(i.key());
+        if(i.value() && deadband > 0) {
+            QVariantMap item;
+            item["hz"] = rate;
+            item["db"] = deadband;
+            di[i.key()] = item;
+        } else if(i.value() && rate > 0) {
+            di[i.key()] = rate;
+        } else {
+            di[i.key()] = i.value();
+        }
     }
     sendSerialJSON("RD",di);
 
@@ -363,6 +377,19 @@ void BoardNano33BLE::parseIncomingJSON(const QVariantMap &map)
 
                 // Don't add it as encoded
                 cmap.remove(it.key());
+
+            // Delta encoded arrays, only the elements that changed
+            } else if(it.key().startsWith('7')) {
+                QByteArray arr = QByteArray::fromBase64(it.value().toByteArray());
+                QString name = it.key().mid(1,it.key().length()-4);
+                if(it.key().endsWith("u16")) {
+                    setDeltaLiveData<uint16_t>(name, arr);
+                } else if(it.key().endsWith("u8")) {
+                    setDeltaLiveData<uint8_t>(it.key().mid(1,it.key().length()-3), arr);
+                } else if(it.key().endsWith("flt")) {
+                    setDeltaLiveData<float>(name, arr);
+                }
+                cmap.remove(it.key());
             }
         }
 
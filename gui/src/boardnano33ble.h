@@ -84,6 +84,24 @@ private:
         }
     };
 
+    // Delta encoded array, 32bit mask of the changed elements then their values
+    template <class T>
+    void setDeltaLiveData(const QString &name, const QByteArray &ba) {
+        if(ba.size() < (int)sizeof(uint32_t))
+            return;
+        uint32_t mask;
+        memcpy(&mask, ba.constData(), sizeof(mask));
+        const char *values = ba.constData() + sizeof(mask);
+        int count = (ba.size() - sizeof(mask)) / sizeof(T);
+        for(int i=0, j=0; i < 32 && j < count; i++) {
+            if(mask & (1UL << i)) {
+                T value;
+                memcpy(&value, values + j++ * sizeof(T), sizeof(T));
+                trkset->setLiveData(name + QString("[%1]").arg(i), value);
+            }
+        }
+    }
+
 private slots:
 
     void ihTimeout();
@@ -20,6 +20,8 @@ DiagnosticDisplay::DiagnosticDisplay(TrackerSettings *ts, QWidget *parent) :
     ui->tblLiveData->setModel(model);
     //ui->tblLiveData->setStyleSheet("QTreeView::item {padding-left: 0px; border: 0px}");
     ui->tblLiveData->resizeColumnToContents(0);
+    ui->tblLiveData->resizeColumnToContents(2);
+    ui->tblLiveData->resizeColumnToContents(3);
     ui->tblLiveData->horizontalHeader()->setSectionResizeMode(1,QHeaderView::Stretch);
 }
 
@@ -64,7 +66,9 @@ DataModel::DataModel(TrackerSettings *ts, QObject *parent)
     dataitem->checked = false;
     dataitem->name = di;
     dataitem->index0 = createIndex(i,0,dataitem);
-    dataitem->index1 = createIndex(i++,1,dataitem);
+    dataitem->index1 = createIndex(i,1,dataitem);
+    dataitem->index2 = createIndex(i,2,dataitem);
+    dataitem->index3 = createIndex(i++,3,dataitem);
     datalist.append(dataitem);
   }
   connect(trkset,&TrackerSettings::liveDataChanged, this, &DataModel::dataupdate);
@@ -82,6 +86,9 @@ Qt::ItemFlags DataModel::flags(const QModelIndex &index) const
   if(index.column() == 0)
     return Qt::ItemIsUserCheckable |
            Qt::ItemIsEnabled;
+  if(index.column() == COL_RATE || index.column() == COL_DEADBAND)
+    return Qt::ItemIsEditable |
+           Qt::ItemIsEnabled;
   return Qt::ItemIsEnabled;
 }
 
@@ -106,6 +113,22 @@ bool DataModel::setData(const QModelIndex &index, const QVariant &value, int rol
     }
     return true;
   }
+
+  // Rates are per item, all elements of an array share one
+  if(index.column() == COL_RATE && role == Qt::EditRole && index.row() < datalist.count()) {
+    QString key = itemKey(datalist.at(index.row()));
+    trkset->setDataItemRate(key, qBound(0, value.toInt(), TrackerSettings::MAX_DATA_RATE));
+    keyChanged(key, COL_RATE);
+    return true;
+  }
+
+  // Same for deadbands, an array is resent once any element moves by more
+  if(index.column() == COL_DEADBAND && role == Qt::EditRole && index.row() < datalist.count()) {
+    QString key = itemKey(datalist.at(index.row()));
+    trkset->setDataItemDeadband(key, qMax(0.0, value.toDouble()));
+    keyChanged(key, COL_DEADBAND);
+    return true;
+  }
   return false;
 }
 
@@ -122,6 +145,19 @@ QVariant DataModel::data(const QModelIndex &index, int role) const
     if(index.column() == 1) {
         return datalist.at(index.row())->value;
     }
+    if(index.column() == COL_RATE) {
+        int rate = trkset->dataItemRate(itemKey(datalist.at(index.row())));
+        return rate > 0 ? QVariant(rate) : QVariant(tr("Default"));
+    }
+    if(index.column() == COL_DEADBAND) {
+        float deadband = trkset->dataItemDeadband(itemKey(datalist.at(index.row())));
+        return deadband > 0 ? QVariant(deadband) : QVariant(tr("Any change"));
+    }
+  } else if(role == Qt::EditRole) {
+    if(index.column() == COL_RATE)
+        return trkset->dataItemRate(itemKey(datalist.at(index.row())));
+    if(index.column() == COL_DEADBAND)
+        return (double)trkset->dataItemDeadband(itemKey(datalist.at(index.row())));
   } else if (role == Qt::CheckStateRole) {
       if(index.column() == 0)
         return datalist.at(index.row())->checked?Qt::Checked:Qt::Unchecked;
@@ -139,6 +175,10 @@ QModelIndex DataModel::index(int row, int column, const QModelIndex &parent) con
     return datalist.at(row)->index0;
   else if (column == 1)
     return datalist.at(row)->index1;
+  else if (column == COL_RATE)
+    return datalist.at(row)->index2;
+  else if (column == COL_DEADBAND)
+    return datalist.at(row)->index3;
 
   return QModelIndex();
 }
@@ -158,6 +198,10 @@ QVariant DataModel::headerData(int section, Qt::Orientation orientation, int rol
     return tr("Item");
   if(section == 1)
     return tr("Value");
+  if(section == COL_RATE)
+    return tr("Rate (Hz)");
+  if(section == COL_DEADBAND)
+    return tr("Deadband");
   return QVariant();
 }
 
@@ -172,6 +216,16 @@ void DataModel::checkArray(QString array, bool checked)
   }
 }
 
+void DataModel::keyChanged(const QString &key, int column)
+{
+  foreach(DataItem *itm, datalist) {
+    if(itemKey(itm) == key) {
+      QModelIndex idx = index(itm->index0.row(), column);
+      Q_EMIT(dataChanged(idx,idx));
+    }
+  }
+}
+
 void DataModel::dataupdate()
 {
   // Update local map of data
@@ -36,6 +36,8 @@ public:
     bool checked;
     QModelIndex index0;
     QModelIndex index1;
+    QModelIndex index2;
+    QModelIndex index3;
 };
 
 class DataModel : public QAbstractItemModel
@@ -51,10 +53,13 @@ public:
   QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
   QModelIndex parent(const QModelIndex &index) const override;
   int rowCount(const QModelIndex &parent = QModelIndex()) const override {Q_UNUSED(parent); return datalist.count()-1;}
-  int columnCount(const QModelIndex &parent = QModelIndex()) const override {Q_UNUSED(parent); return 2;}
+  int columnCount(const QModelIndex &parent = QModelIndex()) const override {Q_UNUSED(parent); return 4;}
   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 private:
+  enum {COL_RATE=2, COL_DEADBAND};
+  static QString itemKey(const DataItem *itm) {return itm->name.mid(0,itm->name.indexOf('['));}
   void checkArray(QString array, bool checked);
+  void keyChanged(const QString &key, int column);
   TrackerSettings *trkset;
   QList<DataItem *> datalist;
 private slots:
@@ -118,8 +118,13 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->chkInvertedPPM,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
     connect(ui->chkInvertedPPMIn,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
     connect(ui->chkResetCenterWave,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
+    connect(ui->chkBTOnChange,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
     connect(ui->chkSbusInInv,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
     connect(ui->chkSbusOutInv,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
+    connect(ui->chkSbusHWTimed,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
+    connect(ui->chkMavGimbalDevice,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
+    connect(ui->cmdSerial,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmdSerial,SIGNAL(currentIndexChanged(int)),ui->stkSerial,SLOT(setCurrentIndex(int)));
     connect(ui->chkLngBttnPress,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
     connect(ui->chkRstOnTlt,SIGNAL(clicked(bool)),this,SLOT(updateFromUI()));
 
@@ -130,6 +135,10 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->spnLPTiltRoll,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->spnLPPan2,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->spnLPTiltRoll2,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->spnLPMinCut,SIGNAL(valueChanged(double)),this,SLOT(updateFromUI()));
+    connect(ui->spnLPSlope,SIGNAL(valueChanged(double)),this,SLOT(updateFromUI()));
+    connect(ui->spnPredict,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->spnFusionDiv,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->spnPPMSync,SIGNAL(valueChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->spnPPMFrameLen,SIGNAL(valueChanged(double)),this,SLOT(updateFromUI()));
     connect(ui->spnA4Gain,SIGNAL(valueChanged(double)),this,SLOT(updateFromUI()));
@@ -181,6 +190,25 @@ MainWindow::MainWindow(QWidget *parent)
     ui->cmbRemap->addItem("Z,Y,Z",AXES_MAP(AXIS_Z,AXIS_Y,AXIS_X));
     ui->cmbRemap->setCurrentIndex(0);
 
+        // IMU rates and ranges, data is the setting value
+    ui->cmbIMURate->addItem("119 Hz",119);
+    ui->cmbIMURate->addItem("238 Hz",238);
+    ui->cmbIMURate->addItem("476 Hz",476);
+    ui->cmbGyroBW->addItem("Lowest",0);
+    ui->cmbGyroBW->addItem("Low",1);
+    ui->cmbGyroBW->addItem("Medium",2);
+    ui->cmbGyroBW->addItem("High",3);
+    ui->cmbGyroFS->addItem("245 deg/s",245);
+    ui->cmbGyroFS->addItem("500 deg/s",500);
+    ui->cmbGyroFS->addItem("2000 deg/s",2000);
+    ui->cmbAccFS->addItem("2 g",2);
+    ui->cmbAccFS->addItem("4 g",4);
+    ui->cmbAccFS->addItem("8 g",8);
+    ui->cmbAccFS->addItem("16 g",16);
+    ui->cmbMagRate->addItem("20 Hz",20);
+    ui->cmbMagRate->addItem("40 Hz",40);
+    ui->cmbMagRate->addItem("80 Hz",80);
+
     connect(ui->cmbpanchn,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbtiltchn,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbrllchn,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
@@ -188,6 +216,13 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->cmbRemap,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbSigns,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbButtonPin,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbLPMode,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbFusion,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbIMURate,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbGyroBW,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbGyroFS,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbAccFS,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
+    connect(ui->cmbMagRate,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbPpmInPin,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbPpmOutPin,SIGNAL(currentIndexChanged(int)),this,SLOT(updateFromUI()));
     connect(ui->cmbBtMode,SIGNAL(currentIndexChanged(int)),this,SLOT(BTModeChanged()));
@@ -549,8 +584,12 @@ void MainWindow::updateToUI()
     ui->chkInvertedPPM->setChecked(trkset.invertedPpmOut());
     ui->chkInvertedPPMIn->setChecked(trkset.invertedPpmIn());
     ui->chkResetCenterWave->setChecked(trkset.resetOnWave());
+    ui->chkBTOnChange->setChecked(trkset.btNotifyOnChange());
     ui->chkSbusInInv->setChecked(trkset.invertedSBUSIn());
     ui->chkSbusOutInv->setChecked(trkset.invertedSBUSOut());
+    ui->chkSbusHWTimed->setChecked(trkset.SBUSHWTimed());
+    ui->chkMavGimbalDevice->setChecked(trkset.MAVGimbalDevice());
+    ui->cmdSerial->setCurrentIndex(trkset.serialMode());
     ui->chkLngBttnPress->setChecked(trkset.buttonPressMode());
     ui->chkRstOnTlt->setChecked(trkset.resetOnTiltMode());
 
@@ -567,6 +606,17 @@ void MainWindow::updateToUI()
     ui->spnLPPan->setValue(trkset.lpPan());
     ui->spnLPTiltRoll2->setValue(trkset.lpTiltRoll());
     ui->spnLPPan2->setValue(trkset.lpPan());
+    ui->cmbLPMode->setCurrentIndex(trkset.lpMode());
+    ui->spnLPMinCut->setValue(trkset.lpMinCutoff());
+    ui->spnLPSlope->setValue(trkset.lpSlope());
+    ui->spnPredict->setValue(trkset.predictTime());
+    ui->cmbFusion->setCurrentIndex(trkset.fusionEngine());
+    ui->cmbIMURate->setCurrentIndex(ui->cmbIMURate->findData(trkset.imuODR()));
+    ui->cmbGyroBW->setCurrentIndex(ui->cmbGyroBW->findData(trkset.gyroBW()));
+    ui->cmbGyroFS->setCurrentIndex(ui->cmbGyroFS->findData(trkset.gyroFS()));
+    ui->cmbAccFS->setCurrentIndex(ui->cmbAccFS->findData(trkset.accFS()));
+    ui->cmbMagRate->setCurrentIndex(ui->cmbMagRate->findData(trkset.magODR()));
+    ui->spnFusionDiv->setValue(trkset.fusionDivider());
     ui->spnA4Gain->setValue(trkset.analog4Gain());
     ui->spnA4Off->setValue(trkset.analog4Offset());
     ui->spnA5Gain->setValue(trkset.analog5Gain());
@@ -718,6 +768,17 @@ void MainWindow::updateFromUI()
     if(trkset.hardware() == "NANO33BLE") {
         trkset.setLPTiltRoll(ui->spnLPTiltRoll->value());
         trkset.setLPPan(ui->spnLPPan->value());
+        trkset.setLPMode(ui->cmbLPMode->currentIndex());
+        trkset.setLPMinCutoff(ui->spnLPMinCut->value());
+        trkset.setLPSlope(ui->spnLPSlope->value());
+        trkset.setPredictTime(ui->spnPredict->value());
+        trkset.setFusionEngine(ui->cmbFusion->currentIndex());
+        trkset.setIMUODR(ui->cmbIMURate->currentData().toInt());
+        trkset.setGyroBW(ui->cmbGyroBW->currentData().toInt());
+        trkset.setGyroFS(ui->cmbGyroFS->currentData().toInt());
+        trkset.setAccFS(ui->cmbAccFS->currentData().toInt());
+        trkset.setMagODR(ui->cmbMagRate->currentData().toInt());
+        trkset.setFusionDivider(ui->spnFusionDiv->value());
     } else if (trkset.hardware() == "BNO055") {
         trkset.setLPTiltRoll(ui->spnLPTiltRoll2->value());
         trkset.setLPPan(ui->spnLPPan2->value());
@@ -832,6 +893,9 @@ void MainWindow::updateFromUI()
 
     trkset.setInvertedSBUSOut(ui->chkSbusOutInv->isChecked());
     trkset.setSBUSRate(ui->spnSBUSRate->value());
+    trkset.setSBUSHWTimed(ui->chkSbusHWTimed->isChecked());
+    trkset.setMAVGimbalDevice(ui->chkMavGimbalDevice->isChecked());
+    trkset.setSerialMode(ui->cmdSerial->currentIndex());
 
     uint16_t setframelen = ui->spnPPMFrameLen->value() * 1000;
     trkset.setPPMFrame(setframelen);
@@ -863,6 +927,7 @@ void MainWindow::updateFromUI()
     trkset.setInvertedPpmOut(ui->chkInvertedPPM->isChecked());
     trkset.setInvertedPpmIn(ui->chkInvertedPPMIn->isChecked());
     trkset.setResetOnWave(ui->chkResetCenterWave->isChecked());
+    trkset.setBTNotifyOnChange(ui->chkBTOnChange->isChecked());
 
 
     ui->cmdStore->setEnabled(true);
@@ -961,12 +1026,46 @@ void MainWindow::liveDataChanged()
 {
     ui->lblBLEAddress->setText(trkset.blueToothAddress());
     ui->btLed->setState(trkset.blueToothConnected());
-    if(trkset.blueToothConnected())
+    if(trkset.blueToothConnected() && trkset.blueToothReconnectTime() > 0)
+        ui->lblBTConnected->setText(tr("Connected, reconnect took %1 ms")
+                                    .arg(trkset.blueToothReconnectTime()));
+    else if(trkset.blueToothConnected() && trkset.blueToothPeers() > 1)
+        ui->lblBTConnected->setText(tr("Connected to %1 receivers").arg(trkset.blueToothPeers()));
+    else if(trkset.blueToothConnected())
         ui->lblBTConnected->setText(tr("Connected"));
     else
         ui->lblBTConnected->setText(tr("Not connected"));
     if(trkset.blueToothMode() == TrackerSettings::BTDISABLE)
         ui->lblBTConnected->setText("Disabled");
+    ui->lblBTLatency->setText(QString("%1 ms, %2 queued")
+                              .arg(trkset.blueToothLatency() / 1000.0, 0, 'f', 1)
+                              .arg(trkset.blueToothQueue()));
+    QString peerstats = tr("Receiver rate/latency");
+    for(int i=0; i < 3; i++) {
+        if(trkset.blueToothPeerRate(i) == 0 && trkset.blueToothPeerLatency(i) == 0)
+            continue;
+        peerstats += QString("\n%1: %2 Hz/%3 ms").arg(i+1)
+                                               .arg(trkset.blueToothPeerRate(i))
+                                               .arg(trkset.blueToothPeerLatency(i) / 1000.0, 0, 'f', 1);
+    }
+    ui->lblBTLatency->setToolTip(peerstats);
+    static const char *phynames[] = {"1M", "2M", "Coded"};
+    QString phy = "-";
+    switch(trkset.blueToothPhy()) {
+    case 1: phy = "1M"; break;
+    case 2: phy = "2M"; break;
+    case 4: phy = "Coded"; break;
+    }
+    if(trkset.blueToothConnected())
+        phy += QString(", %1 dBm").arg(trkset.blueToothRSSI());
+    ui->lblBTPhy->setText(phy);
+    QString phystats = tr("Packets sent/late");
+    for(int i=0; i < 3; i++)
+        phystats += QString("\n%1: %2/%3").arg(phynames[i])
+                                          .arg(trkset.blueToothPhyPackets(i))
+                                          .arg(trkset.blueToothPhyLate(i));
+    ui->lblBTPhy->setToolTip(phystats);
+    ui->lblJoystickRate->setText(tr("%1 reports/s").arg(trkset.joystickRate()));
     if(trkset.tiltRollPanEnabled()) {
       ui->servoPan->setShowActualPosition(true);
       ui->servoTilt->setShowActualPosition(true);
@@ -1211,9 +1310,21 @@ void MainWindow::BLE33tabChanged()
     dataitms["btcon"] = false;
     dataitms["btaddr"] = false;
     dataitms["btrmt"] = false;
+    dataitms["btlatency"] = false;
+    dataitms["btqueue"] = false;
+    dataitms["btphy"] = false;
+    dataitms["btrssi"] = false;
+    dataitms["btreconn"] = false;
+    dataitms["btpeers"] = false;
+    dataitms["btpeerrate"] = false;
+    dataitms["btpeerlat"] = false;
+    dataitms["btphypkt"] = false;
+    dataitms["btphylate"] = false;
+    dataitms["hidrate"] = false;
 
     switch(ui->tabBLE->currentIndex()) {
     case 0: { // General
+        dataitms["hidrate"] = true;
         break;
     }
     case 1: { // Output
@@ -1226,6 +1337,16 @@ void MainWindow::BLE33tabChanged()
         dataitms["btcon"] = true;
         dataitms["btrmt"] = true;
         dataitms["btaddr"] = true;
+        dataitms["btlatency"] = true;
+        dataitms["btqueue"] = true;
+        dataitms["btphy"] = true;
+        dataitms["btrssi"] = true;
+        dataitms["btreconn"] = true;
+        dataitms["btpeers"] = true;
+        dataitms["btpeerrate"] = true;
+        dataitms["btpeerlat"] = true;
+        dataitms["btphypkt"] = true;
+        dataitms["btphylate"] = true;
         break;
     }
     case 4: { // PWM
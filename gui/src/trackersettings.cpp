@@ -29,6 +29,17 @@ TrackerSettings::TrackerSettings(QObject *parent):
 
     _data["lppan"] = DEF_LP_PAN;
     _data["lptiltroll"] = DEF_LP_TLTRLL;
+    _data["lpmode"] = DEF_LP_MODE;
+    _data["lpmincut"] = DEF_LP_MINCUT;
+    _data["lpslope"] = DEF_LP_SLOPE;
+    _data["predict"] = DEF_PREDICT;
+    _data["fusion"] = DEF_FUSION;
+    _data["imuodr"] = DEF_IMU_ODR;
+    _data["gyrobw"] = DEF_GYRO_BW;
+    _data["gyrofs"] = DEF_GYRO_FS;
+    _data["accfs"] = DEF_ACC_FS;
+    _data["magodr"] = DEF_MAG_ODR;
+    _data["fusiondiv"] = DEF_FUSION_DIV;
 
     _data["axisremap"] = (uint)AXES_MAP(AXIS_X,AXIS_Y,AXIS_Z);
     _data["axissign"] = (uint)0;
@@ -45,6 +56,7 @@ TrackerSettings::TrackerSettings(QObject *parent):
 
     _data["ppmininvert"] = false;
     _data["btmode"] = (uint)0;
+    _data["btonchange"] = false;
     _data["orient"] = (uint)0;
     _data["rstppm"] = DEF_RST_PPM;
 
@@ -57,7 +69,10 @@ TrackerSettings::TrackerSettings(QObject *parent):
     // SBUS Defaults
     _data["sbininv"] = DEF_SBUS_IN_INV;
     _data["sboutinv"] = DEF_SBUS_OUT_INV;
+    _data["sermode"] = SERMODE_SBUS;
+    _data["mavgimdev"] = DEF_MAV_GIMBAL_DEVICE;
     _data["sbrate"] = DEF_SBUS_RATE;
+    _data["sbhwtimed"] = DEF_SBUS_HW_TIMED;
 
     // Analog defaults
     _data["an4ch"]  = DEF_ALG_A4_CH;
@@ -99,6 +114,16 @@ TrackerSettings::TrackerSettings(QObject *parent):
     #undef DA
     _devicerealtimedata = _realtimedata;
 
+    // Don't resend orientation for changes too small to see
+    _realtimedeadbands["tilt"] = 0.05f;
+    _realtimedeadbands["roll"] = 0.05f;
+    _realtimedeadbands["pan"] = 0.05f;
+    _realtimedeadbands["tiltoff"] = 0.05f;
+    _realtimedeadbands["rolloff"] = 0.05f;
+    _realtimedeadbands["panoff"] = 0.05f;
+    _realtimedeadbands["quat"] = 0.0005f;
+    _devicerealtimedeadbands = _realtimedeadbands;
+
 }
 
 int TrackerSettings::Rll_min() const
@@ -289,6 +314,127 @@ void TrackerSettings::setLPPan(int value)
     _data["lppan"] = value;
 }
 
+int TrackerSettings::lpMode() const
+{
+    return _data["lpmode"].toInt();
+}
+
+void TrackerSettings::setLPMode(int value)
+{
+    if(value == LP_MODE_FIXED || value == LP_MODE_ADAPTIVE)
+        _data["lpmode"] = value;
+}
+
+float TrackerSettings::lpMinCutoff() const
+{
+    return _data["lpmincut"].toFloat();
+}
+
+void TrackerSettings::setLPMinCutoff(float value)
+{
+    if(value >= MIN_LP_MINCUT && value <= MAX_LP_MINCUT)
+        _data["lpmincut"] = value;
+}
+
+float TrackerSettings::lpSlope() const
+{
+    return _data["lpslope"].toFloat();
+}
+
+void TrackerSettings::setLPSlope(float value)
+{
+    if(value >= 0 && value <= MAX_LP_SLOPE)
+        _data["lpslope"] = value;
+}
+
+int TrackerSettings::predictTime() const
+{
+    return _data["predict"].toInt();
+}
+
+void TrackerSettings::setPredictTime(int ms)
+{
+    if(ms >= 0 && ms <= MAX_PREDICT)
+        _data["predict"] = ms;
+}
+
+int TrackerSettings::fusionEngine() const
+{
+    return _data["fusion"].toInt();
+}
+
+void TrackerSettings::setFusionEngine(int value)
+{
+    if(value >= FUSION_MADGWICK && value <= FUSION_ESKF)
+        _data["fusion"] = value;
+}
+
+int TrackerSettings::imuODR() const
+{
+    return _data["imuodr"].toInt();
+}
+
+void TrackerSettings::setIMUODR(int hz)
+{
+    if(hz == 119 || hz == 238 || hz == 476)
+        _data["imuodr"] = hz;
+}
+
+int TrackerSettings::gyroBW() const
+{
+    return _data["gyrobw"].toInt();
+}
+
+void TrackerSettings::setGyroBW(int value)
+{
+    if(value >= 0 && value <= 3)
+        _data["gyrobw"] = value;
+}
+
+int TrackerSettings::gyroFS() const
+{
+    return _data["gyrofs"].toInt();
+}
+
+void TrackerSettings::setGyroFS(int dps)
+{
+    if(dps == 245 || dps == 500 || dps == 2000)
+        _data["gyrofs"] = dps;
+}
+
+int TrackerSettings::accFS() const
+{
+    return _data["accfs"].toInt();
+}
+
+void TrackerSettings::setAccFS(int g)
+{
+    if(g == 2 || g == 4 || g == 8 || g == 16)
+        _data["accfs"] = g;
+}
+
+int TrackerSettings::magODR() const
+{
+    return _data["magodr"].toInt();
+}
+
+void TrackerSettings::setMagODR(int hz)
+{
+    if(hz == 20 || hz == 40 || hz == 80)
+        _data["magodr"] = hz;
+}
+
+int TrackerSettings::fusionDivider() const
+{
+    return _data["fusiondiv"].toInt();
+}
+
+void TrackerSettings::setFusionDivider(int value)
+{
+    if(value >= 1 && value <= MAX_FUSION_DIV)
+        _data["fusiondiv"] = value;
+}
+
 int TrackerSettings::gyroWeightTiltRoll() const
 {
     return _data["gyroweighttiltroll"].toInt();
@@ -736,6 +882,30 @@ void TrackerSettings::setDataItemSend(const QString &itm, const bool &enabled)
     }
 }
 
+// Rate (hz) to send a data item at, 0 for the board default
+void TrackerSettings::setDataItemRate(const QString &itm, int hz)
+{
+    if(_realtimedata.contains(itm)) {
+        if(_realtimerates.value(itm, 0) != hz) {
+            _realtimerates[itm] = hz;
+            if(_realtimedata[itm])
+                emit requestedDataItemChanged();
+        }
+    }
+}
+
+// Change needed before the board resends an item, or an element of an array
+void TrackerSettings::setDataItemDeadband(const QString &itm, float deadband)
+{
+    if(_realtimedata.contains(itm)) {
+        if(_realtimedeadbands.value(itm, 0) != deadband) {
+            _realtimedeadbands[itm] = deadband;
+            if(_realtimedata[itm])
+                emit requestedDataItemChanged();
+        }
+    }
+}
+
 // Add/remove multiple items
 void TrackerSettings::setDataItemSend(QMap<QString, bool> items)
 {
@@ -753,7 +923,9 @@ QMap<QString, bool> TrackerSettings::getDataItemsDiff()
     QMapIterator<QString, bool> i(_realtimedata);
     while (i.hasNext()) {
         i.next();
-        if(_devicerealtimedata[i.key()] != i.value()) {
+        if(_devicerealtimedata[i.key()] != i.value() ||
+           (i.value() && _devicerealtimerates.value(i.key(), 0) != _realtimerates.value(i.key(), 0)) ||
+           (i.value() && _devicerealtimedeadbands.value(i.key(), 0) != _realtimedeadbands.value(i.key(), 0))) {
             diffs[i.key()] = i.value();
         }
     }
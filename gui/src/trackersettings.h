@@ -48,7 +48,16 @@
     DV(bool,btcon,       10,-1)\
     DV(bool,isSense,     10,-1)\
     DV(bool,trpenabled,  10,-1)\
-    DV(uint8_t, cpuuse,  1,-1)
+    DV(uint8_t, cpuuse,  1,-1)\
+    DV(uint16_t,fusioncyc,5,-1)\
+    DV(bool,magdist,     5,-1)\
+    DV(uint16_t,btlatency,10,-1)\
+    DV(uint8_t, btqueue, 10,-1)\
+    DV(uint8_t, btphy,   10,-1)\
+    DV(int8_t,  btrssi,  10,-1)\
+    DV(uint16_t,btreconn,10,-1)\
+    DV(uint8_t, btpeers, 10,-1)\
+    DV(uint16_t,hidrate, 10,-1)
 
 // To shorten names, as these are sent to the GUI for decoding
 #define u8  uint8_t
@@ -67,15 +76,21 @@
     DA(u16, sbusch, 16, 1)\
     DA(flt, quat,4, 1)\
     DA(chr, btaddr,18, 20) \
-    DA(chr, btrmt,18, 10)
+    DA(chr, btrmt,18, 10)\
+    DA(u16, btphypkt, 3, 10)\
+    DA(u16, btphylate, 3, 10)\
+    DA(u16, btpeerrate, 3, 10)\
+    DA(u16, btpeerlat, 3, 10)
 
 class TrackerSettings : public QObject
 {    
     Q_OBJECT
 public:
     enum {BTDISABLE,BTPARAHEAD,BTPARARMT};
+    enum {SERMODE_SBUS,SERMODE_CRSF,SERMODE_MAVLINK};
 
     static constexpr int MIN_PWM=988;
+    static constexpr int MAX_DATA_RATE=100; // (hz) Fastest the board sends a data item
     static constexpr int MAX_PWM=2012;
     static constexpr int DEF_MIN_PWM=1050;
     static constexpr int DEF_MAX_PWM=1950;
@@ -115,6 +130,27 @@ public:
     static constexpr int DEF_ALERT_CH = -1;
     static constexpr int DEF_LP_PAN = 75;
     static constexpr int DEF_LP_TLTRLL = 75;
+    static constexpr int LP_MODE_FIXED = 0;
+    static constexpr int LP_MODE_ADAPTIVE = 1;
+    static constexpr int DEF_LP_MODE = LP_MODE_FIXED;
+    static constexpr float DEF_LP_MINCUT = 0.5;
+    static constexpr float MIN_LP_MINCUT = 0.05;
+    static constexpr float MAX_LP_MINCUT = 20;
+    static constexpr float DEF_LP_SLOPE = 0.2;
+    static constexpr float MAX_LP_SLOPE = 1;
+    static constexpr int DEF_PREDICT = 0;
+    static constexpr int MAX_PREDICT = 100;
+    static constexpr int FUSION_MADGWICK = 0;
+    static constexpr int FUSION_MAHONY = 1;
+    static constexpr int FUSION_ESKF = 2;
+    static constexpr int DEF_FUSION = FUSION_MADGWICK;
+    static constexpr int DEF_IMU_ODR = 119;
+    static constexpr int DEF_GYRO_BW = 0;
+    static constexpr int DEF_GYRO_FS = 2000;
+    static constexpr int DEF_ACC_FS = 4;
+    static constexpr int DEF_MAG_ODR = 80;
+    static constexpr int DEF_FUSION_DIV = 1;
+    static constexpr int MAX_FUSION_DIV = 8;
     static constexpr int DEF_PWM_A0_CH = -1;
     static constexpr int DEF_PWM_A1_CH = -1;
     static constexpr int DEF_PWM_A2_CH = -1;
@@ -122,6 +158,8 @@ public:
     static constexpr bool DEF_SBUS_IN_INV = false;
     static constexpr bool DEF_SBUS_OUT_INV = false;
     static constexpr int DEF_SBUS_RATE = 60;
+    static constexpr bool DEF_SBUS_HW_TIMED = false;
+    static constexpr bool DEF_MAV_GIMBAL_DEVICE = false;
     static constexpr int DEF_ALG_A4_CH = -1;
     static constexpr int DEF_ALG_A5_CH = -1;
     static constexpr int DEF_ALG_A6_CH = -1;
@@ -178,6 +216,39 @@ public:
     int lpTiltRoll() const;
     void setLPTiltRoll(int value);
 
+    int lpMode() const;
+    void setLPMode(int value);
+
+    float lpMinCutoff() const;
+    void setLPMinCutoff(float value);
+
+    float lpSlope() const;
+    void setLPSlope(float value);
+
+    int predictTime() const;
+    void setPredictTime(int ms);
+
+    int fusionEngine() const;
+    void setFusionEngine(int value);
+
+    int imuODR() const;
+    void setIMUODR(int hz);
+
+    int gyroBW() const;
+    void setGyroBW(int value);
+
+    int gyroFS() const;
+    void setGyroFS(int dps);
+
+    int accFS() const;
+    void setAccFS(int g);
+
+    int magODR() const;
+    void setMagODR(int hz);
+
+    int fusionDivider() const;
+    void setFusionDivider(int value);
+
     int gyroWeightTiltRoll() const;
     void setGyroWeightTiltRoll(int value);
 
@@ -234,6 +305,13 @@ public:
 
     void setSBUSRate(uint rate) {_data["sbrate"] = rate;}
     uint SBUSRate() { return _data["sbrate"].toUInt();}
+    void setSBUSHWTimed(bool v) {_data["sbhwtimed"] = v;}
+    bool SBUSHWTimed() { return _data["sbhwtimed"].toBool();}
+
+    void setSerialMode(int mode) {_data["sermode"] = mode;}
+    int serialMode() { return _data["sermode"].toInt();}
+    void setMAVGimbalDevice(bool v) {_data["mavgimdev"] = v;}
+    bool MAVGimbalDevice() { return _data["mavgimdev"].toBool();}
 
     int buttonPin() const;
     void setButtonPin(int value);
@@ -321,6 +399,19 @@ public:
     void setBlueToothMode(int mode);
     QString blueToothAddress();
     bool blueToothConnected() {return _live["btcon"].toBool();}
+    int blueToothLatency() {return _live["btlatency"].toInt();}
+    int blueToothQueue() {return _live["btqueue"].toInt();}
+    int blueToothPhy() {return _live["btphy"].toInt();}
+    int blueToothRSSI() {return _live["btrssi"].toInt();}
+    int blueToothReconnectTime() {return _live["btreconn"].toInt();}
+    int blueToothPeers() {return _live["btpeers"].toInt();}
+    int blueToothPeerRate(int peer) {return _live[QString("btpeerrate[%1]").arg(peer)].toInt();}
+    int blueToothPeerLatency(int peer) {return _live[QString("btpeerlat[%1]").arg(peer)].toInt();}
+    int blueToothPhyPackets(int phy) {return _live[QString("btphypkt[%1]").arg(phy)].toInt();}
+    int blueToothPhyLate(int phy) {return _live[QString("btphylate[%1]").arg(phy)].toInt();}
+    int joystickRate() {return _live["hidrate"].toInt();}
+    bool btNotifyOnChange() const {return _data["btonchange"].toBool();}
+    void setBTNotifyOnChange(bool value) {_data["btonchange"] = value;}
     bool tiltRollPanEnabled() {return _live["trpenabled"].toBool();}
 
     void setPairedBTAddress(QString addr="") {_data["btpair"] = addr;}
@@ -359,7 +450,13 @@ public:
     void setDataItemSend(const QString &itm, const bool &enabled);
     void setDataItemSend(QMap<QString,bool> items);
     QMap<QString, bool> getDataItemsDiff();
-    void setDataItemsMatched() {_devicerealtimedata = _realtimedata;}
+    void setDataItemsMatched() {_devicerealtimedata = _realtimedata;
+                                _devicerealtimerates = _realtimerates;
+                                _devicerealtimedeadbands = _realtimedeadbands;}
+    void setDataItemRate(const QString &itm, int hz);
+    int dataItemRate(const QString &itm) {return _realtimerates.value(itm, 0);}
+    void setDataItemDeadband(const QString &itm, float deadband);
+    float dataItemDeadband(const QString &itm) {return _realtimedeadbands.value(itm, 0);}
     // Gets all currently sending data items
     QMap<QString, bool> getDataItems();    
     QStringList allDataItems();
@@ -381,6 +478,10 @@ private:
     QVariantMap _live; // Live Data (Realtime)
     QMap<QString, bool> _realtimedata;
     QMap<QString, bool> _devicerealtimedata;
+    QMap<QString, int> _realtimerates; // Requested rate (hz), 0 = board default
+    QMap<QString, int> _devicerealtimerates;
+    QMap<QString, float> _realtimedeadbands; // Change needed before the board resends an item
+    QMap<QString, float> _devicerealtimedeadbands;
     QStringList bleAddresses;
 };
 